@@ -35,4 +35,5 @@ extern void register_base64(void);
 extern void register_fileio(void);
 extern void register_system(void);
 extern void register_exec(void);
+extern void register_query(void);
 extern void register_crypto(void);
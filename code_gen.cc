@@ -49,6 +49,7 @@ typedef struct fixup Fixup;
 
 struct gstate {
     unsigned total_var_refs;	/* For duplicating an old bug... */
+    unsigned builtin_var_refs;	/* Which built-in variables are used */
     unsigned num_literals, max_literals;
     Var *literals;
     unsigned num_fork_vectors, max_fork_vectors;
@@ -80,6 +81,10 @@ struct state {
     Byte *trymap;
     unsigned try_depth;
 #endif				/* BYTECODE_REDUCE_REF */
+#ifdef BYTECODE_INT_OPS
+    Byte *intmap;		/* integer opcode to substitute, or 0 */
+    unsigned comparison_pc;	/* where the last comparison op went */
+#endif				/* BYTECODE_INT_OPS */
     unsigned cur_stack, max_stack;
     unsigned saved_stack;
     unsigned num_loops, max_loops;
@@ -107,6 +112,7 @@ static void
 init_gstate(GState * gstate)
 {
     gstate->total_var_refs = 0;
+    gstate->builtin_var_refs = 0;
     gstate->num_literals = gstate->num_fork_vectors = 0;
     gstate->max_literals = gstate->max_fork_vectors = 0;
     gstate->fork_vectors = 0;
@@ -142,6 +148,10 @@ init_state(State * state, GState * gstate)
     state->trymap = (Byte *)mymalloc(sizeof(Byte) * state->max_bytes, M_BYTECODES);
     state->try_depth = 0;
 #endif				/* BYTECODE_REDUCE_REF */
+#ifdef BYTECODE_INT_OPS
+    state->intmap = (Byte *)mymalloc(sizeof(Byte) * state->max_bytes, M_BYTECODES);
+    state->comparison_pc = UINT_MAX;
+#endif				/* BYTECODE_INT_OPS */
 
     state->cur_stack = state->max_stack = 0;
     state->saved_stack = UINT_MAX;
@@ -162,6 +172,9 @@ free_state(State state)
     myfree(state.pushmap, M_BYTECODES);
     myfree(state.trymap, M_BYTECODES);
 #endif				/* BYTECODE_REDUCE_REF */
+#ifdef BYTECODE_INT_OPS
+    myfree(state.intmap, M_BYTECODES);
+#endif				/* BYTECODE_INT_OPS */
     myfree(state.loops, M_CODE_GEN);
 }
 
@@ -178,12 +191,19 @@ emit_byte(Byte b, State * state)
 	state->trymap = (Byte *)myrealloc(state->trymap, sizeof(Byte) * new_max,
 					  M_BYTECODES);
 #endif				/* BYTECODE_REDUCE_REF */
+#ifdef BYTECODE_INT_OPS
+	state->intmap = (Byte *)myrealloc(state->intmap, sizeof(Byte) * new_max,
+					  M_BYTECODES);
+#endif				/* BYTECODE_INT_OPS */
 	state->max_bytes = new_max;
     }
 #ifdef BYTECODE_REDUCE_REF
     state->pushmap[state->num_bytes] = 0;
     state->trymap[state->num_bytes] = state->try_depth;
 #endif				/* BYTECODE_REDUCE_REF */
+#ifdef BYTECODE_INT_OPS
+    state->intmap[state->num_bytes] = 0;
+#endif				/* BYTECODE_INT_OPS */
     state->bytes[state->num_bytes++] = b;
 }
 
@@ -316,9 +336,17 @@ add_fork(Bytecodes b, State * state)
 	state->max_fork = i;
 }
 
+static void
+note_var_use(unsigned slot, State * state)
+{
+    if (slot <= SLOT_ANON)
+	state->gstate->builtin_var_refs |= 1U << slot;
+}
+
 static void
 add_var_ref(unsigned slot, State * state)
 {
+    note_var_use(slot, state);
     add_fixup(FIXUP_VAR_REF, slot, state);
     state->num_var_refs++;
     if (slot > state->max_var_ref)
@@ -509,6 +537,7 @@ emit_var_op(Opcode op, unsigned slot, State * state)
 	emit_byte(op + NUM_READY_VARS, state);
 	add_var_ref(slot, state);
     } else {
+	note_var_use(slot, state);
 	emit_byte(op + slot, state);
 #ifdef BYTECODE_REDUCE_REF
 	state->pushmap[state->num_bytes - 1] = op;
@@ -516,6 +545,45 @@ emit_var_op(Opcode op, unsigned slot, State * state)
     }
 }
 
+static void
+emit_test_op(Opcode op, State * state)
+{
+#ifdef BYTECODE_INT_OPS
+    /* A comparison whose result is tested straight away */
+    if (state->comparison_pc + 1 == state->num_bytes) {
+	Byte cmp = state->bytes[state->comparison_pc];
+
+	state->intmap[state->comparison_pc] = cmp - OP_EQ + OP_EQ_TEST;
+    }
+#endif				/* BYTECODE_INT_OPS */
+    emit_byte(op, state);
+}
+
+#ifdef BYTECODE_INT_OPS
+/* Whether EXPR, the right-hand side of an assignment to the variable ID,
+ * has the form `ID + y', `ID - y' or `ID * y', where y is either another
+ * ready variable or a small integer.
+ */
+static int
+is_int_update(int id, Expr * expr)
+{
+    Expr *lhs, *rhs;
+
+    if (id >= NUM_READY_VARS
+	|| (expr->kind != EXPR_PLUS && expr->kind != EXPR_MINUS
+	    && expr->kind != EXPR_TIMES))
+	return 0;
+    lhs = expr->e.bin.lhs;
+    rhs = expr->e.bin.rhs;
+    if (lhs->kind != EXPR_ID || lhs->e.id != id)
+	return 0;
+    if (rhs->kind == EXPR_ID)
+	return rhs->e.id < NUM_READY_VARS;
+    return (rhs->kind == EXPR_VAR && rhs->e.var.type == TYPE_INT
+	    && IN_OPTIM_NUM_RANGE(rhs->e.var.v.num));
+}
+#endif				/* BYTECODE_INT_OPS */
+
 static void generate_expr(Expr *, State *);
 
 static void
@@ -710,6 +778,10 @@ generate_expr(Expr * expr, State * state)
 	    default:
 		panic("Not a binary operator in GENERATE_EXPR()");
 	    }
+#ifdef BYTECODE_INT_OPS
+	    if (op >= OP_EQ && op <= OP_GE)
+		state->comparison_pc = state->num_bytes;
+#endif				/* BYTECODE_INT_OPS */
 	    emit_byte(op, state);
 	    pop_stack(1, state);
 	}
@@ -823,7 +895,7 @@ generate_expr(Expr * expr, State * state)
 	    int else_label, end_label;
 
 	    generate_expr(expr->e.cond.condition, state);
-	    emit_byte(OP_IF_QUES, state);
+	    emit_test_op(OP_IF_QUES, state);
 	    else_label = add_label(state);
 	    pop_stack(1, state);
 	    generate_expr(expr->e.cond.consequent, state);
@@ -879,9 +951,19 @@ generate_expr(Expr * expr, State * state)
 		define_label(done, state);
 	    } else {
 		int is_indexed = 0;
+#ifdef BYTECODE_INT_OPS
+		unsigned rhs_pc;
+#endif				/* BYTECODE_INT_OPS */
 
 		push_lvalue(e, 0, state);
+#ifdef BYTECODE_INT_OPS
+		rhs_pc = state->num_bytes;
+		generate_expr(expr->e.bin.rhs, state);
+		if (e->kind == EXPR_ID && is_int_update(e->e.id, expr->e.bin.rhs))
+		    state->intmap[rhs_pc] = OP_UPDATE_INT;
+#else				/* no BYTECODE_INT_OPS */
 		generate_expr(expr->e.bin.rhs, state);
+#endif				/* BYTECODE_INT_OPS */
 		if (e->kind == EXPR_RANGE || e->kind == EXPR_INDEX)
 		    emit_byte(OP_PUT_TEMP, state);
 		while (1) {
@@ -972,7 +1054,7 @@ generate_stmt(Stmt * stmt, State * state)
 		    int else_label;
 
 		    generate_expr(arms->condition, state);
-		    emit_byte(if_op, state);
+		    emit_test_op(if_op, state);
 		    else_label = add_label(state);
 		    pop_stack(1, state);
 		    generate_stmt(arms->stmt, state);
@@ -1046,7 +1128,7 @@ generate_stmt(Stmt * stmt, State * state)
 		loop_top = capture_label(state);
 		generate_expr(stmt->s.loop.condition, state);
 		if (stmt->s.loop.id == -1)
-		    emit_byte(OP_WHILE, state);
+		    emit_test_op(OP_WHILE, state);
 		else {
 		    emit_extended_byte(EOP_WHILE_ID, state);
 		    add_var_ref(stmt->s.loop.id, state);
@@ -1329,6 +1411,25 @@ stmt_to_code(Stmt * stmt, GState * gstate)
     myfree(bbd, M_CODE_GEN);
 #endif				/* BYTECODE_REDUCE_REF */
 
+#ifdef BYTECODE_INT_OPS
+    /*
+     * Now that the PUSH/PUSH_CLEAR decisions have been made, substitute
+     * the integer opcodes marked during generation.  Each one replaces
+     * the first byte of its sequence, and the interpreter can recover
+     * that byte from the rest of the sequence when it has to fall back.
+     */
+    for (old_i = 0; old_i < (int) state.num_bytes; old_i++)
+	if (state.intmap[old_i] == OP_UPDATE_INT) {
+#ifdef BYTECODE_REDUCE_REF
+	    if (IS_PUSH_CLEAR_n(state.bytes[old_i]))
+		state.bytes[old_i] = OP_UPDATE_INT_CLEAR;
+	    else
+#endif				/* BYTECODE_REDUCE_REF */
+		state.bytes[old_i] = OP_UPDATE_INT;
+	} else if (state.intmap[old_i])
+	    state.bytes[old_i] = state.intmap[old_i];
+#endif				/* BYTECODE_INT_OPS */
+
     fixup = state.fixups;
     fix_i = 0;
     for (old_i = new_i = 0; old_i < state.num_bytes; old_i++) {
@@ -1395,6 +1496,7 @@ generate_code(Stmt * stmt, DB_Version version)
 
     prog->main_vector = stmt_to_code(stmt, &gstate);
     prog->version = version;
+    prog->builtin_var_refs = gstate.builtin_var_refs;
 
     if (gstate.literals) {
 	unsigned i;
@@ -120,6 +120,13 @@ extern void db_set_last_used_objid(Objid);
 				 * referring to a currently-valid object.
 				 */
 
+extern Var db_object_table_stats(void);
+				/* Returns a map describing the object table:
+				 * its slots, valid objects and recycled holes,
+				 * and the object structures allocated and
+				 * free for reuse.
+				 */
+
 extern void db_destroy_object(Objid);
 				/* Destroys object, freeing all associated
 				 * storage.  The object must not have parents,
@@ -157,7 +164,9 @@ extern Var db_ancestors(Var, bool);
 				 * given object.  db_ancestors() does not/
 				 * can not free the returned list.  The caller
 				 * should therefore free it once it has finished
-				 * operating on it.
+				 * operating on it.  The list may be shared
+				 * with the object's ancestor cache, so it
+				 * must not be modified in place.
 				 */
 
 extern Var db_descendants(Var, bool);
@@ -232,7 +241,25 @@ extern int db_change_parents(Var obj, Var parents, Var anon_kids);
 				 * its ancestors.
 				 */
 
+extern Var db_create_children(Var parents, Objid owner, int count);
+				/* Creates COUNT (at least one) new objects
+				 * with PARENTS and OWNER (#-1 meaning each
+				 * owns itself), as db_create_object() and
+				 * db_change_parents() would, but growing the
+				 * object table and the parents' children only
+				 * once.  Returns the list of new objects, or a
+				 * value of TYPE_NONE (having created nothing)
+				 * if db_change_parents() would fail.
+				 */
+
 extern Objid db_object_location(Objid);
+extern unsigned db_contents_stamp(Objid);
+				/* Returns a number that changes whenever the
+				 * contents of the given object change, or the
+				 * name or `aliases' property of any of them
+				 * might have, for caching what is known about
+				 * the contents.
+				 */
 extern int db_count_contents(Objid);
 extern int db_for_all_contents(Objid,
 			       int (*)(void *, Objid),
@@ -394,6 +421,8 @@ typedef struct {
     enum bi_prop built_in;	/* true iff property is a built-in one */
     void *definer;		/* null iff property is a built-in one */
     void *ptr;			/* null iff property not found */
+    int index;			/* the property's slot on `ptr' */
+    bool aliases;		/* true iff it's an `aliases' property */
 } db_prop_handle;
 
 extern db_prop_handle db_find_property(Var obj, const char *name,
@@ -483,7 +512,8 @@ typedef enum {
     VF_READ = 01,
     VF_WRITE = 02,
     VF_EXEC = 04,
-    VF_DEBUG = 010
+    VF_DEBUG = 010,
+    VF_PARALLEL = 0400		/* try commands in a worker first */
 } db_verb_flag;
 
 typedef enum {
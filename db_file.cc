@@ -304,6 +304,7 @@ ng_read_object(int anonymous)
     int i;
     Verbdef *v, **prevv;
     int nprops;
+    Pval *pvals;
 
     if (dbio_scanf("#%d", &oid) != 1)
 	return 0;
@@ -334,10 +335,10 @@ ng_read_object(int anonymous)
     o->owner = dbio_read_objid();
 
     o->location = dbio_read_var();
-    o->contents = dbio_read_var();
+    dbpriv_init_objset(&o->contents, dbio_read_var());
 
     o->parents = dbio_read_var();
-    o->children = dbio_read_var();
+    dbpriv_init_objset(&o->children, dbio_read_var());
 
     o->verbdefs = 0;
     prevv = &(o->verbdefs);
@@ -364,16 +365,17 @@ ng_read_object(int anonymous)
 	}
     }
 
-    o->nval = nprops = dbio_read_num();
-    if (nprops)
-	o->propval = (Pval *)mymalloc(nprops * sizeof(Pval), M_PVAL);
-    else
-	o->propval = 0;
+    nprops = dbio_read_num();
+    pvals = nprops ? (Pval *)mymalloc(nprops * sizeof(Pval), M_PVAL) : 0;
 
     for (i = 0; i < nprops; i++) {
-	read_propval(o->propval + i);
+	read_propval(pvals + i);
     }
 
+    dbpriv_set_propvals(o, pvals, nprops);
+    if (pvals)
+	myfree(pvals, M_PVAL);
+
     return 1;
 }
 
@@ -445,10 +447,10 @@ ng_write_object(Objid oid)
     dbio_write_objid(o->owner);
 
     dbio_write_var(o->location);
-    dbio_write_var(o->contents);
+    dbio_write_var(dbpriv_object_contents(o));
 
     dbio_write_var(o->parents);
-    dbio_write_var(o->children);
+    dbio_write_var(dbpriv_object_children(o));
 
     for (v = o->verbdefs, nverbdefs = 0; v; v = v->next)
 	nverbdefs++;
@@ -463,8 +465,11 @@ ng_write_object(Objid oid)
 
     nprops = o->nval;
     dbio_write_num(nprops);
-    for (i = 0; i < nprops; i++)
-	write_propval(o->propval + i);
+    for (i = 0; i < nprops; i++) {
+	Pval pval = dbpriv_propval(o, i);
+
+	write_propval(&pval);
+    }
 }
 
 
@@ -648,7 +653,7 @@ ng_validate_hierarchies()
 		       oid);
 		broken = 1;
 	    }
-	    if (!is_list_of_objs(o->children)) {
+	    if (!is_list_of_objs(o->children.list)) {
 		errlog("VALIDATE: #%d.children is not a list of objects.\n",
 		       oid);
 		broken = 1;
@@ -658,7 +663,7 @@ ng_validate_hierarchies()
 		       oid);
 		broken = 1;
 	    }
-	    if (!is_list_of_objs(o->contents)) {
+	    if (!is_list_of_objs(o->contents.list)) {
 		errlog("VALIDATE: #%d.contents is not a list of objects.\n",
 		       oid);
 		broken = 1;
@@ -688,9 +693,9 @@ ng_validate_hierarchies()
 
 	    if (!broken) {
 		CHECK(parents, "parent");
-		CHECK(children, "child");
+		CHECK(children.list, "child");
 		CHECK(location, "location");
-		CHECK(contents, "content");
+		CHECK(contents.list, "content");
 	    }
 
 #	    undef CHECK
@@ -736,11 +741,11 @@ ng_validate_hierarchies()
 		Var tmp, t1, t2, obj;					\
 		obj.type = TYPE_OBJ;					\
 		obj.v.obj = oid;					\
-		t1 = enlist_var(var_ref(o->up));			\
+		t1 = enlist_var(var_ref(dbpriv_object_##up(o)));	\
 		FOR_EACH(tmp, t1, i, c) {				\
 		    if (tmp.v.obj != NOTHING) {				\
 			Object *otmp = dbpriv_find_object(tmp.v.obj);	\
-			t2 = enlist_var(var_ref(otmp->down));		\
+			t2 = enlist_var(var_ref(dbpriv_object_##down(otmp))); \
 			if (ismember(obj, t2, 1)) {			\
 			    free_var(t2);				\
 			    continue;					\
@@ -808,18 +813,22 @@ v4_upgrade_objects()
 
 	    _new->parents = var_dup(new_obj(o->parent));
 
-	    _new->children = new_list(0);
+	    Var children = new_list(0);
 	    for (iter = o->child; iter != NOTHING; iter = objects[iter]->sibling)
-		_new->children = listappend(_new->children, var_dup(new_obj(iter)));
+		children = listappend(children, var_dup(new_obj(iter)));
+	    dbpriv_init_objset(&_new->children, children);
 
 	    _new->location = var_dup(new_obj(o->location));
 
-	    _new->contents = new_list(0);
+	    Var contents = new_list(0);
 	    for (iter = o->contents; iter != NOTHING; iter = objects[iter]->next)
-		_new->contents = listappend(_new->contents, var_dup(new_obj(iter)));
+		contents = listappend(contents, var_dup(new_obj(iter)));
+	    dbpriv_init_objset(&_new->contents, contents);
 
-	    _new->propval = o->propval;
-	    _new->nval = dbv4_count_properties(oid);
+	    dbpriv_set_propvals(_new, o->propval,
+				dbv4_count_properties(oid));
+	    if (o->propval)
+		myfree(o->propval, M_PVAL);
 
 	    _new->verbdefs = o->verbdefs;
 	    _new->propdefs = o->propdefs;
@@ -1058,10 +1067,11 @@ write_db_file(const char *reason)
 {
     Objid oid;
     Objid last_oid = db_last_used_objid(), max_oid = -1;
-    int nprogs = 0;
+    const Objid *oids;
+    int nprogs = 0, noids;
     Verbdef *v;
     Var user_list;
-    int i;
+    int i, j;
     volatile int success = 1;
 
     try {
@@ -1098,29 +1108,31 @@ write_db_file(const char *reason)
 
 	dbio_printf("%d\n", 0);
 
-	for (oid = 0; oid <= max_oid; oid++) {
-	    if (valid(oid))
-		for (v = dbpriv_find_object(oid)->verbdefs; v; v = v->next)
-		    if (v->program)
-			nprogs++;
-	}
+	oids = dbpriv_live_objects(&noids);
+	while (noids > 0 && oids[noids - 1] > max_oid)
+	    noids--;
+
+	for (j = 0; j < noids; j++)
+	    for (v = dbpriv_find_object(oids[j])->verbdefs; v; v = v->next)
+		if (v->program)
+		    nprogs++;
 
 	dbio_printf("%d\n", nprogs);
 
 	oklog("%s: Writing %d MOO verb programs ...\n", reason, nprogs);
-	for (i = 0, oid = 0; oid <= max_oid; oid++) {
-	    if (valid(oid)) {
-		int vcount = 0;
-		for (v = dbpriv_find_object(oid)->verbdefs; v; v = v->next) {
-		    if (v->program) {
-			dbio_printf("#%d:%d\n", oid, vcount);
-			dbio_write_program(v->program);
-			if (++i % 5000 == 0 || i == nprogs)
-			    oklog("%s: Done writing %d verb programs ...\n",
-			          reason, i);
-		    }
-		    vcount++;
+	for (i = 0, j = 0; j < noids; j++) {
+	    int vcount = 0;
+
+	    oid = oids[j];
+	    for (v = dbpriv_find_object(oid)->verbdefs; v; v = v->next) {
+		if (v->program) {
+		    dbio_printf("#%d:%d\n", oid, vcount);
+		    dbio_write_program(v->program);
+		    if (++i % 5000 == 0 || i == nprogs)
+			oklog("%s: Done writing %d verb programs ...\n",
+			      reason, i);
 		}
+		vcount++;
 	    }
 	}
     }
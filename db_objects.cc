@@ -19,6 +19,8 @@
  * Routines for manipulating DB objects
  *****************************************************************************/
 
+#include <stdlib.h>
+
 #include "my-string.h"
 
 #include "config.h"
@@ -27,6 +29,7 @@
 #include "db_private.h"
 #include "collection.h"
 #include "list.h"
+#include "map.h"
 #include "program.h"
 #include "server.h"
 #include "storage.h"
@@ -44,10 +47,377 @@ static Var all_users;
 /* used in graph traversals */
 static unsigned char *bit_array;
 static size_t array_size = 0;
+
+/* Bumped on every change to the parent/child hierarchy that could
+ * change the ancestors of an existing object, which invalidates every
+ * object's cached ancestors at once.
+ */
+static unsigned int hierarchy_version = 1;
+
+/* Contents stamps are drawn from a single counter, so that the stamp of
+ * any object is the later of its own and the last one given to all.
+ */
+static unsigned int contents_stamps = 0;
+static unsigned int all_contents_stamp = 0;
+
+/* Objects are carved out of slabs of this many, and recycled ones are
+ * kept on a free list for reuse, so that objects made at about the
+ * same time sit together in memory.
+ */
+#define OBJECT_SLAB_SIZE 256
+
+static Object *free_objects = 0;	/* linked through their first word */
+static int slab_objects = 0, free_object_count = 0;
+
+/* The numbers of the valid objects, in order, for passes over the whole
+ * database.  Recycling an object leaves a stale entry behind, which is
+ * squeezed out the next time the list is asked for; creating an object
+ * out of order or renumbering one has the list rebuilt from scratch.
+ */
+static Objid *live = 0;
+static int live_count = 0, live_max = 0;
+static int live_stale = 0;
+static bool live_ok = false;
 
 
+/*********** Contents and children ***********/
+
+/* Sets with more objects than this get an index. */
+#define OBJSET_INDEX_THRESHOLD 64
+
+/* The objects in a large set, in order, with NOTHING in the holes left
+ * by removed objects, and a hash table (open addressing, with linear
+ * probing) of their positions.
+ */
+struct Objindex {
+    Objid *items;
+    int head;			/* items before this are all holes */
+    int used;			/* items used, including holes */
+    int count;			/* objects in the set */
+    int max;
+    int *slots;			/* positions in `items' plus one, or 0 */
+    unsigned int mask;
+};
+
+static unsigned int
+objid_hash(Objid oid)
+{
+    return (unsigned int)oid * 2654435761u;
+}
+
+/* Returns the slot holding `oid's position, or -1 if it isn't there. */
+static int
+index_find(Objindex *ix, Objid oid)
+{
+    unsigned int s;
+
+    for (s = objid_hash(oid) & ix->mask; ix->slots[s]; s = (s + 1) & ix->mask)
+	if (ix->items[ix->slots[s] - 1] == oid)
+	    return s;
+
+    return -1;
+}
+
+static void
+index_insert(Objindex *ix, int pos)
+{
+    unsigned int s;
+
+    for (s = objid_hash(ix->items[pos]) & ix->mask; ix->slots[s];
+	 s = (s + 1) & ix->mask)
+	;
+    ix->slots[s] = pos + 1;
+}
+
+/* Empties slot `s', moving back any later entries that would otherwise
+ * no longer be found.
+ */
+static void
+index_delete(Objindex *ix, unsigned int s)
+{
+    unsigned int j = s, k;
+
+    for (;;) {
+	j = (j + 1) & ix->mask;
+	if (!ix->slots[j])
+	    break;
+	k = objid_hash(ix->items[ix->slots[j] - 1]) & ix->mask;
+	/* can the entry in `j' move back to `s'? */
+	if (s <= j ? (k <= s || k > j) : (k <= s && k > j)) {
+	    ix->slots[s] = ix->slots[j];
+	    s = j;
+	}
+    }
+    ix->slots[s] = 0;
+}
+
+/* Squeezes out the holes, makes room for `max' items and rehashes. */
+static void
+rebuild_index(Objindex *ix, int max)
+{
+    unsigned int size;
+    int i, n = 0;
+
+    for (i = 0; i < ix->used; i++)
+	if (ix->items[i] != NOTHING)
+	    ix->items[n++] = ix->items[i];
+    ix->head = 0;
+    ix->used = n;
+
+    if (max != ix->max) {
+	ix->items = (Objid *)myrealloc(ix->items, max * sizeof(Objid), M_ARRAY);
+	ix->max = max;
+    }
+
+    for (size = 16; size < 2 * (unsigned int)max; size *= 2)
+	;
+    if (size != ix->mask + 1) {
+	if (ix->slots)
+	    myfree(ix->slots, M_ARRAY);
+	ix->slots = (int *)mymalloc(size * sizeof(int), M_ARRAY);
+	ix->mask = size - 1;
+    }
+    memset(ix->slots, 0, size * sizeof(int));
+
+    for (i = 0; i < n; i++)
+	index_insert(ix, i);
+}
+
+static Objindex *
+make_index(Var list)
+{
+    Objindex *ix = (Objindex *)mymalloc(sizeof(Objindex), M_ARRAY);
+    int i, n = listlength(list);
+
+    ix->max = 2 * n;
+    ix->items = (Objid *)mymalloc(ix->max * sizeof(Objid), M_ARRAY);
+    for (i = 1; i <= n; i++)
+	ix->items[i - 1] = list.v.list[i].v.obj;
+    ix->head = 0;
+    ix->used = ix->count = n;
+    ix->slots = 0;
+    ix->mask = 0;
+    rebuild_index(ix, ix->max);
+
+    return ix;
+}
+
+static void
+free_index(Objindex *ix)
+{
+    myfree(ix->items, M_ARRAY);
+    myfree(ix->slots, M_ARRAY);
+    myfree(ix, M_ARRAY);
+}
+
+void
+dbpriv_init_objset(Objset *s, Var list)
+{
+    s->list = list;
+    s->index = 0;
+}
+
+void
+dbpriv_free_objset(Objset *s)
+{
+    free_var(s->list);
+    s->list.type = TYPE_NONE;
+    if (s->index)
+	free_index(s->index);
+    s->index = 0;
+}
+
+/* Returns the set as a list, which isn't var_ref()ed. */
+static Var
+objset_list(Objset *s)
+{
+    Objindex *ix = s->index;
+    int i, n = 0;
+
+    if (s->list.type != TYPE_NONE)
+	return s->list;
+
+    s->list = new_list(ix->count);
+    for (i = ix->head; i < ix->used; i++)
+	if (ix->items[i] != NOTHING) {
+	    s->list.v.list[++n].type = TYPE_OBJ;
+	    s->list.v.list[n].v.obj = ix->items[i];
+	}
+
+    if (ix->count < OBJSET_INDEX_THRESHOLD / 2) {
+	free_index(ix);
+	s->index = 0;
+    } else if (ix->used > ix->count)
+	rebuild_index(ix, ix->max);
+
+    return s->list;
+}
+
+static int
+objset_count(Objset *s)
+{
+    return s->index ? s->index->count : listlength(s->list);
+}
+
+static void
+objset_add(Objset *s, Objid oid)
+{
+    Objindex *ix = s->index;
+
+    if (!ix) {
+	s->list = setadd(s->list, new_obj(oid));
+	if (listlength(s->list) > OBJSET_INDEX_THRESHOLD)
+	    s->index = make_index(s->list);
+	return;
+    }
+
+    if (index_find(ix, oid) >= 0)
+	return;
+
+    /* make room, first by filling in holes */
+    if (ix->used == ix->max)
+	rebuild_index(ix, ix->count > ix->max / 2 ? ix->max * 2 : ix->max);
+
+    ix->items[ix->used] = oid;
+    index_insert(ix, ix->used++);
+    ix->count++;
+
+    /* a list that's up to date can often be extended in place */
+    if (s->list.type != TYPE_NONE) {
+	if (var_refcount(s->list) == 1)
+	    s->list = listappend(s->list, new_obj(oid));
+	else {
+	    free_var(s->list);
+	    s->list.type = TYPE_NONE;
+	}
+    }
+}
+
+/* Adds the objects in `oids', none of which are members yet. */
+static void
+objset_append(Objset *s, Var oids)
+{
+    Var oid;
+    int i, c;
+
+    if (!s->index) {
+	s->list = listconcat(s->list, var_ref(oids));
+	if (listlength(s->list) > OBJSET_INDEX_THRESHOLD)
+	    s->index = make_index(s->list);
+    } else
+	FOR_EACH(oid, oids, i, c)
+	    objset_add(s, oid.v.obj);
+}
+
+static void
+objset_remove(Objset *s, Objid oid)
+{
+    Objindex *ix = s->index;
+    int slot;
+
+    /* A large set read from the database is indexed when it first loses
+     * a member, not when it's read, since validation edits its list.
+     */
+    if (!ix && listlength(s->list) > OBJSET_INDEX_THRESHOLD)
+	ix = s->index = make_index(s->list);
+    if (!ix) {
+	s->list = setremove(s->list, new_obj(oid));
+	return;
+    }
+
+    if ((slot = index_find(ix, oid)) < 0)
+	return;
+
+    ix->items[ix->slots[slot] - 1] = NOTHING;
+    index_delete(ix, slot);
+    ix->count--;
+    while (ix->head < ix->used && ix->items[ix->head] == NOTHING)
+	ix->head++;
+
+    free_var(s->list);
+    s->list.type = TYPE_NONE;
+}
+
+/* Calls `func' on each object in the set, stopping when it returns
+ * true.  Large sets are walked without building their list, so that
+ * emptying one an object at a time takes linear time.
+ */
+static int
+objset_for_all(Objset *s, int (*func) (void *, Objid), void *data)
+{
+    Var item, list;
+    int i, c;
+
+    if (s->index) {
+	for (i = s->index->head; s->index && i < s->index->used; i++)
+	    if (s->index->items[i] != NOTHING && func(data, s->index->items[i]))
+		return 1;
+	return 0;
+    }
+
+    list = var_ref(s->list);
+    FOR_EACH(item, list, i, c)
+	if (func(data, item.v.obj)) {
+	    free_var(list);
+	    return 1;
+	}
+    free_var(list);
+
+    return 0;
+}
+
+/* Puts `_new' in `old's place, changing the list in place. */
+static void
+objset_replace(Objset *s, Objid old, Objid _new)
+{
+    Objindex *ix = s->index;
+    int i, slot;
+
+    if (ix && (slot = index_find(ix, old)) >= 0) {
+	int pos = ix->slots[slot] - 1;
+
+	index_delete(ix, slot);
+	ix->items[pos] = _new;
+	index_insert(ix, pos);
+    }
+
+    if (s->list.type != TYPE_NONE)
+	for (i = 1; i <= listlength(s->list); i++)
+	    if (s->list.v.list[i].v.obj == old) {
+		s->list.v.list[i].v.obj = _new;
+		break;
+	    }
+}
+
+
 /*********** Objects qua objects ***********/
 
+static void
+init_ancestors(Object *o)
+{
+    o->ancestors.type = TYPE_NONE;
+    o->ancestor_set = 0;
+    o->ancestors_version = 0;
+}
+
+static void
+free_ancestors(Object *o)
+{
+    free_var(o->ancestors);
+    if (o->ancestor_set)
+	myfree(o->ancestor_set, M_ARRAY);
+    init_ancestors(o);
+}
+
+static void
+forget_descendants(Object *o)
+{
+    free_var(o->descendants);
+    o->descendants.type = TYPE_NONE;
+}
+
+static void forget_ancestors_descendants(Var);
+
 Object *
 dbpriv_find_object(Objid oid)
 {
@@ -125,6 +495,120 @@ ensure_new_object(void)
     extend(num_objects + 1);
 }
 
+static Object *
+alloc_object(void)
+{
+    Object *o;
+    int i;
+
+    if (!free_objects) {
+	Object *slab = (Object *)mymalloc(OBJECT_SLAB_SIZE * sizeof(Object),
+					  M_OBJECT);
+
+	for (i = OBJECT_SLAB_SIZE - 1; i >= 0; i--) {
+	    *(Object **)&slab[i] = free_objects;
+	    free_objects = &slab[i];
+	}
+	slab_objects += OBJECT_SLAB_SIZE;
+	free_object_count += OBJECT_SLAB_SIZE;
+    }
+
+    o = free_objects;
+    free_objects = *(Object **)o;
+    free_object_count--;
+
+    return o;
+}
+
+static void
+free_object(Object *o)
+{
+    *(Object **)o = free_objects;
+    free_objects = o;
+    free_object_count++;
+}
+
+static void
+note_live_object(Objid oid)
+{
+    if (!live_ok)
+	return;
+
+    if (live_count > 0 && live[live_count - 1] >= oid) {
+	live_ok = false;
+	return;
+    }
+
+    if (live_count == live_max) {
+	live_max = live_max ? live_max * 2 : 1024;
+	live = (Objid *)myrealloc(live, live_max * sizeof(Objid), M_ARRAY);
+    }
+    live[live_count++] = oid;
+}
+
+static void
+note_dead_object(void)
+{
+    live_stale++;
+}
+
+const Objid *
+dbpriv_live_objects(int *count)
+{
+    int i, n;
+
+    if (!live_ok) {
+	for (i = 0, n = 0; i < num_objects; i++)
+	    if (objects[i])
+		n++;
+	if (n > live_max) {
+	    live_max = n;
+	    live = (Objid *)myrealloc(live, live_max * sizeof(Objid), M_ARRAY);
+	}
+	for (i = 0, n = 0; i < num_objects; i++)
+	    if (objects[i])
+		live[n++] = i;
+	live_count = n;
+	live_stale = 0;
+	live_ok = true;
+    } else if (live_stale > 0) {
+	for (i = 0, n = 0; i < live_count; i++)
+	    if (live[i] < num_objects && objects[live[i]])
+		live[n++] = live[i];
+	live_count = n;
+	live_stale = 0;
+    }
+
+    *count = live_count;
+    return live;
+}
+
+Var
+db_object_table_stats(void)
+{
+    Var r = new_map(), k, v;
+    int count;
+
+    dbpriv_live_objects(&count);
+
+#define PACK_STAT(name, value)	\
+    k.type = TYPE_STR;		\
+    k.v.str = str_dup(name);	\
+    v.type = TYPE_INT;		\
+    v.v.num = (value);		\
+    r = mapinsert(r, k, v)
+
+    PACK_STAT("slots", num_objects);
+    PACK_STAT("objects", count);
+    PACK_STAT("recycled", num_objects - count);
+    PACK_STAT("allocated", slab_objects);
+    PACK_STAT("free", free_object_count);
+
+#undef PACK_STAT
+
+    return r;
+}
+
 void
 dbpriv_assign_nonce(Object *o)
 {
@@ -134,7 +618,7 @@ dbpriv_assign_nonce(Object *o)
 void
 dbpriv_after_load(void)
 {
-    int i;
+    int i, n;
 
     for (i = num_objects; i < max_objects; i++) {
 	if (objects[i]) {
@@ -142,6 +626,15 @@ dbpriv_after_load(void)
 	    objects[i] = NULL;
 	}
     }
+
+    /* drop the ancestors cached during validation */
+    live_ok = false;
+    const Objid *oids = dbpriv_live_objects(&n);
+    for (i = 0; i < n; i++) {
+	free_ancestors(objects[oids[i]]);
+	forget_descendants(objects[oids[i]]);
+    }
+    hierarchy_version++;
 }
 
 /* Both `dbpriv_new_object()' and `dbpriv_new_anonymous_object()'
@@ -155,8 +648,12 @@ dbpriv_new_object(void)
     Object *o;
 
     ensure_new_object();
-    o = objects[num_objects] = (Object *)mymalloc(sizeof(Object), M_OBJECT);
+    o = objects[num_objects] = alloc_object();
     o->id = num_objects;
+    init_ancestors(o);
+    o->descendants.type = TYPE_NONE;
+    o->contents_stamp = ++contents_stamps;
+    note_live_object(num_objects);
     num_objects++;
 
     return o;
@@ -170,6 +667,9 @@ dbpriv_new_anonymous_object(void)
     ensure_new_object();
     o = objects[num_objects] = (Object *)mymalloc(sizeof(Object), M_ANON);
     o->id = NOTHING;
+    init_ancestors(o);
+    o->descendants.type = TYPE_NONE;
+    o->contents_stamp = ++contents_stamps;
     num_objects++;
 
     return o;
@@ -189,12 +689,14 @@ db_init_object(Object *o)
     o->flags = 0;
 
     o->parents = var_ref(nothing);
-    o->children = new_list(0);
+    dbpriv_init_objset(&o->children, new_list(0));
 
     o->location = var_ref(nothing);
-    o->contents = new_list(0);
+    dbpriv_init_objset(&o->contents, new_list(0));
 
-    o->propval = 0;
+    o->layout = 0;
+    o->values = 0;
+    o->nvalues = 0;
     o->nval = 0;
 
     o->propdefs.max_length = 0;
@@ -228,17 +730,21 @@ db_destroy_object(Objid oid)
 	panic("DB_DESTROY_OBJECT: Invalid object!");
 
     if (o->location.v.obj != NOTHING ||
-	o->contents.v.list[0].v.num != 0 ||
+	objset_count(&o->contents) != 0 ||
 	(o->parents.type == TYPE_OBJ && o->parents.v.obj != NOTHING) ||
 	(o->parents.type == TYPE_LIST && o->parents.v.list[0].v.num != 0) ||
-	o->children.v.list[0].v.num != 0)
+	objset_count(&o->children) != 0)
 	panic("DB_DESTROY_OBJECT: Not a barren orphan!");
 
     free_var(o->parents);
-    free_var(o->children);
+    dbpriv_free_objset(&o->children);
 
     free_var(o->location);
-    free_var(o->contents);
+    dbpriv_free_objset(&o->contents);
+
+    /* a barren orphan is nobody's ancestor, so no other cache changes */
+    free_ancestors(o);
+    forget_descendants(o);
 
     if (is_user(oid)) {
 	Var t;
@@ -249,18 +755,14 @@ db_destroy_object(Objid oid)
     }
     free_str(o->name);
 
-    for (i = 0; i < o->propdefs.cur_length; i++) {
-	/* As an orphan, the only properties on this object are the ones
-	 * defined on it directly, so these two arrays must be the same length.
-	 */
+    /* As an orphan, the only properties on this object are the ones
+     * defined on it directly.
+     */
+    for (i = 0; i < o->propdefs.cur_length; i++)
 	free_str(o->propdefs.l[i].name);
-	free_var(o->propval[i].var);
-    }
     if (o->propdefs.l)
 	myfree(o->propdefs.l, M_PROPDEF);
-    if (o->propval)
-	myfree(o->propval, M_PVAL);
-    o->nval = 0;
+    dbpriv_free_propvals(o);
 
     for (v = o->verbdefs; v; v = w) {
 	if (v->program)
@@ -270,8 +772,9 @@ db_destroy_object(Objid oid)
 	myfree(v, M_VERBDEF);
     }
 
-    myfree(objects[oid], M_OBJECT);
+    free_object(objects[oid]);
     objects[oid] = 0;
+    note_dead_object();
 }
 
 Var
@@ -336,28 +839,38 @@ db_make_anonymous(Objid oid, Objid last)
     Var parent;
     int i, c;
 
+    forget_ancestors_descendants(me);
+    forget_descendants(o);
+
     /* remove me from my old parents' children */
     if (old_parents.type == TYPE_OBJ && old_parents.v.obj != NOTHING)
-	objects[old_parents.v.obj]->children = setremove(objects[old_parents.v.obj]->children, me);
+	objset_remove(&objects[old_parents.v.obj]->children, oid);
     else if (old_parents.type == TYPE_LIST)
 	FOR_EACH(parent, old_parents, i, c)
-	    objects[parent.v.obj]->children = setremove(objects[parent.v.obj]->children, me);
+	    objset_remove(&objects[parent.v.obj]->children, oid);
 
     objects[oid] = 0;
+    note_dead_object();
     db_set_last_used_objid(last);
 
+    /* It had no children, and its ancestors stay the same, so every
+     * cached list of ancestors is still good.
+     */
     o->id = NOTHING;
 
-    free_var(o->children);
+    /* anonymous objects have neither children nor contents */
+    dbpriv_free_objset(&o->children);
+    dbpriv_init_objset(&o->children, new_list(0));
     free_var(o->location);
-    free_var(o->contents);
+    dbpriv_free_objset(&o->contents);
+    dbpriv_init_objset(&o->contents, new_list(0));
 
     /* Last step, reallocate the memory and copy -- anonymous objects
      * require space for reference counting.
      */
     Object *t = (Object *)mymalloc(sizeof(Object), M_ANON);
     memcpy(t, o, sizeof(Object));
-    myfree(o, M_OBJECT);
+    free_object(o);
 
     return t;
 }
@@ -373,16 +886,14 @@ db_destroy_anonymous_object(void *obj)
     o->name = NULL;
 
     free_var(o->parents);
+    free_ancestors(o);
+    forget_descendants(o);
 
     for (i = 0; i < o->propdefs.cur_length; i++)
 	free_str(o->propdefs.l[i].name);
     if (o->propdefs.l)
 	myfree(o->propdefs.l, M_PROPDEF);
-    for (i = 0; i < o->nval; i++)
-	free_var(o->propval[i].var);
-    if (o->propval)
-	myfree(o->propval, M_PVAL);
-    o->nval = 0;
+    dbpriv_free_propvals(o);
 
     for (v = o->verbdefs; v; v = w) {
 	if (v->program)
@@ -454,6 +965,9 @@ db_renumber_object(Objid old)
 	    o = objects[_new] = objects[old];
 	    objects[old] = 0;
 	    objects[_new]->id = _new;
+	    live_ok = false;
+	    dbpriv_all_contents_changed();
+	    hierarchy_version++;
 
 	    /* Fix up the parents/children hierarchy and the
 	     * location/contents hierarchy.
@@ -463,20 +977,12 @@ db_renumber_object(Objid old)
 
 #define	    FIX(up, down)							\
 	    if (TYPE_LIST == o->up.type) {					\
-		FOR_EACH(obj1, o->up, i1, c1) {					\
-		    FOR_EACH(obj2, objects[obj1.v.obj]->down, i2, c2)		\
-			if (obj2.v.obj == old)					\
-			    break;						\
-		    objects[obj1.v.obj]->down.v.list[i2].v.obj = _new;		\
-		}								\
-	    }									\
-	    else if (TYPE_OBJ == o->up.type && NOTHING != o->up.v.obj) {	\
-		FOR_EACH(obj1, objects[o->up.v.obj]->down, i2, c2)		\
-		if (obj1.v.obj == old)						\
-		    break;							\
-		objects[o->up.v.obj]->down.v.list[i2].v.obj = _new;		\
+		FOR_EACH(obj1, o->up, i1, c1)					\
+		    objset_replace(&objects[obj1.v.obj]->down, old, _new);	\
 	    }									\
-	    FOR_EACH(obj1, o->down, i1, c1) {					\
+	    else if (TYPE_OBJ == o->up.type && NOTHING != o->up.v.obj)		\
+		objset_replace(&objects[o->up.v.obj]->down, old, _new);	\
+	    FOR_EACH(obj1, dbpriv_object_##down(o), i1, c1) {			\
 		if (TYPE_LIST == objects[obj1.v.obj]->up.type) {		\
 		    FOR_EACH(obj2, objects[obj1.v.obj]->up, i2, c2)		\
 			if (obj2.v.obj == old)					\
@@ -493,6 +999,8 @@ db_renumber_object(Objid old)
 
 #undef	    FIX
 
+	    forget_ancestors_descendants(new_obj(_new));
+
 	    /* Fix up the list of users, if necessary */
 	    if (is_user(_new)) {
 		int i;
@@ -505,16 +1013,13 @@ db_renumber_object(Objid old)
 	    }
 	    /* Fix the owners of verbs, properties and objects */
 	    {
-		Objid oid;
+		const Objid *oids;
+		int i, n;
 
-		for (oid = 0; oid < num_objects; oid++) {
-		    Object *o = objects[oid];
+		oids = dbpriv_live_objects(&n);
+		for (i = 0; i < n; i++) {
+		    Object *o = objects[oids[i]];
 		    Verbdef *v;
-		    Pval *p;
-		    int i, count;
-
-		    if (!o)
-			continue;
 
 		    if (o->owner == _new)
 			o->owner = NOTHING;
@@ -526,15 +1031,8 @@ db_renumber_object(Objid old)
 			    v->owner = NOTHING;
 			else if (v->owner == old)
 			    v->owner = _new;
-
-		    p = o->propval;
-		    count = o->nval;
-		    for (i = 0; i < count; i++)
-			if (p[i].owner == _new)
-			    p[i].owner = NOTHING;
-			else if (p[i].owner == old)
-			    p[i].owner = _new;
 		}
+		dbpriv_renumber_propval_owners(old, _new);
 	    }
 
 	    return _new;
@@ -566,10 +1064,15 @@ db_object_bytes(Var obj)
     for (i = 0; i < o->propdefs.cur_length; i++)
 	count += memo_strlen(o->propdefs.l[i].name) + 1;
 
-    len = o->nval;
-    count += (sizeof(Pval) - sizeof(Var)) * len;
+    /* the object's share of its (usually shared) layout */
+    if (o->layout)
+	count += (sizeof(Playout) + sizeof(Pslot) * (o->layout->count - 1))
+		 / o->layout->refcount;
+
+    len = o->nvalues;
+    count += (sizeof(Pvalue) - sizeof(Var)) * len;
     for (i = 0; i < len; i++)
-	count += value_bytes(o->propval[i].var);
+	count += value_bytes(o->values[i].var);
 
     return count;
 }
@@ -593,13 +1096,13 @@ db_object_bytes(Var obj)
 #define ARRAY_SIZE_IN_BYTES (array_size / 8)
 #define CLEAR_BIT_ARRAY() memset(bit_array, 0, ARRAY_SIZE_IN_BYTES)
 
-#define DEFUNC(name, field)						\
+#define DEFUNC(name, get)						\
 									\
 static int								\
 db1_count_##name(Object *o)						\
 {									\
     int i, c, n = 0;							\
-    Var tmp, field = enlist_var(var_ref(o->field));			\
+    Var tmp, field = enlist_var(var_ref(get(o)));			\
     Object *o2;								\
     Objid oid;								\
 									\
@@ -622,7 +1125,7 @@ static void								\
 db2_add_##name(Object *o, Var *plist, int *px)				\
 {									\
     int i, c;								\
-    Var tmp, field = enlist_var(var_ref(o->field));			\
+    Var tmp, field = enlist_var(var_ref(get(o)));			\
     Object *o2;								\
     Objid oid;								\
 									\
@@ -650,8 +1153,8 @@ db_##name(Var obj, bool full)						\
     Var list;								\
 									\
     o = dbpriv_dereference(obj);					\
-    if ((o->field.type == TYPE_OBJ && o->field.v.obj == NOTHING) ||	\
-	(o->field.type == TYPE_LIST && listlength(o->field) == 0))	\
+    if ((get(o).type == TYPE_OBJ && get(o).v.obj == NOTHING) ||		\
+	(get(o).type == TYPE_LIST && listlength(get(o)) == 0))		\
 	return full ? enlist_var(var_ref(obj)) : new_list(0);		\
 									\
     CLEAR_BIT_ARRAY();							\
@@ -672,14 +1175,169 @@ db_##name(Var obj, bool full)						\
     return list;							\
 }
 
-DEFUNC(ancestors, parents);
-DEFUNC(descendants, children);
+/* local to this file; db_ancestors() and db_descendants() cache their
+ * results
+ */
+static Var db_uncached_ancestors(Var, bool);
+static Var db_uncached_descendants(Var, bool);
+
+DEFUNC(uncached_ancestors, dbpriv_object_parents);
+DEFUNC(uncached_descendants, dbpriv_object_children);
 
 /* the following two could be replace by better/more specific implementations */
-DEFUNC(all_locations, location);
-DEFUNC(all_contents, contents);
+DEFUNC(all_locations, dbpriv_object_location);
+DEFUNC(all_contents, dbpriv_object_contents);
 
 #undef DEFUNC
+
+static int
+objid_cmp(const void *a, const void *b)
+{
+    Objid x = *(const Objid *)a, y = *(const Objid *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Makes sure that `o's cached ancestors are up to date. */
+static void
+cache_ancestors(Object *o)
+{
+    Var obj;
+    int i, n;
+
+    if (o->ancestors_version == hierarchy_version)
+	return;
+
+    free_ancestors(o);
+
+    /* the traversal doesn't hold on to `obj' */
+    if (o->id != NOTHING)
+	obj = new_obj(o->id);
+    else {
+	obj.type = TYPE_ANON;
+	obj.v.anon = o;
+    }
+    o->ancestors = db_uncached_ancestors(obj, false);
+
+    n = listlength(o->ancestors);
+    if (n > 0) {
+	o->ancestor_set = (Objid *)mymalloc(n * sizeof(Objid), M_ARRAY);
+	for (i = 0; i < n; i++)
+	    o->ancestor_set[i] = o->ancestors.v.list[i + 1].v.obj;
+	qsort(o->ancestor_set, n, sizeof(Objid), objid_cmp);
+    }
+    o->ancestors_version = hierarchy_version;
+}
+
+/* Returns a new list of `obj' followed by the objects in `list',
+ * which is freed.
+ */
+static Var
+with_object(Var obj, Var list)
+{
+    Var r;
+    int i, n = listlength(list);
+
+    r = new_list(n + 1);
+    r.v.list[1] = var_ref(obj);
+    for (i = 1; i <= n; i++)
+	r.v.list[i + 1] = list.v.list[i];
+    free_var(list);
+
+    return r;
+}
+
+Var
+db_ancestors(Var obj, bool full)
+{
+    Object *o = dbpriv_dereference(obj);
+
+    cache_ancestors(o);
+
+    return full ? with_object(obj, var_ref(o->ancestors))
+		: var_ref(o->ancestors);
+}
+
+Var
+db_descendants(Var obj, bool full)
+{
+    Object *o = dbpriv_dereference(obj);
+    Var list;
+
+    if (o->descendants.type != TYPE_NONE)
+	list = var_ref(o->descendants);
+    else {
+	int threshold
+	    = server_int_option_cached(SVO_DESCENDANTS_CACHE_THRESHOLD);
+
+	list = db_uncached_descendants(obj, false);
+	if (TYPE_OBJ == obj.type && threshold > 0
+	    && listlength(list) >= threshold)
+	    o->descendants = var_ref(list);
+    }
+
+    return full ? with_object(obj, list) : list;
+}
+
+/* Drops the cached descendants of all of `obj's ancestors. */
+static void
+forget_ancestors_descendants(Var obj)
+{
+    Var ancestor, ancestors = db_ancestors(obj, false);
+    int i, c;
+
+    FOR_EACH(ancestor, ancestors, i, c)
+	forget_descendants(objects[ancestor.v.obj]);
+    free_var(ancestors);
+}
+
+/* Brings the cached descendants of `obj's old and new ancestors (each
+ * list starting with `obj' itself) up to date after `obj' has changed
+ * parents.  When `obj' is a leaf, as it is when it has just been
+ * created or is about to be recycled, it can simply be removed from
+ * the old lists and, if it has a single parent `p', added to the new
+ * lists in which `p's descendants come last -- which is where the
+ * traversal would now find it, since db_change_parents() has just made
+ * it `p's last child, and any of `p's descendants that other parents
+ * reach first come earlier still.  Other lists are recomputed when next
+ * needed.
+ */
+static void
+fix_descendant_caches(Var obj, Var old_ancestors, Var new_ancestors)
+{
+    Object *o = objects[obj.v.obj], *a;
+    int leaf = (objset_count(&o->children) == 0);
+    Var parent = o->parents;
+    Var ancestor;
+    int i, c, j, n;
+
+    FOR_EACH(ancestor, old_ancestors, i, c) {
+	a = objects[ancestor.v.obj];
+	if (i == 1 || a->descendants.type == TYPE_NONE)
+	    continue;
+	n = listlength(a->descendants);
+	for (j = n; j >= 1; j--)
+	    if (a->descendants.v.list[j].v.obj == obj.v.obj)
+		break;
+	if (leaf && j >= 1)
+	    a->descendants = listdelete(a->descendants, j);
+	else
+	    forget_descendants(a);
+    }
+
+    FOR_EACH(ancestor, new_ancestors, i, c) {
+	a = objects[ancestor.v.obj];
+	if (i == 1 || a->descendants.type == TYPE_NONE)
+	    continue;
+	n = listlength(a->descendants);
+	if (leaf && TYPE_OBJ == parent.type
+	    && (ancestor.v.obj == parent.v.obj
+		|| (n > 0 && db_object_isa(a->descendants.v.list[n], parent))))
+	    a->descendants = listappend(a->descendants, var_ref(obj));
+	else
+	    forget_descendants(a);
+    }
+}
 
 
 /*********** Object attributes ***********/
@@ -768,6 +1426,9 @@ dbpriv_set_object_name(Object *o, const char *name)
     if (o->name)
 	free_str(o->name);
     o->name = name;
+
+    if (o->id != NOTHING && valid(o->location.v.obj))
+	dbpriv_contents_changed(objects[o->location.v.obj]);
 }
 
 const char *
@@ -791,7 +1452,7 @@ dbpriv_object_parents(Object *o)
 Var
 dbpriv_object_children(Object *o)
 {
-    return o->children;
+    return objset_list(&o->children);
 }
 
 Var
@@ -809,19 +1470,13 @@ db_object_children(Objid oid)
 int
 db_count_children(Objid oid)
 {
-    return listlength(objects[oid]->children);
+    return objset_count(&objects[oid]->children);
 }
 
 int
 db_for_all_children(Objid oid, int (*func) (void *, Objid), void *data)
 {
-    int i, c = db_count_children(oid);
-
-    for (i = 1; i <= c; i++)
-	if (func(data, objects[oid]->children.v.list[i].v.obj))
-	    return 1;
-
-    return 0;
+    return objset_for_all(&objects[oid]->children, func, data);
 }
 
 static int
@@ -875,7 +1530,7 @@ db_change_parents(Var obj, Var new_parents, Var anon_kids)
     Object *o = dbpriv_dereference(obj);
 
     if (o->verbdefs == NULL
-        && listlength(o->children) == 0
+        && objset_count(&o->children) == 0
         && (TYPE_LIST != anon_kids.type || listlength(anon_kids) == 0)) {
 	/* Since this object has no children and no verbs, we know that it
 	   can't have had any part in affecting verb lookup, since we use first
@@ -901,22 +1556,40 @@ db_change_parents(Var obj, Var new_parents, Var anon_kids)
 
 	/* remove me/obj from my old parents' children */
 	if (old_parents.type == TYPE_OBJ && old_parents.v.obj != NOTHING)
-	    objects[old_parents.v.obj]->children = setremove(objects[old_parents.v.obj]->children, obj);
+	    objset_remove(&objects[old_parents.v.obj]->children, obj.v.obj);
 	else if (old_parents.type == TYPE_LIST)
 	    FOR_EACH(parent, old_parents, i, c)
-		objects[parent.v.obj]->children = setremove(objects[parent.v.obj]->children, obj);
+		objset_remove(&objects[parent.v.obj]->children, obj.v.obj);
 
 	/* add me/obj to my new parents' children */
 	if (new_parents.type == TYPE_OBJ && new_parents.v.obj != NOTHING)
-	    objects[new_parents.v.obj]->children = setadd(objects[new_parents.v.obj]->children, obj);
+	    objset_add(&objects[new_parents.v.obj]->children, obj.v.obj);
 	else if (new_parents.type == TYPE_LIST)
 	    FOR_EACH(parent, new_parents, i, c)
-		objects[parent.v.obj]->children = setadd(objects[parent.v.obj]->children, obj);
+		objset_add(&objects[parent.v.obj]->children, obj.v.obj);
     }
 
     free_var(o->parents);
     o->parents = var_dup(new_parents);
 
+    /* Only `o' and its descendants have new ancestors.  A new object,
+     * or one about to be recycled, usually has no descendants, and
+     * then there's no need to throw away every other object's cache.
+     */
+    if (objset_count(&o->children) > 0
+	|| (TYPE_LIST == anon_kids.type && listlength(anon_kids) > 0))
+	hierarchy_version++;
+    else
+	free_ancestors(o);
+
+    /* inherited aliases may have changed */
+    if (TYPE_OBJ == obj.type) {
+	if (objset_count(&o->children) > 0)
+	    dbpriv_all_contents_changed();
+	else if (valid(o->location.v.obj))
+	    dbpriv_contents_changed(objects[o->location.v.obj]);
+    }
+
     /* Nothing between this point and the completion of
      * `dbpriv_fix_properties_after_chparent' may call `anon_valid'
      * because `o' is currently invalid (the nonce is out of date and
@@ -925,6 +1598,9 @@ db_change_parents(Var obj, Var new_parents, Var anon_kids)
 
     Var new_ancestors = db_ancestors(obj, true);
 
+    if (TYPE_OBJ == obj.type)
+	fix_descendant_caches(obj, old_ancestors, new_ancestors);
+
     dbpriv_fix_properties_after_chparent(obj, old_ancestors, new_ancestors, anon_kids);
 
     free_var(old_ancestors);
@@ -933,6 +1609,74 @@ db_change_parents(Var obj, Var new_parents, Var anon_kids)
     return 1;
 }
 
+Var
+db_create_children(Var parents, Objid owner, int count)
+{
+    Objid last = db_last_used_objid();
+    Objid first;
+    Object *f, *o;
+    Var oids, parent, ancestor, ancestors, rest;
+    int i, c, n;
+
+    extend(num_objects + count);
+
+    /* the first child goes the long way around; the rest are copies */
+    first = db_create_object();
+    db_set_object_owner(first, owner == NOTHING ? first : owner);
+    if (!db_change_parents(new_obj(first), parents, none)) {
+	db_destroy_object(first);
+	db_set_last_used_objid(last);
+	return none;
+    }
+    f = objects[first];
+
+    oids = new_list(count);
+    oids.v.list[1] = new_obj(first);
+    for (n = 2; n <= count; n++) {
+	o = dbpriv_new_object();
+	db_init_object(o);
+	o->owner = owner == NOTHING ? o->id : owner;
+	free_var(o->parents);
+	o->parents = var_ref(f->parents);
+	dbpriv_copy_propvals(o, f);
+	dbpriv_assign_nonce(o);
+	oids.v.list[n] = new_obj(o->id);
+    }
+
+    if (count > 1) {
+	rest = sublist(var_ref(oids), 2, count);
+
+	if (parents.type == TYPE_OBJ && parents.v.obj != NOTHING)
+	    objset_append(&objects[parents.v.obj]->children, rest);
+	else if (parents.type == TYPE_LIST)
+	    FOR_EACH(parent, parents, i, c)
+		objset_append(&objects[parent.v.obj]->children, rest);
+
+	/* Extend the cached descendants that `first' was just appended
+	 * to, and drop the rest.
+	 */
+	ancestors = db_ancestors(new_obj(first), false);
+	FOR_EACH(ancestor, ancestors, i, c) {
+	    o = objects[ancestor.v.obj];
+	    if (o->descendants.type == TYPE_NONE)
+		continue;
+	    n = listlength(o->descendants);
+	    if (n > 0 && o->descendants.v.list[n].v.obj == first)
+		o->descendants = listconcat(o->descendants, var_ref(rest));
+	    else
+		forget_descendants(o);
+	}
+	free_var(ancestors);
+
+	/* db_change_parents() already dropped the cached ancestors of
+	 * `first', and the rest are nobody's ancestors yet.
+	 */
+	free_var(rest);
+    }
+
+    return oids;
+}
+
 Var
 dbpriv_object_location(Object *o)
 {
@@ -945,42 +1689,59 @@ db_object_location(Objid oid)
     return dbpriv_object_location(objects[oid]).v.obj;
 }
 
+void
+dbpriv_contents_changed(Object *o)
+{
+    if (o)
+	o->contents_stamp = ++contents_stamps;
+}
+
+void
+dbpriv_all_contents_changed(void)
+{
+    all_contents_stamp = ++contents_stamps;
+}
+
+unsigned
+db_contents_stamp(Objid oid)
+{
+    unsigned stamp = objects[oid]->contents_stamp;
+
+    return stamp > all_contents_stamp ? stamp : all_contents_stamp;
+}
+
 Var
 dbpriv_object_contents(Object *o)
 {
-    return o->contents;
+    return objset_list(&o->contents);
 }
 
 int
 db_count_contents(Objid oid)
 {
-    return listlength(objects[oid]->contents);
+    return objset_count(&objects[oid]->contents);
 }
 
 int
 db_for_all_contents(Objid oid, int (*func) (void *, Objid), void *data)
 {
-    int i, c = db_count_contents(oid);
-
-    for (i = 1; i <= c; i++)
-	if (func(data, objects[oid]->contents.v.list[i].v.obj))
-	    return 1;
-
-    return 0;
+    return objset_for_all(&objects[oid]->contents, func, data);
 }
 
 void
 db_change_location(Objid oid, Objid new_location)
 {
-    Var me = new_obj(oid);
-
     Objid old_location = objects[oid]->location.v.obj;
 
-    if (valid(old_location))
-	objects[old_location]->contents = setremove(objects[old_location]->contents, var_dup(me));
+    if (valid(old_location)) {
+	objset_remove(&objects[old_location]->contents, oid);
+	dbpriv_contents_changed(objects[old_location]);
+    }
 
-    if (valid(new_location))
-	objects[new_location]->contents = setadd(objects[new_location]->contents, me);
+    if (valid(new_location)) {
+	objset_add(&objects[new_location]->contents, oid);
+	dbpriv_contents_changed(objects[new_location]);
+    }
 
     free_var(objects[oid]->location);
 
@@ -1072,29 +1833,15 @@ db_object_isa(Var object, Var parent)
     if (equality(object, parent, 0))
 	return 1;
 
-    Object *o, *t;
-
-    o = (TYPE_OBJ == object.type) ?
-        dbpriv_find_object(object.v.obj) :
-        object.v.anon;
-
-    Var ancestor, ancestors = enlist_var(var_ref(o->parents));
-
-    while (listlength(ancestors) > 0) {
-	POP_TOP(ancestor, ancestors);
-
-	if (ancestor.v.obj == NOTHING)
-	    continue;
-
-	if (equality(ancestor, parent, 0)) {
-	    free_var(ancestors);
-	    return 1;
-	}
+    if (TYPE_OBJ != parent.type)
+	return 0;
 
-	t = dbpriv_find_object(ancestor.v.obj);
+    Object *o = dbpriv_dereference(object);
+    Objid oid = parent.v.obj;
 
-	ancestors = listconcat(ancestors, enlist_var(var_ref(t->parents)));
-    }
+    cache_ancestors(o);
 
-    return 0;
+    return o->ancestor_set
+	   && bsearch(&oid, o->ancestor_set, listlength(o->ancestors),
+		      sizeof(Objid), objid_cmp) != 0;
 }
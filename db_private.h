@@ -56,6 +56,42 @@ typedef struct Pval {
     short perms;
 } Pval;
 
+/* The owner and permissions of one of an object's property slots. */
+typedef struct Pslot {
+    Objid owner;
+    short perms;
+} Pslot;
+
+/* A layout holds the owners and permissions of all of an object's
+ * property slots.  Layouts never change once made, and are shared by
+ * every object whose slots have the same owners and permissions --
+ * typically all of the children of one parent -- so that objects need
+ * only store the values that they don't leave clear.
+ */
+typedef struct Playout {
+    struct Playout *next;	/* in the table of all layouts */
+    unsigned int hash;
+    int refcount;
+    int count;
+    Pslot slots[1];
+} Playout;
+
+/* The value of the property in slot `index'. */
+typedef struct Pvalue {
+    int index;
+    Var var;
+} Pvalue;
+
+/* An object's contents or children, in order.  Small sets are kept as
+ * a plain list.  Larger ones also get an index (see db_objects.cc), so
+ * that objects can be added and removed in constant time; the list is
+ * then only rebuilt when next asked for.
+ */
+typedef struct Objset {
+    Var list;			/* TYPE_NONE while out of date */
+    struct Objindex *index;	/* null for small sets */
+} Objset;
+
 typedef struct Object {
     Objid id;
 
@@ -65,11 +101,17 @@ typedef struct Object {
     int flags; /* see db.h for `flags' values */
 
     Var location;
-    Var contents;
+    Objset contents;
     Var parents;
-    Var children;
+    Objset children;
 
-    Pval *propval;
+    /* The object has `nval' property slots, laid out by `layout' (null
+     * if there are none).  `values' holds the `nvalues' values that
+     * aren't clear, in slot order.
+     */
+    Playout *layout;
+    Pvalue *values;
+    int nvalues;
     unsigned int nval;
 
     Verbdef *verbdefs;
@@ -80,6 +122,26 @@ typedef struct Object {
      * globally unique.
      */
     unsigned int nonce;
+
+    /* Ancestors, cached by `db_ancestors()' and `db_object_isa()'.
+     * Valid only while `ancestors_version' matches the version of the
+     * hierarchy as a whole (see db_objects.cc).  `ancestor_set' holds
+     * the same objects as `ancestors', sorted, for binary search.
+     */
+    Var ancestors;
+    Objid *ancestor_set;
+    unsigned int ancestors_version;
+
+    /* Descendants, cached by `db_descendants()' for objects with at
+     * least `$server_options.descendants_cache_threshold' of them, and
+     * kept up to date as the hierarchy changes.  TYPE_NONE if not cached.
+     */
+    Var descendants;
+
+    /* Changes whenever the contents change, or the names or aliases of
+     * any of them might have.  See `db_contents_stamp()'.
+     */
+    unsigned contents_stamp;
 } Object;
 
 /*
@@ -118,6 +180,12 @@ extern void db_write_anonymous(Var);
 
 extern void dbpriv_assign_nonce(Object *);
 
+extern void dbpriv_init_objset(Objset *, Var list);
+				/* Makes a set of the objects in LIST, which
+				 * is consumed.
+				 */
+extern void dbpriv_free_objset(Objset *);
+
 extern Objid dbpriv_object_owner(Object *);
 extern void dbpriv_set_object_owner(Object *, Objid owner);
 
@@ -170,10 +238,50 @@ extern Object *dbpriv_find_object(Objid);
 
 extern void dbpriv_after_load(void);
 
+extern void dbpriv_contents_changed(Object *o);
+extern void dbpriv_all_contents_changed(void);
+				/* Bump the contents stamp of O (if it isn't
+				 * null) or of every object.
+				 */
+
+extern const Objid *dbpriv_live_objects(int *count);
+				/* Returns the numbers of all valid objects, in
+				 * increasing order, and stores their COUNT.
+				 * Good until the next object is created,
+				 * recycled or renumbered.
+				 */
+
 /*********** Properties ***********/
 
 extern Propdef dbpriv_new_propdef(const char *);
 
+extern void dbpriv_set_propvals(Object *o, Pval *pvals, int count);
+				/* Gives O, which has no properties yet, the
+				 * COUNT slots in PVALS, taking over their
+				 * values.
+				 */
+
+extern Pval dbpriv_propval(Object *o, int index);
+				/* Returns the owner, permissions and value
+				 * of slot INDEX of O.  The value is not
+				 * var_ref()ed.
+				 */
+
+extern void dbpriv_free_propvals(Object *o);
+				/* Frees O's property values and layout. */
+
+extern void dbpriv_copy_propvals(Object *to, Object *from);
+				/* Gives TO, which has no properties yet, a
+				 * copy of FROM's slots and values, with the
+				 * slots FROM owns owned by TO instead.
+				 */
+
+extern void dbpriv_renumber_propval_owners(Objid old, Objid _new);
+				/* Changes the owner of every property slot
+				 * owned by OLD to _NEW, and of every slot
+				 * owned by _NEW to #-1.
+				 */
+
 extern int dbpriv_check_properties_for_chparent(Var obj,
 						Var parents,
 						Var anon_kids);
@@ -65,6 +65,18 @@ properties_offset(Var target, Var _this)
     return i <= c ? offset : -1;
 }
 
+/*
+ * The matcher keeps an index of the names and aliases of the contents
+ * of busy places, so it has to hear about changes to `aliases'.
+ */
+static inline bool
+is_aliases(const char *pname)
+{
+    return !mystrcasecmp(pname, "aliases");
+}
+
+static int aliases_hash = 0;
+
 /*
  * Returns true iff `o' defines a property named `pname'.
  */
@@ -99,7 +111,7 @@ property_defined_at_or_below(const char *pname, int phash, Object *o)
 	    && !mystrcasecmp(props->l[i].name, pname))
 	    return 1;
 
-    Var children = o->children;
+    Var children = dbpriv_object_children(o);
     for (i = 1; i <= children.v.list[0].v.num; i++) {
 	Object *child = dbpriv_dereference(children.v.list[i]);
 	if (property_defined_at_or_below(pname, phash, child))
@@ -109,62 +121,531 @@ property_defined_at_or_below(const char *pname, int phash, Object *o)
     return 0;
 }
 
+/*
+ * Layouts are kept in a hash table, so that objects whose slots have
+ * the same owners and permissions can share one.
+ */
+static Playout **layouts = 0;
+static unsigned int layout_buckets = 0;
+static unsigned int layout_count = 0;
+
+static unsigned int
+hash_slots(const Pslot *slots, int count)
+{
+    unsigned int hash = 2166136261u;
+    int i;
+
+    for (i = 0; i < count; i++) {
+	hash = (hash ^ (unsigned int)slots[i].owner) * 16777619u;
+	hash = (hash ^ (unsigned short)slots[i].perms) * 16777619u;
+    }
+
+    return hash;
+}
+
+static int
+same_slots(const Pslot *a, const Pslot *b, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+	if (a[i].owner != b[i].owner || a[i].perms != b[i].perms)
+	    return 0;
+
+    return 1;
+}
+
 static void
-insert_prop2(Var obj, int pos, Pval pval)
+add_layout(Playout *l)
 {
-    Object *o = dbpriv_dereference(obj);
-    Pval *new_propval;
-    int i, nprops;
+    if (layout_count >= layout_buckets) {
+	unsigned int i, n = layout_buckets ? layout_buckets * 2 : 256;
+	Playout **table = (Playout **)mymalloc(n * sizeof(Playout *), M_PVAL);
+	Playout *x, *next;
+
+	memset(table, 0, n * sizeof(Playout *));
+	for (i = 0; i < layout_buckets; i++)
+	    for (x = layouts[i]; x; x = next) {
+		next = x->next;
+		x->next = table[x->hash & (n - 1)];
+		table[x->hash & (n - 1)] = x;
+	    }
+	if (layouts)
+	    myfree(layouts, M_PVAL);
+	layouts = table;
+	layout_buckets = n;
+    }
 
-    nprops = ++o->nval;
-    new_propval = (Pval *)mymalloc(nprops * sizeof(Pval), M_PVAL);
+    l->next = layouts[l->hash & (layout_buckets - 1)];
+    layouts[l->hash & (layout_buckets - 1)] = l;
+    layout_count++;
+}
 
-    dbpriv_assign_nonce(o);
+/*
+ * Returns a layout with the `count' slots in `slots', or null if there
+ * are none.  The caller must release it with `free_layout()'.
+ */
+static Playout *
+make_layout(const Pslot *slots, int count)
+{
+    unsigned int hash;
+    Playout *l;
+    int i;
 
-    for (i = 0; i < pos; i++)
-	new_propval[i] = o->propval[i];
+    if (count == 0)
+	return 0;
+
+    hash = hash_slots(slots, count);
+    if (layout_buckets)
+	for (l = layouts[hash & (layout_buckets - 1)]; l; l = l->next)
+	    if (l->hash == hash && l->count == count
+		&& same_slots(l->slots, slots, count)) {
+		l->refcount++;
+		return l;
+	    }
 
-    new_propval[pos] = pval;
-    new_propval[pos].var = var_ref(pval.var);
-    if (new_propval[pos].perms & PF_CHOWN)
-	new_propval[pos].owner = o->owner;
+    l = (Playout *)mymalloc(sizeof(Playout) + (count - 1) * sizeof(Pslot),
+			    M_PVAL);
+    l->hash = hash;
+    l->refcount = 1;
+    l->count = count;
+    for (i = 0; i < count; i++)
+	l->slots[i] = slots[i];
+    add_layout(l);
 
-    for (i = pos + 1; i < nprops; i++)
-	new_propval[i] = o->propval[i - 1];
+    return l;
+}
 
-    if (o->propval)
-	myfree(o->propval, M_PVAL);
-    o->propval = new_propval;
+static Playout *
+ref_layout(Playout *l)
+{
+    if (l)
+	l->refcount++;
+    return l;
 }
 
 static void
-insert_prop(Objid oid, int pos, Pval pval)
+free_layout(Playout *l)
+{
+    Playout **p;
+
+    if (!l || --l->refcount > 0)
+	return;
+
+    for (p = &layouts[l->hash & (layout_buckets - 1)]; *p != l; p = &(*p)->next)
+	;
+    *p = l->next;
+    layout_count--;
+    myfree(l, M_PVAL);
+}
+
+/* Returns room for `count' slots, good until the next call. */
+static Pslot *
+scratch_slots(int count)
 {
-    insert_prop2(new_obj(oid), pos, pval);
+    static Pslot *slots = 0;
+    static int max_slots = 0;
+
+    if (count > max_slots) {
+	if (slots)
+	    myfree(slots, M_PVAL);
+	max_slots = count > 2 * max_slots ? count : 2 * max_slots;
+	slots = (Pslot *)mymalloc(max_slots * sizeof(Pslot), M_PVAL);
+    }
+
+    return slots;
 }
 
+/*
+ * The last change made to a layout.  When adding or removing a
+ * property on many objects in turn, the next object (often a sibling,
+ * with the same layout) probably needs the same change.  The change
+ * holds on to both layouts, so neither can be freed and its address
+ * reused in the meantime.
+ */
+typedef struct {
+    Playout *from, *to;
+    int pos;
+    Pslot slot;
+} layout_change;
+
 static void
-insert_prop_recursively(Objid root, int prop_pos, Pval pv)
+init_layout_change(layout_change *change)
 {
-    insert_prop(root, prop_pos, pv);
+    change->from = change->to = 0;
+}
 
-    pv.var.type = TYPE_CLEAR;	/* do after initial insert_prop so only
-				   children will be TYPE_CLEAR */
+static void
+free_layout_change(layout_change *change)
+{
+    free_layout(change->from);
+    free_layout(change->to);
+}
 
-    Var descendant, descendants = db_descendants(new_obj(root), false);
-    int i, c, offset = 0;
-    int offsets[listlength(descendants)];
+/*
+ * Returns a layout like `from' but with `slot' inserted at `pos' or,
+ * if `slot' is null, with the slot at `pos' removed.  The caller must
+ * release it with `free_layout()'.
+ */
+static Playout *
+change_layout(Playout *from, int count, int pos, const Pslot *slot,
+	      layout_change *change)
+{
+    Playout *to;
+    Pslot *slots;
+    int n;
+
+    if (change && change->from == from && change->pos == pos
+	&& (!slot || same_slots(slot, &change->slot, 1)))
+	return ref_layout(change->to);
+
+    if (slot) {
+	n = count + 1;
+	slots = scratch_slots(n);
+	if (pos > 0)
+	    memcpy(slots, from->slots, pos * sizeof(Pslot));
+	slots[pos] = *slot;
+	if (count > pos)
+	    memcpy(slots + pos + 1, from->slots + pos,
+		   (count - pos) * sizeof(Pslot));
+    } else {
+	n = count - 1;
+	slots = scratch_slots(n);
+	if (pos > 0)
+	    memcpy(slots, from->slots, pos * sizeof(Pslot));
+	if (n > pos)
+	    memcpy(slots + pos, from->slots + pos + 1,
+		   (n - pos) * sizeof(Pslot));
+    }
+    to = make_layout(slots, n);
+
+    if (change) {
+	free_layout_change(change);
+	change->from = ref_layout(from);
+	change->to = ref_layout(to);
+	change->pos = pos;
+	if (slot)
+	    change->slot = *slot;
+    }
 
-    FOR_EACH(descendant, descendants, i, c) {
-	offset = properties_offset(new_obj(root), descendant);
-	offsets[i - 1] = offset;
+    return to;
+}
+
+/*
+ * Returns the number of values to allocate room for when an object has
+ * `n' of them.  Objects with more than a few values get up to an eighth
+ * again as many, so that adding or removing a value usually resizes an
+ * object's values in place.
+ */
+static int
+pval_capacity(int n)
+{
+    int step = 1;
+
+    while (step * 16 <= n)
+	step *= 2;
+
+    return (n + step - 1) / step * step;
+}
+
+static void
+resize_values(Object *o, int n)
+{
+    if (n == 0) {
+	if (o->values)
+	    myfree(o->values, M_PVAL);
+	o->values = 0;
+    } else if (o->values)
+	o->values = (Pvalue *)myrealloc(o->values,
+					pval_capacity(n) * sizeof(Pvalue),
+					M_PVAL);
+    else
+	o->values = (Pvalue *)mymalloc(pval_capacity(n) * sizeof(Pvalue),
+				       M_PVAL);
+}
+
+/*
+ * Returns the position in `o's values of the value in slot `index' or,
+ * if that slot is clear, of the first value after it.
+ */
+static int
+value_position(Object *o, int index)
+{
+    int lo = 0, hi = o->nvalues;
+
+    while (lo < hi) {
+	int mid = (lo + hi) / 2;
+
+	if (o->values[mid].index < index)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    return lo;
+}
+
+static Var
+slot_value(Object *o, int index)
+{
+    int i = value_position(o, index);
+
+    return (i < o->nvalues && o->values[i].index == index
+	    ? o->values[i].var : clear);
+}
+
+/* Consumes `value'. */
+static void
+set_slot_value(Object *o, int index, Var value)
+{
+    int i = value_position(o, index);
+
+    if (i < o->nvalues && o->values[i].index == index) {
+	free_var(o->values[i].var);
+	if (value.type != TYPE_CLEAR)
+	    o->values[i].var = value;
+	else {
+	    o->nvalues--;
+	    memmove(o->values + i, o->values + i + 1,
+		    (o->nvalues - i) * sizeof(Pvalue));
+	    resize_values(o, o->nvalues);
+	}
+    } else if (value.type != TYPE_CLEAR) {
+	resize_values(o, ++o->nvalues);
+	memmove(o->values + i + 1, o->values + i,
+		(o->nvalues - i - 1) * sizeof(Pvalue));
+	o->values[i].index = index;
+	o->values[i].var = value;
+    }
+}
+
+static void
+set_slot(Object *o, int index, Objid owner, short perms)
+{
+    Pslot *slots;
+    Playout *l;
+
+    if (o->layout->slots[index].owner == owner
+	&& o->layout->slots[index].perms == perms)
+	return;
+
+    slots = scratch_slots(o->nval);
+    memcpy(slots, o->layout->slots, o->nval * sizeof(Pslot));
+    slots[index].owner = owner;
+    slots[index].perms = perms;
+    l = make_layout(slots, o->nval);
+    free_layout(o->layout);
+    o->layout = l;
+}
+
+void
+dbpriv_set_propvals(Object *o, Pval *pvals, int count)
+{
+    Pslot *slots = scratch_slots(count);
+    int i, n = 0;
+
+    for (i = 0; i < count; i++) {
+	slots[i].owner = pvals[i].owner;
+	slots[i].perms = pvals[i].perms;
+	if (pvals[i].var.type != TYPE_CLEAR)
+	    n++;
     }
 
+    o->layout = make_layout(slots, count);
+    o->nval = count;
+    o->values = 0;
+    o->nvalues = n;
+    resize_values(o, n);
+
+    for (i = 0, n = 0; i < count; i++)
+	if (pvals[i].var.type != TYPE_CLEAR) {
+	    o->values[n].index = i;
+	    o->values[n++].var = pvals[i].var;
+	}
+}
+
+Pval
+dbpriv_propval(Object *o, int index)
+{
+    Pval pval;
+
+    pval.var = slot_value(o, index);
+    pval.owner = o->layout->slots[index].owner;
+    pval.perms = o->layout->slots[index].perms;
+
+    return pval;
+}
+
+void
+dbpriv_free_propvals(Object *o)
+{
+    int i;
+
+    for (i = 0; i < o->nvalues; i++)
+	free_var(o->values[i].var);
+    resize_values(o, 0);
+    o->nvalues = 0;
+
+    free_layout(o->layout);
+    o->layout = 0;
+    o->nval = 0;
+}
+
+void
+dbpriv_copy_propvals(Object *to, Object *from)
+{
+    Pslot *slots;
+    int i, n = from->nval;
+
+    for (i = 0; i < n; i++)
+	if (from->layout->slots[i].owner == from->id)
+	    break;
+
+    if (i == n)
+	to->layout = ref_layout(from->layout);
+    else {
+	slots = scratch_slots(n);
+	memcpy(slots, from->layout->slots, (unsigned) n * sizeof(Pslot));
+	for (; i < n; i++)
+	    if (slots[i].owner == from->id)
+		slots[i].owner = to->id;
+	to->layout = make_layout(slots, n);
+    }
+    to->nval = n;
+
+    to->values = 0;
+    to->nvalues = from->nvalues;
+    resize_values(to, to->nvalues);
+    for (i = 0; i < from->nvalues; i++) {
+	to->values[i].index = from->values[i].index;
+	to->values[i].var = var_ref(from->values[i].var);
+    }
+}
+
+void
+dbpriv_renumber_propval_owners(Objid old, Objid _new)
+{
+    Playout *all = 0, *l, *next;
+    unsigned int i;
+    int x;
+
+    /* rehash every layout, since their owners are part of their hashes */
+    for (i = 0; i < layout_buckets; i++) {
+	for (l = layouts[i]; l; l = next) {
+	    next = l->next;
+	    l->next = all;
+	    all = l;
+	}
+	layouts[i] = 0;
+    }
+    layout_count = 0;
+
+    for (l = all; l; l = next) {
+	next = l->next;
+	for (x = 0; x < l->count; x++)
+	    if (l->slots[x].owner == _new)
+		l->slots[x].owner = NOTHING;
+	    else if (l->slots[x].owner == old)
+		l->slots[x].owner = _new;
+	l->hash = hash_slots(l->slots, l->count);
+	add_layout(l);
+    }
+}
+
+static void
+insert_prop2(Var obj, int pos, Pval pval, layout_change *change)
+{
+    Object *o = dbpriv_dereference(obj);
+    Playout *l;
+    Pslot slot;
+    int i;
+
+    slot.owner = pval.perms & PF_CHOWN ? o->owner : pval.owner;
+    slot.perms = pval.perms;
+    l = change_layout(o->layout, o->nval, pos, &slot, change);
+    free_layout(o->layout);
+    o->layout = l;
+    o->nval++;
+
+    dbpriv_assign_nonce(o);
+
+    for (i = value_position(o, pos); i < o->nvalues; i++)
+	o->values[i].index++;
+    set_slot_value(o, pos, var_ref(pval.var));
+}
+
+static void
+insert_prop(Objid oid, int pos, Pval pval, layout_change *change)
+{
+    insert_prop2(new_obj(oid), pos, pval, change);
+}
+
+/*
+ * Returns a newly allocated array holding, for each object in
+ * `descendants' (as returned by `db_descendants()'), the position among
+ * its property values of the property at `prop_pos' in `root's.  The
+ * list is in depth-first order, so each object's parent is on the path
+ * from `root' to the object before it, and an object with a single
+ * parent finds its position by adding its own property definitions to
+ * its parent's; only objects with several parents need a look at their
+ * ancestors.
+ */
+static int *
+property_positions(Objid root, int prop_pos, Var descendants)
+{
+    int n = listlength(descendants);
+    int *positions = (int *)mymalloc((n + 1) * sizeof(int), M_INT);
+    Objid *path = (Objid *)mymalloc((n + 1) * sizeof(Objid), M_INT);
+    int *path_positions = (int *)mymalloc((n + 1) * sizeof(int), M_INT);
+    int i, c, top = 0;
+    Var descendant;
+
+    path[0] = root;
+    path_positions[0] = prop_pos;
+
     FOR_EACH(descendant, descendants, i, c) {
-	offset = offsets[i - 1];
-	insert_prop(descendant.v.obj, offset + prop_pos, pv);
+	Object *o = dbpriv_find_object(descendant.v.obj);
+	int pos;
+
+	if (TYPE_OBJ == o->parents.type) {
+	    while (top > 0 && path[top] != o->parents.v.obj)
+		top--;
+	    pos = path_positions[top] + o->propdefs.cur_length;
+	} else {
+	    while (top > 0 && !ismember(new_obj(path[top]), o->parents, 0))
+		top--;
+	    pos = properties_offset(new_obj(root), descendant) + prop_pos;
+	}
+
+	positions[i - 1] = pos;
+	path[++top] = descendant.v.obj;
+	path_positions[top] = pos;
     }
 
+    myfree(path, M_INT);
+    myfree(path_positions, M_INT);
+
+    return positions;
+}
+
+static void
+insert_prop_recursively(Objid root, int prop_pos, Pval pv)
+{
+    insert_prop(root, prop_pos, pv, 0);
+
+    pv.var.type = TYPE_CLEAR;	/* do after initial insert_prop so only
+				   children will be TYPE_CLEAR */
+
+    Var descendant, descendants = db_descendants(new_obj(root), false);
+    int i, c, *positions = property_positions(root, prop_pos, descendants);
+    layout_change change;
+
+    init_layout_change(&change);
+    FOR_EACH(descendant, descendants, i, c)
+	insert_prop(descendant.v.obj, positions[i - 1], pv, &change);
+    free_layout_change(&change);
+
+    myfree(positions, M_INT);
     free_var(descendants);
 }
 
@@ -184,6 +665,9 @@ db_add_propdef(Var obj, const char *pname, Var value, Objid owner,
     if (h.ptr || property_defined_at_or_below(pname, str_hash(pname), o))
 	return 0;
 
+    if (is_aliases(pname))
+	dbpriv_all_contents_changed();
+
     if (o->propdefs.cur_length == o->propdefs.max_length) {
 	Propdef *old_props = o->propdefs.l;
 	int new_size = (o->propdefs.max_length == 0
@@ -207,7 +691,7 @@ db_add_propdef(Var obj, const char *pname, Var value, Objid owner,
     if (TYPE_OBJ == obj.type)
 	insert_prop_recursively(obj.v.obj, o->propdefs.cur_length - 1, pval);
     else
-	insert_prop2(obj, o->propdefs.cur_length - 1, pval);
+	insert_prop2(obj, o->propdefs.cur_length - 1, pval, 0);
 
     return 1;
 }
@@ -222,6 +706,9 @@ db_rename_propdef(Var obj, const char *old, const char *_new)
     int i;
     db_prop_handle h;
 
+    if (is_aliases(old) || is_aliases(_new))
+	dbpriv_all_contents_changed();
+
     for (i = 0; i < count; i++) {
 	Propdef p;
 
@@ -244,57 +731,45 @@ db_rename_propdef(Var obj, const char *old, const char *_new)
 }
 
 static void
-remove_prop2(Var obj, int pos)
+remove_prop2(Var obj, int pos, layout_change *change)
 {
     Object *o = dbpriv_dereference(obj);
-    Pval *new_propval;
-    int i, nprops;
-
-    nprops = --o->nval;
+    Playout *l;
+    int i;
 
     dbpriv_assign_nonce(o);
 
-    free_var(o->propval[pos].var);	/* free deleted property */
-
-    if (nprops) {
-	new_propval = (Pval *)mymalloc(nprops * sizeof(Pval), M_PVAL);
-	for (i = 0; i < pos; i++)
-	    new_propval[i] = o->propval[i];
-	for (i = pos; i < nprops; i++)
-	    new_propval[i] = o->propval[i + 1];
-    } else
-	new_propval = 0;
+    set_slot_value(o, pos, clear);	/* free deleted property */
+    for (i = value_position(o, pos); i < o->nvalues; i++)
+	o->values[i].index--;
 
-    if (o->propval)
-	myfree(o->propval, M_PVAL);
-    o->propval = new_propval;
+    l = change_layout(o->layout, o->nval, pos, 0, change);
+    free_layout(o->layout);
+    o->layout = l;
+    o->nval--;
 }
 
 static void
-remove_prop(Objid oid, int pos)
+remove_prop(Objid oid, int pos, layout_change *change)
 {
-    remove_prop2(new_obj(oid), pos);
+    remove_prop2(new_obj(oid), pos, change);
 }
 
 static void
 remove_prop_recursively(Objid root, int prop_pos)
 {
-    remove_prop(root, prop_pos);
+    remove_prop(root, prop_pos, 0);
 
     Var descendant, descendants = db_descendants(new_obj(root), false);
-    int i, c, offset = 0;
-    int offsets[listlength(descendants)];
+    int i, c, *positions = property_positions(root, prop_pos, descendants);
+    layout_change change;
 
-    FOR_EACH(descendant, descendants, i, c) {
-	offset = properties_offset(new_obj(root), descendant);
-	offsets[i - 1] = offset;
-    }
-
-    FOR_EACH(descendant, descendants, i, c) {
-	offset = offsets[i - 1];
-	remove_prop(descendant.v.obj, offset + prop_pos);
-    }
+    init_layout_change(&change);
+    FOR_EACH(descendant, descendants, i, c)
+	remove_prop(descendant.v.obj, positions[i - 1], &change);
+    free_layout_change(&change);
 
+    myfree(positions, M_INT);
     free_var(descendants);
 }
 
@@ -308,6 +783,9 @@ db_delete_propdef(Var obj, const char *pname)
     int max = props->max_length;
     int i, j;
 
+    if (is_aliases(pname))
+	dbpriv_all_contents_changed();
+
     for (i = 0; i < count; i++) {
 	Propdef p;
 
@@ -340,7 +818,7 @@ db_delete_propdef(Var obj, const char *pname)
 	    if (TYPE_OBJ == obj.type)
 		remove_prop_recursively(obj.v.obj, i);
 	    else
-              remove_prop2(obj, i);
+              remove_prop2(obj, i, 0);
 
 	    return 1;
 	}
@@ -374,10 +852,10 @@ db_for_all_propvals(Var obj, int (*func) (void *, Var), void *data)
 {
     int i;
     Object *o = dbpriv_dereference(obj);
-    int len = o->nval;
+    int len = o->nvalues;
 
     for (i = 0; i < len; i++)
-	if (func(data, o->propval[i].var))
+	if (func(data, o->values[i].var))
 	    return 1;
 
     return 0;
@@ -477,6 +955,7 @@ db_find_property(Var obj, const char *name, Var *value)
 
     h.definer = 0;
     h.ptr = 0;
+    h.aliases = false;
 
     for (i = 0; i < Arraysize(ptable); i++) {
 	if (ptable[i].hash == hash && !mystrcasecmp(name, ptable[i].name)) {
@@ -501,7 +980,8 @@ db_find_property(Var obj, const char *name, Var *value)
     for (i = 0; i < length; i++, n++) {
 	if (defs[i].hash == hash && !mystrcasecmp(defs[i].name, name)) {
 		h.definer = o;
-		h.ptr = o->propval + n;
+		h.ptr = o;
+		h.index = n;
 		goto done;
 	    }
 	}
@@ -522,7 +1002,8 @@ db_find_property(Var obj, const char *name, Var *value)
 	for (i = 0; i < length; i++, n++) {
 	    if (defs[i].hash == hash && !mystrcasecmp(defs[i].name, name)) {
 		h.definer = t;
-		h.ptr = o->propval + n;
+		h.ptr = o;
+		h.index = n;
 		goto done;
 	    }
 	}
@@ -535,10 +1016,16 @@ db_find_property(Var obj, const char *name, Var *value)
     if (!h.ptr)
 	return h;
 
+    /* checked once here, so that setting the value needn't look again */
+    if (!aliases_hash)
+	aliases_hash = str_hash("aliases");
+    h.aliases = hash == aliases_hash && is_aliases(name);
+
     if (value) {
-	Pval *prop = (Pval *)h.ptr;
+	int slot = h.index;
+	Var v;
 
-	while (prop->var.type == TYPE_CLEAR) {
+	while ((v = slot_value(o, slot)).type == TYPE_CLEAR) {
 	    /* We take a few liberties at this point.  If a property
 	     * value on an object is clear, then its `definer' must be
 	     * a permanent (not an anonymous) object, because
@@ -552,15 +1039,15 @@ db_find_property(Var obj, const char *name, Var *value)
 		    if ((offset = properties_offset(new_obj(((Object *)h.definer)->id), parent)) > -1)
 			break;
 		o = dbpriv_find_object(parent.v.obj);
-		prop = o->propval + offset + i;
+		slot = offset + i;
 	    }
 	    else if (TYPE_OBJ == o->parents.type && NOTHING != o->parents.v.obj) {
 		int offset = properties_offset(new_obj(((Object *)h.definer)->id), o->parents);
 		o = dbpriv_find_object(o->parents.v.obj);
-		prop = o->propval + offset + i;
+		slot = offset + i;
 	    }
 	}
-	*value = prop->var;
+	*value = v;
     }
 
     return h;
@@ -585,11 +1072,8 @@ db_property_value(db_prop_handle h)
 
     if (h.built_in)
 	get_bi_value(h, &value);
-    else {
-	Pval *prop = (Pval *)h.ptr;
-
-	value = prop->var;
-    }
+    else
+	value = slot_value((Object *)h.ptr, h.index);
 
     return value;
 }
@@ -598,10 +1082,15 @@ void
 db_set_property_value(db_prop_handle h, Var value)
 {
     if (!h.built_in) {
-	Pval *prop = (Pval *)h.ptr;
+	Object *o = (Object *)h.ptr;
 
-	free_var(prop->var);
-	prop->var = value;
+	set_slot_value(o, h.index, value);
+	if (h.aliases && o->id != NOTHING) {
+	    if (db_count_children(o->id) > 0)
+		dbpriv_all_contents_changed();
+	    else if (valid(o->location.v.obj))
+		dbpriv_contents_changed(dbpriv_find_object(o->location.v.obj));
+	}
     } else {
 	Object *o = (Object *)h.ptr;
 	db_object_flag flag;
@@ -658,11 +1147,8 @@ db_property_owner(db_prop_handle h)
     if (h.built_in) {
 	panic("Built-in property in DB_PROPERTY_OWNER!");
 	return NOTHING;
-    } else {
-	Pval *prop = (Pval *)h.ptr;
-
-	return prop->owner;
-    }
+    } else
+	return ((Object *)h.ptr)->layout->slots[h.index].owner;
 }
 
 void
@@ -671,9 +1157,9 @@ db_set_property_owner(db_prop_handle h, Objid oid)
     if (h.built_in)
 	panic("Built-in property in DB_SET_PROPERTY_OWNER!");
     else {
-	Pval *prop = (Pval *)h.ptr;
+	Object *o = (Object *)h.ptr;
 
-	prop->owner = oid;
+	set_slot(o, h.index, oid, o->layout->slots[h.index].perms);
     }
 }
 
@@ -683,11 +1169,8 @@ db_property_flags(db_prop_handle h)
     if (h.built_in) {
 	panic("Built-in property in DB_PROPERTY_FLAGS!");
 	return 0;
-    } else {
-	Pval *prop = (Pval *)h.ptr;
-
-	return prop->perms;
-    }
+    } else
+	return ((Object *)h.ptr)->layout->slots[h.index].perms;
 }
 
 void
@@ -696,9 +1179,9 @@ db_set_property_flags(db_prop_handle h, unsigned flags)
     if (h.built_in)
 	panic("Built-in property in DB_SET_PROPERTY_FLAGS!");
     else {
-	Pval *prop = (Pval *)h.ptr;
+	Object *o = (Object *)h.ptr;
 
-	prop->perms = flags;
+	set_slot(o, h.index, o->layout->slots[h.index].owner, flags);
     }
 }
 
@@ -898,12 +1381,16 @@ dbpriv_fix_properties_after_chparent(Var obj, Var old_ancestors, Var new_ancesto
      * remaining property values.
      */
     Object *me = dbpriv_dereference(obj);
-    Pval *new_propval = NULL;
+    Pslot *new_slots = NULL;
+    Pvalue *new_values = NULL;
+    int new_nvalues = 0;
 
     assert(old_count == me->nval);
 
     if (new_count != 0) {
-	new_propval = (Pval *)mymalloc(new_count * sizeof(Pval), M_PVAL);
+	new_slots = (Pslot *)mymalloc(new_count * sizeof(Pslot), M_PVAL);
+	if (me->nvalues)
+	    new_values = (Pvalue *)mymalloc(me->nvalues * sizeof(Pvalue), M_PVAL);
 	int i2, c2, i3, c3;
 	FOR_EACH(ancestor, new_ancestors, i2, c2) {
 	    int n1 = new_offsets[i2 - 1];
@@ -913,9 +1400,12 @@ dbpriv_fix_properties_after_chparent(Var obj, Var old_ancestors, Var new_ancesto
 		int o1 = old_offsets[l - 1];
 		int o2 = old_offsets[l];
 		for (x = o1; x < o2; x++, n1++) {
-		    new_propval[n1].var = var_ref(me->propval[x].var);
-		    new_propval[n1].owner = me->propval[x].owner;
-		    new_propval[n1].perms = me->propval[x].perms;
+		    Var v = slot_value(me, x);
+		    new_slots[n1] = me->layout->slots[x];
+		    if (v.type != TYPE_CLEAR) {
+			new_values[new_nvalues].index = n1;
+			new_values[new_nvalues++].var = var_ref(v);
+		    }
 		}
 	    }
 	    else {
@@ -926,10 +1416,9 @@ dbpriv_fix_properties_after_chparent(Var obj, Var old_ancestors, Var new_ancesto
 			    break;
 		free_var(parents);
 		for (x = 0; n1 < n2; x++, n1++) {
-		    Pval pv = dbpriv_find_object(parent.v.obj)->propval[offset + x];
-		    new_propval[n1].var = clear;
-		    new_propval[n1].owner = pv.perms & PF_CHOWN ? me->owner : pv.owner;
-		    new_propval[n1].perms = pv.perms;
+		    Pslot ps = dbpriv_find_object(parent.v.obj)->layout->slots[offset + x];
+		    new_slots[n1].owner = ps.perms & PF_CHOWN ? me->owner : ps.owner;
+		    new_slots[n1].perms = ps.perms;
 		}
 	    }
 	}
@@ -938,14 +1427,16 @@ dbpriv_fix_properties_after_chparent(Var obj, Var old_ancestors, Var new_ancesto
     /*
      * Clean up.
      */
-    int c;
-    if (me->propval) {
-	for (c = 0; c < old_count; c++)
-	  free_var(me->propval[c].var);
-	myfree(me->propval, M_PVAL);
-    }
-    me->propval = new_propval;
+    dbpriv_free_propvals(me);
+    me->layout = make_layout(new_slots, new_count);
     me->nval = new_count;
+    if (new_nvalues) {
+	me->values = new_values;
+	me->nvalues = new_nvalues;
+    } else if (new_values)
+	myfree(new_values, M_PVAL);
+    if (new_slots)
+	myfree(new_slots, M_PVAL);
 
     dbpriv_assign_nonce(me);
 
@@ -963,9 +1454,9 @@ dbpriv_fix_properties_after_chparent(Var obj, Var old_ancestors, Var new_ancesto
     Var children;
 
     if (TYPE_LIST == anon_kids.type)
-	children = listconcat(var_ref(me->children), var_ref(anon_kids));
+	children = listconcat(var_ref(dbpriv_object_children(me)), var_ref(anon_kids));
     else
-	children = var_ref(me->children);
+	children = var_ref(dbpriv_object_children(me));
 
     FOR_EACH(child, children, i4, c4) {
 	Object *oc = dbpriv_dereference(child);
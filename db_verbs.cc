@@ -97,11 +97,8 @@ dbpriv_build_prep_table(void)
 		*t++ = *p++;
 	    *t = '\0';
 
-	    /* This call to PARSE_INTO_WORDS() is the reason that this function
-	     * is called from DB_INITIALIZE() instead of from the first call to
-	     * DB_FIND_PREP(), below.  You see, PARSE_INTO_WORDS() isn't
-	     * re-entrant, and DB_FIND_PREP() is called from code that's still
-	     * using the results of a previous call to PARSE_INTO_WORDS()...
+	    /* PARSE_INTO_WORDS() isn't re-entrant, so the words are
+	     * copied out before the next call.
 	     */
 	    words = parse_into_words(cprep, &nwords);
 
@@ -195,7 +192,7 @@ db_unparse_prep(db_prep_spec prep)
 #define DOBJSHIFT  4
 #define IOBJSHIFT  6
 #define OBJMASK    0x3
-#define PERMMASK   0xF
+#define PERMMASK   0x10F	/* the flags, around the argument specifiers */
 
 int
 db_add_verb(Var obj, const char *vnames, Objid owner, unsigned flags,
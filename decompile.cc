@@ -151,6 +151,10 @@ decompile(Bytecodes bc, Byte * start, Byte * end, Stmt ** stmt_sink,
 	int op_hot = (ptr == hot_byte);
 	Opcode op = (Opcode)(*ptr++);
 
+#ifdef BYTECODE_INT_OPS
+	if (IS_INT_OP(op))
+	    op = INT_OP_TO_GENERIC(op, ptr);
+#endif				/* BYTECODE_INT_OPS */
 	if (IS_PUSH_n(op)) {
 	    e = alloc_expr(EXPR_ID);
 	    e->e.id = PUSH_n_INDEX(op);
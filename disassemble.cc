@@ -81,6 +81,18 @@ struct mapping mappings[] =
     {OP_IMM, "PUSH_LITERAL"},
     {OP_MAP_CREATE, "MAP_CREATE"},
     {OP_MAP_INSERT, "MAP_INSERT"},
+#ifdef BYTECODE_INT_OPS
+    {OP_UPDATE_INT, "UPDATE_INT"},
+#ifdef BYTECODE_REDUCE_REF
+    {OP_UPDATE_INT_CLEAR, "UPDATE_INT_CLEAR"},
+#endif /* BYTECODE_REDUCE_REF */
+    {OP_EQ_TEST, "EQ_TEST"},
+    {OP_NE_TEST, "NE_TEST"},
+    {OP_LT_TEST, "LT_TEST"},
+    {OP_LE_TEST, "LE_TEST"},
+    {OP_GT_TEST, "GT_TEST"},
+    {OP_GE_TEST, "GE_TEST"},
+#endif /* BYTECODE_INT_OPS */
     {OP_MAKE_EMPTY_LIST, "MAKE_EMPTY_LIST"},
     {OP_LIST_ADD_TAIL, "LIST_ADD_TAIL"},
     {OP_LIST_APPEND, "LIST_APPEND"},
@@ -267,6 +279,12 @@ disassemble(Program * prog, Printer p, void *data)
 		stream_printf(insn, "PUSH %s", NAMES(PUSH_n_INDEX(b)));
 	    else if (IS_PUT_n(b))
 		stream_printf(insn, "PUT %s", NAMES(PUT_n_INDEX(b)));
+#ifdef BYTECODE_INT_OPS
+	    else if (IS_INT_OP(b) && !IS_INT_TEST_OP(b))
+		/* the rest of the sequence follows as generic ops */
+		stream_printf(insn, "%s %s", mnemonics[b],
+			      NAMES(PUT_n_INDEX(bc.vector[pc + 2])));
+#endif /* BYTECODE_INT_OPS */
 	    else if (b == OP_EXTENDED) {
 		b = ADD_BYTES(1);
 		stream_add_string(insn, COUNT_EOP_TICK(b) ? " * " : "   ");
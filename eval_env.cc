@@ -72,37 +72,37 @@ copy_rt_env(Var * from, unsigned size)
     return ret;
 }
 
+/*
+ * Only the slots whose bits are set in `used' are filled in (see
+ * `builtin_var_refs' in program.h); the others are left empty.
+ */
 void
-fill_in_rt_consts(Var * env, DB_Version version)
+fill_in_rt_consts(Var * env, DB_Version version, unsigned used)
 {
-    Var v;
+#define SET_CONST(slot, t)			\
+    if (used & (1U << slot)) {			\
+	env[slot].type = TYPE_INT;		\
+	env[slot].v.num = (int) t;		\
+    }
 
-    v.type = TYPE_INT;
-    v.v.num = (int) TYPE_ERR;
-    env[SLOT_ERR] = var_ref(v);
-    v.v.num = (int) TYPE_INT;
-    env[SLOT_NUM] = var_ref(v);
-    v.v.num = (int) _TYPE_STR;
-    env[SLOT_STR] = var_ref(v);
-    v.v.num = (int) TYPE_OBJ;
-    env[SLOT_OBJ] = var_ref(v);
-    v.v.num = (int) _TYPE_LIST;
-    env[SLOT_LIST] = var_ref(v);
+    SET_CONST(SLOT_ERR, TYPE_ERR);
+    SET_CONST(SLOT_NUM, TYPE_INT);
+    SET_CONST(SLOT_STR, _TYPE_STR);
+    SET_CONST(SLOT_OBJ, TYPE_OBJ);
+    SET_CONST(SLOT_LIST, _TYPE_LIST);
 
     if (version >= DBV_Float) {
-	v.v.num = (int) TYPE_INT;
-	env[SLOT_INT] = var_ref(v);
-	v.v.num = (int) _TYPE_FLOAT;
-	env[SLOT_FLOAT] = var_ref(v);
+	SET_CONST(SLOT_INT, TYPE_INT);
+	SET_CONST(SLOT_FLOAT, _TYPE_FLOAT);
     }
     if (version >= DBV_Map) {
-	v.v.num = (int) _TYPE_MAP;
-	env[SLOT_MAP] = var_ref(v);
+	SET_CONST(SLOT_MAP, _TYPE_MAP);
     }
     if (version >= DBV_Anon) {
-	v.v.num = (int) _TYPE_ANON;
-	env[SLOT_ANON] = var_ref(v);
+	SET_CONST(SLOT_ANON, _TYPE_ANON);
     }
+
+#undef SET_CONST
 }
 
 void
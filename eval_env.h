@@ -30,6 +30,6 @@ void set_rt_env_obj(Var * env, int slot, Objid o);
 void set_rt_env_str(Var * env, int slot, const char *s);
 void set_rt_env_var(Var * env, int slot, Var v);
 
-void fill_in_rt_consts(Var * env, DB_Version);
+void fill_in_rt_consts(Var * env, DB_Version, unsigned used);
 
 #endif
@@ -37,6 +37,9 @@ new_vm(int task_id, Var local, int stack_size)
 
     the_vm->task_id = task_id;
     the_vm->local = local;
+    the_vm->compacted = 0;
+    the_vm->ticks_left = 0;
+    the_vm->usecs_left = 0;
     the_vm->activ_stack = (activation *)mymalloc(sizeof(activation) * stack_size, M_VM);
 
     return the_vm;
@@ -49,9 +52,11 @@ free_vm(vm the_vm, int stack_too)
 
     free_var(the_vm->local);
 
-    if (stack_too)
+    if (stack_too) {
+	expand_vm(the_vm);
 	for (i = the_vm->top_activ_stack; i >= 0; i--)
 	    free_activation(&the_vm->activ_stack[i], 1);
+    }
     myfree(the_vm->activ_stack, M_VM);
     myfree(the_vm, M_VM);
 }
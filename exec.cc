@@ -42,6 +42,7 @@
 #include "functions.h"
 #include "list.h"
 #include "log.h"
+#include "server.h"
 #include "storage.h"
 #include "structures.h"
 #include "streams.h"
@@ -74,9 +75,20 @@ typedef struct task_waiting_on_exec {
     Stream *sout;
     Stream *serr;
     vm the_vm;
+    struct task_waiting_on_exec *next;	/* in its process_table chain */
+    struct task_waiting_on_exec *next_done;	/* in done_waiters */
 } task_waiting_on_exec;
 
-static task_waiting_on_exec *process_table[EXEC_MAX_PROCESSES];
+/* Waiters are hashed by pid, so that exec_complete() (which runs in the
+ * SIGCHLD handler) finds one without scanning, and those whose process
+ * has exited are pushed onto `done_waiters' for deal_with_child_exit().
+ * The table only grows, and only with SIGCHLD blocked.
+ */
+static task_waiting_on_exec **process_table = 0;
+static int process_table_size = 0;
+static int process_count = 0;
+
+static task_waiting_on_exec *done_waiters = 0;
 
 volatile static sig_atomic_t sigchild_interrupt = 0;
 
@@ -95,8 +107,10 @@ malloc_task_waiting_on_exec()
     tw->in = NULL;
     tw->status = TWS_CONTINUE;
     tw->code = 0;
+    tw->fin = tw->fout = tw->ferr = -1;
     tw->sout = new_stream(1000);
     tw->serr = new_stream(1000);
+    tw->next = tw->next_done = 0;
     return tw;
 }
 
@@ -114,10 +128,14 @@ free_task_waiting_on_exec(task_waiting_on_exec * tw)
     }
     if (tw->in)
 	free_str(tw->in);
-    close(tw->fout);
-    close(tw->ferr);
-    network_unregister_fd(tw->fout);
-    network_unregister_fd(tw->ferr);
+    if (tw->fout >= 0) {
+	close(tw->fout);
+	network_unregister_fd(tw->fout);
+    }
+    if (tw->ferr >= 0) {
+	close(tw->ferr);
+	network_unregister_fd(tw->ferr);
+    }
     if (tw->sout)
 	free_stream(tw->sout);
     if (tw->serr)
@@ -125,27 +143,87 @@ free_task_waiting_on_exec(task_waiting_on_exec * tw)
     myfree(tw, M_TASK);
 }
 
+/* These three are called with SIGCHLD blocked. */
+
+static void
+add_waiter(task_waiting_on_exec * tw)
+{
+    task_waiting_on_exec **bucket;
+
+    if (process_count >= process_table_size) {
+	int i, new_size = process_table_size ? process_table_size * 2 : 64;
+	task_waiting_on_exec **new_table = (task_waiting_on_exec **)
+	    mymalloc(new_size * sizeof(task_waiting_on_exec *), M_TASK);
+
+	for (i = 0; i < new_size; i++)
+	    new_table[i] = 0;
+	for (i = 0; i < process_table_size; i++) {
+	    task_waiting_on_exec *t, *next;
+
+	    for (t = process_table[i]; t; t = next) {
+		next = t->next;
+		bucket = &new_table[t->pid & (new_size - 1)];
+		t->next = *bucket;
+		*bucket = t;
+	    }
+	}
+	if (process_table)
+	    myfree(process_table, M_TASK);
+	process_table = new_table;
+	process_table_size = new_size;
+    }
+
+    bucket = &process_table[tw->pid & (process_table_size - 1)];
+    tw->next = *bucket;
+    *bucket = tw;
+    process_count++;
+}
+
+static void
+remove_waiter(task_waiting_on_exec * tw)
+{
+    task_waiting_on_exec **tp;
+
+    for (tp = &process_table[tw->pid & (process_table_size - 1)]; *tp;
+	 tp = &(*tp)->next)
+	if (*tp == tw) {
+	    *tp = tw->next;
+	    process_count--;
+	    return;
+	}
+}
+
+static task_waiting_on_exec *
+find_waiter(pid_t pid)
+{
+    task_waiting_on_exec *tw;
+
+    if (!process_table)
+	return 0;
+    for (tw = process_table[pid & (process_table_size - 1)]; tw; tw = tw->next)
+	if (tw->pid == pid)
+	    return tw;
+    return 0;
+}
+
 static task_enum_action
 exec_waiter_enumerator(task_closure closure, void *data)
 {
     task_enum_action action = TEA_CONTINUE;
+    task_waiting_on_exec *tw;
+    int i;
 
     BLOCK_SIGCHLD;
 
-    int i;
-    for (i = 0; i < EXEC_MAX_PROCESSES; i++) {
-	if (process_table[i]) {
-	    if (TWS_KILL != process_table[i]->status) {
-		action = (*closure) (process_table[i]->the_vm,
-				     process_table[i]->cmd,
-				     data);
+    for (i = 0; i < process_table_size && action == TEA_CONTINUE; i++)
+	for (tw = process_table[i]; tw; tw = tw->next)
+	    if (TWS_KILL != tw->status) {
+		action = (*closure) (tw->the_vm, tw->cmd, data);
 		if (TEA_KILL == action)
-		    process_table[i]->status = TWS_KILL;
+		    tw->status = TWS_KILL;
 		if (TEA_CONTINUE != action)
 		    break;
 	    }
-	}
-    }
 
     UNBLOCK_SIGCHLD;
 
@@ -166,26 +244,30 @@ write_all(int fd, const char *buffer, size_t length)
     return 1;
 }
 
+/* Output is read in large chunks straight into the waiter's streams, so
+ * that a chatty process doesn't cost a trip through the main loop for
+ * every thousand bytes.
+ */
 static void
-stdout_readable(int fd, void *data)
+read_all(int fd, Stream * s)
 {
-    task_waiting_on_exec *tw = (task_waiting_on_exec *)data;
-    char buffer[1000];
+    static char buffer[65536];
     int n;
-    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
-	stream_add_string(tw->sout, raw_bytes_to_binary(buffer, n));
-    }
+
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+	stream_add_raw_bytes_to_binary(s, buffer, n);
+}
+
+static void
+stdout_readable(int fd, void *data)
+{
+    read_all(fd, ((task_waiting_on_exec *)data)->sout);
 }
 
 static void
 stderr_readable(int fd, void *data)
 {
-    task_waiting_on_exec *tw = (task_waiting_on_exec *)data;
-    char buffer[1000];
-    int n;
-    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
-	stream_add_string(tw->serr, raw_bytes_to_binary(buffer, n));
-    }
+    read_all(fd, ((task_waiting_on_exec *)data)->serr);
 }
 
 static pid_t
@@ -284,14 +366,7 @@ exec_waiter_suspender(vm the_vm, void *data)
 
     BLOCK_SIGCHLD;
 
-    int i;
-    for (i = 0; i < EXEC_MAX_PROCESSES; i++) {
-	if (process_table[i] == NULL) {
-	    process_table[i] = tw;
-	    break;
-	}
-    }
-    if (i == EXEC_MAX_PROCESSES) {
+    if (process_count >= server_int_option_cached(SVO_MAX_EXEC_PROCESSES)) {
 	error = E_QUOTA;
 	goto free_task_waiting_on_exec;
     }
@@ -300,9 +375,11 @@ exec_waiter_suspender(vm the_vm, void *data)
 
     if ((tw->pid = fork_and_exec(tw->cmd, tw->args, env, &tw->fin, &tw->fout, &tw->ferr)) == 0) {
 	error = E_EXEC;
-	goto clear_process_slot;
+	goto free_task_waiting_on_exec;
     }
 
+    add_waiter(tw);
+
     oklog("EXEC: %s (%d)...\n", tw->cmd, tw->pid);
 
     set_nonblocking(tw->fin);
@@ -329,9 +406,7 @@ exec_waiter_suspender(vm the_vm, void *data)
 
  close_fin:
     close(tw->fin);
-
- clear_process_slot:
-    process_table[i] = NULL;
+    remove_waiter(tw);
 
  free_task_waiting_on_exec:
     free_task_waiting_on_exec(tw);
@@ -458,14 +533,7 @@ bf_exec(Var arglist, Byte next, void *vdata, Objid progr)
 pid_t
 exec_complete(pid_t pid, int code)
 {
-    task_waiting_on_exec *tw = NULL;
-
-    int i;
-    for (i = 0; i < EXEC_MAX_PROCESSES; i++)
-	if (process_table[i] && process_table[i]->pid == pid) {
-	    tw = process_table[i];
-	    break;
-	}
+    task_waiting_on_exec *tw = find_waiter(pid);
 
     if (tw) {
 	sigchild_interrupt = 1;
@@ -474,13 +542,14 @@ exec_complete(pid_t pid, int code)
 	    tw->status = TWS_STOP;
 	    tw->code = code;
 	}
+	tw->next_done = done_waiters;
+	done_waiters = tw;
 
 	return pid;
     }
 
-    /* We wind up here if the child process was a checkpoint process,
-     * or if an exec task was explicitly killed while the process
-     * itself was still executing.
+    /* We wind up here if the child process was a checkpoint process
+     * or a query worker.
      */
     return 0;
 }
@@ -498,12 +567,19 @@ deal_with_child_exit(void)
 
     sigchild_interrupt = 0;
 
-    task_waiting_on_exec *tw = NULL;
+    /* Resume tasks in the order their processes exited. */
+    task_waiting_on_exec *tw, *next, *done = NULL;
 
-    int i;
-    for (i = 0; i < EXEC_MAX_PROCESSES; i++) {
-	tw = process_table[i];
-	if (tw && TWS_STOP == tw->status) {
+    for (tw = done_waiters; tw; tw = next) {
+	next = tw->next_done;
+	tw->next_done = done;
+	done = tw;
+    }
+    done_waiters = NULL;
+
+    for (tw = done; tw; tw = next) {
+	next = tw->next_done;
+	if (TWS_STOP == tw->status) {
 	    Var v;
 	    v = new_list(3);
 	    v.v.list[1].type = TYPE_INT;
@@ -517,10 +593,8 @@ deal_with_child_exit(void)
 
 	    resume_task(tw->the_vm, v);
 	}
-	if (tw && TWS_CONTINUE != tw->status) {
-	    free_task_waiting_on_exec(tw);
-	    process_table[i] = NULL;
-	}
+	remove_waiter(tw);
+	free_task_waiting_on_exec(tw);
     }
 
     UNBLOCK_SIGCHLD;
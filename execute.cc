@@ -15,6 +15,8 @@
     Pavel@Xerox.Com
  *****************************************************************************/
 
+#include <limits.h>
+
 #include "my-string.h"
 
 #include "collection.h"
@@ -26,6 +28,7 @@
 #include "eval_vm.h"
 #include "execute.h"
 #include "functions.h"
+#include "jit.h"
 #include "list.h"
 #include "log.h"
 #include "map.h"
@@ -33,6 +36,7 @@
 #include "opcode.h"
 #include "options.h"
 #include "parse_cmd.h"
+#include "query.h"
 #include "server.h"
 #include "storage.h"
 #include "streams.h"
@@ -56,6 +60,8 @@ static int root_activ_vector;	/* root_activ_vector == MAIN_VECTOR
 /* these globals are not part of the vm because they get re-initialized
    after a suspend */
 static int ticks_remaining;
+static int ticks_banked;	/* ticks held back until the end of a
+				   background task's quantum */
 int task_timed_out;
 static int interpreter_is_running = 0;
 static Timer_ID task_alarm_id;
@@ -117,6 +123,24 @@ free_rt_stack(activation * a)
 	myfree(stack, M_RT_STACK);
 }
 
+static void
+print_frame(Stream * str, activation * a, int vector)
+{
+    if (TYPE_OBJ == a->vloc.type)
+	stream_printf(str, "#%d:%s", a->vloc.v.obj, a->verbname);
+    else
+	stream_printf(str, "*anonymous*:%s", a->verbname);
+
+    if (equality(a->vloc, a->_this, 0)) {
+	stream_add_string(str, " (this == ");
+	unparse_value(str, a->_this);
+	stream_add_string(str, ")");
+    }
+
+    stream_printf(str, ", line %d",
+		  find_line_number(a->prog, vector, a->error_pc));
+}
+
 void
 print_error_backtrace(const char *msg, void (*output) (const char *))
 {
@@ -130,27 +154,16 @@ print_error_backtrace(const char *msg, void (*output) (const char *))
 	if (t != top_activ_stack)
 	    stream_printf(str, "... called from ");
 
-	if (TYPE_OBJ == activ_stack[t].vloc.type)
-	    stream_printf(str, "#%d:%s", activ_stack[t].vloc.v.obj,
-		          activ_stack[t].verbname);
-	else
-	    stream_printf(str, "*anonymous*:%s",
-		          activ_stack[t].verbname);
-
-	if (equality(activ_stack[t].vloc, activ_stack[t]._this, 0)) {
-	    stream_add_string(str, " (this == ");
-	    unparse_value(str, activ_stack[t]._this);
-	    stream_add_string(str, ")");
-	}
-
-	stream_printf(str, ", line %d",
-		      find_line_number(activ_stack[t].prog,
-				       (t == 0 ? root_activ_vector
-					: MAIN_VECTOR),
-				       activ_stack[t].error_pc));
+	print_frame(str, &activ_stack[t],
+		    (t == 0 ? root_activ_vector : MAIN_VECTOR));
 	if (t == top_activ_stack)
 	    stream_printf(str, ":  %s", msg);
 	output(reset_stream(str));
+	if (activ_stack[t].tail_caller) {
+	    stream_printf(str, "... tail called from ");
+	    print_frame(str, activ_stack[t].tail_caller, MAIN_VECTOR);
+	    output(reset_stream(str));
+	}
 	if (t > 0 && activ_stack[t].bi_func_pc) {
 	    stream_printf(str, "... called from built-in function %s()",
 			  name_func_by_num(activ_stack[t].bi_func_id));
@@ -187,12 +200,11 @@ error_backtrace_list(const char *msg)
     return backtrace_list;
 }
 
-static enum error
-suspend_task(package p)
+static vm
+save_current_vm(void)
 {
     vm the_vm = new_vm(current_task_id, var_ref(current_local), top_activ_stack + 1);
     unsigned int i;
-    enum error e;
 
     the_vm->max_stack_size = max_stack_size;
     the_vm->top_activ_stack = top_activ_stack;
@@ -201,12 +213,60 @@ suspend_task(package p)
     for (i = 0; i <= top_activ_stack; i++)
 	the_vm->activ_stack[i] = activ_stack[i];
 
+    return the_vm;
+}
+
+static enum error
+suspend_task(package p)
+{
+    vm the_vm = save_current_vm();
+    enum error e;
+
     e = (*p.u.susp.proc) (the_vm, p.u.susp.data);
     if (e != E_NONE)
 	free_vm(the_vm, 0);
     return e;
 }
 
+/* Puts aside the running background task, which has used up its
+ * quantum, behind everything else that is ready to run.  It goes back on
+ * the queue as if it had suspended and been resumed with VALUE, which
+ * has been popped off the top of its stack and so is pushed back on when
+ * it runs again; it carries on with the ticks and seconds it had left.
+ */
+static long long task_usecs_left(void);
+
+static void
+preempt_task(Var value)
+{
+    vm the_vm = save_current_vm();
+
+    the_vm->ticks_left = ticks_remaining + ticks_banked;
+    the_vm->usecs_left = task_usecs_left();
+    resume_task(the_vm, value);
+}
+
+/* Moves up to N banked ticks into ticks_remaining. */
+static void
+draw_banked_ticks(int n)
+{
+    if (n > ticks_banked)
+	n = ticks_banked;
+    ticks_remaining += n;
+    ticks_banked -= n;
+}
+
+int
+charge_ticks(int n)
+{
+    if (n > ticks_remaining)
+	draw_banked_ticks(n - ticks_remaining);
+    if (n > ticks_remaining)
+	return 0;
+    ticks_remaining -= n;
+    return 1;
+}
+
 static int raise_error(package p, enum outcome *outcome);
 static void abort_task(enum abort_reason reason);
 
@@ -403,6 +463,24 @@ find_handler_activ(Var code)
     return -1;
 }
 
+static Var
+make_stack_entry(activation * a, int vector, int line_numbers_too,
+		 Objid progr)
+{
+    Var v = new_list(line_numbers_too ? 6 : 5);
+
+    v.v.list[1] = anonymizing_var_ref(a->_this, progr);
+    v.v.list[2] = str_ref_to_var(a->verb);
+    v.v.list[3] = new_obj(a->progr);
+    v.v.list[4] = anonymizing_var_ref(a->vloc, progr);
+    v.v.list[5] = new_obj(a->player);
+    if (line_numbers_too) {
+	v.v.list[6].type = TYPE_INT;
+	v.v.list[6].v.num = find_line_number(a->prog, vector, a->error_pc);
+    }
+    return v;
+}
+
 static Var
 make_stack_list(activation * stack, int start, int end, int include_end,
 		int root_vector, int line_numbers_too, Objid progr)
@@ -413,6 +491,8 @@ make_stack_list(activation * stack, int start, int end, int include_end,
     for (i = end; i >= start; i--) {
 	if (include_end || i != end)
 	    count++;
+	if (stack[i].tail_caller)
+	    count++;
 	if (i != start && stack[i].bi_func_pc)
 	    count++;
     }
@@ -422,21 +502,15 @@ make_stack_list(activation * stack, int start, int end, int include_end,
     for (i = end; i >= start; i--) {
 	Var v;
 
-	if (include_end || i != end) {
-	    v = r.v.list[j++] = new_list(line_numbers_too ? 6 : 5);
-	    v.v.list[1] = anonymizing_var_ref(stack[i]._this, progr);
-	    v.v.list[2] = str_ref_to_var(stack[i].verb);
-	    v.v.list[3] = new_obj(stack[i].progr);
-	    v.v.list[4] = anonymizing_var_ref(stack[i].vloc, progr);
-	    v.v.list[5] = new_obj(stack[i].player);
-	    if (line_numbers_too) {
-		v.v.list[6].type = TYPE_INT;
-		v.v.list[6].v.num = find_line_number(stack[i].prog,
-						     (i == 0 ? root_vector
-						      : MAIN_VECTOR),
-						     stack[i].error_pc);
-	    }
-	}
+	if (include_end || i != end)
+	    r.v.list[j++] = make_stack_entry(&stack[i],
+					     (i == 0 ? root_vector
+					      : MAIN_VECTOR),
+					     line_numbers_too, progr);
+	if (stack[i].tail_caller)
+	    r.v.list[j++] = make_stack_entry(stack[i].tail_caller,
+					     MAIN_VECTOR,
+					     line_numbers_too, progr);
 	if (i != start && stack[i].bi_func_pc) {
 	    v = r.v.list[j++] = new_list(line_numbers_too ? 6 : 5);
 	    v.v.list[1].type = TYPE_OBJ;
@@ -546,21 +620,40 @@ abort_task(enum abort_reason reason)
 
 /**** activation manipulation ****/
 
+/* While a tail call is being set up the callee may briefly occupy the
+ * slot above the stack limit (see `check_activ_stack_size()').
+ */
+static int tail_call_slot = 0;
+
 static int
 push_activation(void)
 {
-    if (top_activ_stack < max_stack_size - 1) {
+    if (top_activ_stack < max_stack_size - 1 + tail_call_slot) {
 	top_activ_stack++;
 	return 1;
     } else
 	return 0;
 }
 
+static void
+free_tail_caller(activation * t)
+{
+    free_var(t->_this);
+    free_var(t->vloc);
+    free_str(t->verb);
+    free_str(t->verbname);
+    free_program(t->prog);
+    myfree(t, M_VM);
+}
+
 void
 free_activation(activation * ap, char data_too)
 {
     Var *i;
 
+    if (ap->tail_caller)
+	free_tail_caller(ap->tail_caller);
+
     free_rt_env(ap->rt_env, ap->prog->num_var_names);
 
     for (i = ap->base_rt_stack; i < ap->top_rt_stack; i++)
@@ -580,6 +673,139 @@ free_activation(activation * ap, char data_too)
 }
 
 
+/** Inherited built-in variables **/
+
+/* A called verb starts with its caller's values of these.  If the
+ * verb's code never mentions one of them `call_verb2()' leaves its
+ * slot empty, and whoever needs the value looks further down the
+ * stack for the nearest activation that has one.  Code can't assign
+ * to an empty slot without mentioning it, so the value found there
+ * is the one the activation would have inherited.
+ */
+static const int inherited_slots[] = {
+    SLOT_ARGSTR, SLOT_DOBJ, SLOT_DOBJSTR, SLOT_PREPSTR, SLOT_IOBJ,
+    SLOT_IOBJSTR
+};
+
+#define NUM_INHERITED_SLOTS \
+    (sizeof(inherited_slots) / sizeof(inherited_slots[0]))
+
+static Var
+inherited_var(int slot, int frame)
+{				/* does NOT increment the ref count */
+    for (; frame >= 0; frame--)
+	if (activ_stack[frame].rt_env[slot].type != TYPE_NONE)
+	    return activ_stack[frame].rt_env[slot];
+
+    return none;
+}
+
+/* Fills in the empty inherited slots of a copy of the running
+ * activation's environment; used for forked tasks, which run without
+ * the rest of the stack.
+ */
+void
+fill_in_inherited_vars(Var * env)
+{
+    unsigned i;
+
+    for (i = 0; i < NUM_INHERITED_SLOTS; i++) {
+	int slot = inherited_slots[i];
+	if (env[slot].type == TYPE_NONE)
+	    env[slot] = var_ref(inherited_var(slot, top_activ_stack));
+    }
+}
+
+/* Moves inherited values that `to' is relying on out of `from' when
+ * `from' is about to go away.
+ */
+static void
+hand_down_inherited_vars(Var * from, Var * to)
+{
+    unsigned i;
+
+    for (i = 0; i < NUM_INHERITED_SLOTS; i++) {
+	int slot = inherited_slots[i];
+	if (to[slot].type == TYPE_NONE) {
+	    to[slot] = from[slot];
+	    from[slot] = none;
+	}
+    }
+}
+
+/** Tail calls **/
+
+/* A verb call or `pass()' that is immediately followed by OP_RETURN
+ * can reuse the activation of the verb making the call, provided that
+ * nothing remains to be done in that activation once the callee
+ * returns: no enclosing try/except or try/finally and no built-in
+ * function waiting on its value.  The callee must also see the same
+ * `caller_perms()' it would have seen otherwise, so the caller's
+ * permissions must match those of the verb that called it.
+ */
+static int
+tail_call_ok(unsigned frame)
+{
+    activation *a = &activ_stack[frame];
+    Var *v;
+
+    if (!server_flag_option_cached(SVO_TAIL_CALLS)
+	|| frame == 0
+	|| a->bi_func_pc != 0
+	|| a->progr != activ_stack[frame - 1].progr)
+	return 0;
+
+    for (v = a->base_rt_stack; v < a->top_rt_stack; v++)
+	if (v->type == TYPE_CATCH || v->type == TYPE_FINALLY)
+	    return 0;
+
+    return 1;
+}
+
+/* Replace the caller of the newly pushed top activation with the
+ * callee itself, remembering who the caller was.
+ */
+static void
+collapse_tail_call(void)
+{
+    activation *a = &CALLER_ACTIV;
+    activation *t = (activation *)mymalloc(sizeof(activation), M_VM);
+    Var *i;
+
+    if (a->tail_caller)
+	free_tail_caller(a->tail_caller);
+
+    /* ownership of the identifying fields moves to `t' */
+    t->prog = a->prog;
+    t->_this = a->_this;
+    t->vloc = a->vloc;
+    t->verb = a->verb;
+    t->verbname = a->verbname;
+    t->progr = a->progr;
+    t->player = a->player;
+    t->recv = a->recv;
+    t->debug = a->debug;
+    t->pc = a->pc;
+    t->error_pc = a->error_pc;
+    t->bi_func_pc = 0;
+    t->rt_env = 0;
+    t->base_rt_stack = t->top_rt_stack = 0;
+    t->rt_stack_size = 0;
+    t->temp = none;
+    t->tail_caller = 0;
+
+    hand_down_inherited_vars(a->rt_env, RUN_ACTIV.rt_env);
+    free_rt_env(a->rt_env, a->prog->num_var_names);
+    for (i = a->base_rt_stack; i < a->top_rt_stack; i++)
+	free_var(*i);
+    free_rt_stack(a);
+    free_var(a->temp);
+
+    *a = RUN_ACTIV;
+    a->tail_caller = t;
+    top_activ_stack--;
+}
+
 /** Set up another activation for calling a verb
   does not change the vm in case of any error **/
 
@@ -685,16 +911,18 @@ call_verb2(Objid recv, const char *vname, Var _this, Var args, int do_pass)
     RUN_ACTIV.error_pc = 0;
     RUN_ACTIV.bi_func_pc = 0;
     RUN_ACTIV.temp.type = TYPE_NONE;
+    RUN_ACTIV.tail_caller = 0;
 
     RUN_ACTIV.rt_env = env = new_rt_env(RUN_ACTIV.prog->num_var_names);
 
-    fill_in_rt_consts(env, program->version);
+    fill_in_rt_consts(env, program->version, program->builtin_var_refs);
 
     set_rt_env_var(env, SLOT_THIS, var_ref(RUN_ACTIV._this));
     set_rt_env_var(env, SLOT_CALLER, var_ref(CALLER_ACTIV._this));
 
 #define ENV_COPY(slot) \
-    set_rt_env_var(env, slot, var_ref(CALLER_ACTIV.rt_env[slot]))
+    if (program->builtin_var_refs & (1U << slot)) \
+	set_rt_env_var(env, slot, var_ref(inherited_var(slot, top_activ_stack - 1)))
 
     ENV_COPY(SLOT_ARGSTR);
     ENV_COPY(SLOT_DOBJ);
@@ -705,7 +933,7 @@ call_verb2(Objid recv, const char *vname, Var _this, Var args, int do_pass)
 
     if (is_wizard(CALLER_ACTIV.progr) &&
 	(CALLER_ACTIV.rt_env[SLOT_PLAYER].type == TYPE_OBJ))
-	ENV_COPY(SLOT_PLAYER);
+	set_rt_env_var(env, SLOT_PLAYER, var_ref(CALLER_ACTIV.rt_env[SLOT_PLAYER]));
     else
 	set_rt_env_obj(env, SLOT_PLAYER, CALLER_ACTIV.player);
     RUN_ACTIV.player = env[SLOT_PLAYER].v.obj;
@@ -836,9 +1064,30 @@ do {								\
       next_opcode:
 	error_bv = bv;
 	op = (Opcode)(*bv++);
+#ifdef BYTECODE_INT_OPS
+      redispatch:		/* integer opcodes falling back to generic ones */
+#endif				/* BYTECODE_INT_OPS */
 
 	if (COUNT_TICK(op)) {
-	    if (--ticks_remaining <= 0) {
+	    if (--ticks_remaining <= 0 && ticks_banked > 0) {
+		/* The end of a quantum.  Preempt the task so that this
+		 * opcode runs first thing when it's resumed, unless there's
+		 * nothing on the stack that resumption can restore, in
+		 * which case try again at the next tick.  An extended op
+		 * may already have spent the last tick of the quantum, so
+		 * draw enough to bring the count back up to one.
+		 */
+		if (rts > RUN_ACTIV.base_rt_stack && rts[-1].type != TYPE_ERR) {
+		    ticks_remaining++;
+		    bv = error_bv;
+		    rts--;
+		    STORE_STATE_VARIABLES();
+		    preempt_task(*rts);
+		    return OUTCOME_BLOCKED;
+		}
+		draw_banked_ticks(1 - ticks_remaining);
+	    }
+	    if (ticks_remaining <= 0) {
 		STORE_STATE_VARIABLES();
 		abort_task(ABORT_TICKS);
 		return OUTCOME_ABORTED;
@@ -874,6 +1123,15 @@ do {								\
 	case OP_JUMP:
 	    {
 		unsigned lab = READ_BYTES(bv, bc.numbytes_label);
+#ifdef JIT
+		/* jumping back to the top of a loop */
+		if (lab < (unsigned) (error_bv - bc.vector)
+		    && server_flag_option_cached(SVO_JIT))
+		    lab = jit_run_loop(RUN_ACTIV.prog, &bc, lab,
+				       error_bv - bc.vector,
+				       RUN_ACTIV.rt_env, &rts,
+				       &ticks_remaining);
+#endif
 		JUMP(lab);
 	    }
 	    break;
@@ -886,7 +1144,13 @@ do {								\
 
 		to = TOP_RT_VALUE;
 		from = NEXT_TOP_RT_VALUE;
-		if ((to.type != TYPE_INT && to.type != TYPE_OBJ)
+		if (to.type == TYPE_INT && from.type == TYPE_INT
+		    && from.v.num <= to.v.num && from.v.num < MAXINT) {
+		    /* the usual case, counting up through integers */
+		    free_var(RUN_ACTIV.rt_env[id]);
+		    RUN_ACTIV.rt_env[id] = from;
+		    NEXT_TOP_RT_VALUE.v.num++;
+		} else if ((to.type != TYPE_INT && to.type != TYPE_OBJ)
 		    || to.type != from.type) {
 		    RAISE_ERROR(E_TYPE);
 		    free_var(POP());
@@ -1716,6 +1980,8 @@ do {								\
 		    free_var(obj);
 
 		    if (err == E_NONE) {
+			if (in_parallel_worker)
+			    abandon_parallel_call("property assignment");
 			db_set_property_value(h, var_ref(rhs));
 			PUSH(rhs);
 		    } else {
@@ -1745,6 +2011,8 @@ do {								\
 		} else {
 		    enum error e;
 
+		    if (in_parallel_worker)
+			abandon_parallel_call("fork");
 		    e = enqueue_forked_task2(RUN_ACTIV, f_index, time.v.num,
 					op == OP_FORK_WITH_ID ? id : -1);
 		    if (e != E_NONE)
@@ -1799,12 +2067,19 @@ do {								\
 		    free_var(system);
 
 		    if (is_object(obj) || recv != NOTHING) {
+			int tail;
+
 			STORE_STATE_VARIABLES();
+			tail = (bv[0] == OP_RETURN && tail_call_ok(top_activ_stack));
+			tail_call_slot = tail;
 			err = call_verb2(recv, verb.v.str, obj, args, 0);
+			tail_call_slot = 0;
 			/* if there is no error, RUN_ACTIV is now the CALLEE's.
 			   args will be consumed in the new rt_env */
 			/* if there is an error, then RUN_ACTIV is unchanged, and
 			   args is not consumed in this case */
+			if (tail && err == E_NONE)
+			    collapse_tail_call();
 			LOAD_STATE_VARIABLES();
 		    }
 		    else
@@ -1882,6 +2157,15 @@ do {								\
 			RUN_ACTIV.bi_func_id = func_id;
 			RUN_ACTIV.bi_func_data = p.u.call.data;
 			RUN_ACTIV.bi_func_pc = p.u.call.pc;
+			/* `pass()' and friends finish with a tail call of
+			   their own; nothing is left for this frame either */
+			if (p.u.call.pc == 0
+			    && tail_call_ok(top_activ_stack - 1)
+			    && (CALLER_ACTIV.prog->main_vector.vector[CALLER_ACTIV.pc]
+				== OP_RETURN)) {
+			    collapse_tail_call();
+			    LOAD_STATE_VARIABLES();
+			}
 			break;
 		    case package::BI_SUSPEND:
 			{
@@ -2252,77 +2536,39 @@ do {								\
 		    break;
 
 		case EOP_FOR_LIST_1:
+		case EOP_FOR_LIST_2:
 		    {
 #			define ITER TOP_RT_VALUE
 #			define BASE NEXT_TOP_RT_VALUE
 
 			unsigned id = READ_BYTES(bv, bc.numbytes_var_name);
+			unsigned index = (eop == EOP_FOR_LIST_2
+					  ? READ_BYTES(bv, bc.numbytes_var_name)
+					  : 0);
 			unsigned lab = READ_BYTES(bv, bc.numbytes_label);
-
-			if (BASE.type != TYPE_STR && BASE.type != TYPE_LIST
-			    && BASE.type != TYPE_MAP) {
-			    RAISE_ERROR(E_TYPE);
-			    free_var(POP());
-			    free_var(POP());
-			    JUMP(lab);
-			} else if (BASE.type == TYPE_STR || BASE.type == TYPE_LIST) {
-			    int len = (BASE.type == TYPE_STR
-				       ? memo_strlen(BASE.v.str)
-				       : BASE.v.list[0].v.num);
-			    if (ITER.type == TYPE_NONE) {
-				free_var(ITER);
-				ITER = new_int(1);
-			    }
-			    if (ITER.v.num > len) {
+			Var *env = RUN_ACTIV.rt_env;
+
+			/* The common case first: stepping through a list
+			 * whose iteration has already started.  The index
+			 * is always an integer, so assigning it needs no
+			 * reference counting.
+			 */
+			if (BASE.type == TYPE_LIST && ITER.type == TYPE_INT) {
+			    if (ITER.v.num > BASE.v.list[0].v.num) {
 				free_var(POP());
 				free_var(POP());
 				JUMP(lab);
 			    } else {
-				free_var(RUN_ACTIV.rt_env[id]);
-				RUN_ACTIV.rt_env[id] = (BASE.type == TYPE_STR)
-				  ? strget(BASE, ITER.v.num)
-				  : var_ref(BASE.v.list[ITER.v.num]);
+				free_var(env[id]);
+				env[id] = var_ref(BASE.v.list[ITER.v.num]);
+				if (eop == EOP_FOR_LIST_2) {
+				    free_var(env[index]);
+				    env[index] = ITER;
+				}
 				ITER.v.num++;	/* increment iter */
 			    }
-			} else if (BASE.type == TYPE_MAP) {
-			    if (ITER.type == TYPE_NONE) {
-				/* starting iteration */
-				free_var(ITER);
-				ITER = new_iter(BASE);
-			    } else if (ITER.type != TYPE_ITER) {
-				/* resuming an iteration after a db load */
-				Var iter;
-				mapseek(BASE, ITER, &iter, 0);
-				free_var(ITER);
-				ITER = iter;
-			    }
-			    var_pair pair;
-			    if (ITER.type == TYPE_NONE || !iterget(ITER, &pair)) {
-				free_var(POP());
-				free_var(POP());
-				JUMP(lab);
-			    } else {
-				free_var(RUN_ACTIV.rt_env[id]);
-				RUN_ACTIV.rt_env[id] = var_ref(pair.b);
-				iternext(ITER);	/* increment iter */
-			    }
-			}
-#			undef ITER
-#			undef BASE
-		    }
-		    break;
-
-		case EOP_FOR_LIST_2:
-		    {
-#			define ITER TOP_RT_VALUE
-#			define BASE NEXT_TOP_RT_VALUE
-
-			unsigned id = READ_BYTES(bv, bc.numbytes_var_name);
-			unsigned index = READ_BYTES(bv, bc.numbytes_var_name);
-			unsigned lab = READ_BYTES(bv, bc.numbytes_label);
-
-			if (BASE.type != TYPE_STR && BASE.type != TYPE_LIST
-			    && BASE.type != TYPE_MAP) {
+			} else if (BASE.type != TYPE_STR && BASE.type != TYPE_LIST
+				   && BASE.type != TYPE_MAP) {
 			    RAISE_ERROR(E_TYPE);
 			    free_var(POP());
 			    free_var(POP());
@@ -2340,19 +2586,23 @@ do {								\
 				free_var(POP());
 				JUMP(lab);
 			    } else {
-				free_var(RUN_ACTIV.rt_env[id]);
-				RUN_ACTIV.rt_env[id] = (BASE.type == TYPE_STR)
+				free_var(env[id]);
+				env[id] = (BASE.type == TYPE_STR)
 				  ? strget(BASE, ITER.v.num)
 				  : var_ref(BASE.v.list[ITER.v.num]);
-				free_var(RUN_ACTIV.rt_env[index]);
-				RUN_ACTIV.rt_env[index] = var_ref(ITER);
+				if (eop == EOP_FOR_LIST_2) {
+				    free_var(env[index]);
+				    env[index] = ITER;
+				}
 				ITER.v.num++;	/* increment iter */
 			    }
 			} else if (BASE.type == TYPE_MAP) {
 			    if (ITER.type == TYPE_NONE) {
+				/* starting iteration */
 				free_var(ITER);
 				ITER = new_iter(BASE);
 			    } else if (ITER.type != TYPE_ITER) {
+				/* resuming an iteration after a db load */
 				Var iter;
 				mapseek(BASE, ITER, &iter, 0);
 				free_var(ITER);
@@ -2364,10 +2614,12 @@ do {								\
 				free_var(POP());
 				JUMP(lab);
 			    } else {
-				free_var(RUN_ACTIV.rt_env[id]);
-				RUN_ACTIV.rt_env[id] = var_ref(pair.b);
-				free_var(RUN_ACTIV.rt_env[index]);
-				RUN_ACTIV.rt_env[index] = var_ref(pair.a);
+				free_var(env[id]);
+				env[id] = var_ref(pair.b);
+				if (eop == EOP_FOR_LIST_2) {
+				    free_var(env[index]);
+				    env[index] = var_ref(pair.a);
+				}
 				iternext(ITER);	/* increment iter */
 			    }
 			}
@@ -2575,6 +2827,116 @@ do {								\
 	    break;
 #endif				/* BYTECODE_REDUCE_REF */
 
+#ifdef BYTECODE_INT_OPS
+	case OP_UPDATE_INT:
+#ifdef BYTECODE_REDUCE_REF
+	case OP_UPDATE_INT_CLEAR:
+#endif				/* BYTECODE_REDUCE_REF */
+	    {
+		/* x = x + y, x = x - y or x = x * y, where bv[0] pushes y,
+		 * bv[1] is the arithmetic op and bv[2] is PUT_n for x.
+		 */
+		Var *env = RUN_ACTIV.rt_env;
+		Var *xp = &env[PUT_n_INDEX(bv[2])];
+		Var *yp = 0;
+		unsigned yop = bv[0];
+		Var ans;
+
+		if (IS_OPTIM_NUM_OPCODE(yop)) {
+		    ans.type = TYPE_INT;
+		    ans.v.num = OPCODE_TO_OPTIM_NUM(yop);
+		}
+#ifdef BYTECODE_REDUCE_REF
+		else if (IS_PUSH_CLEAR_n(yop))
+		    ans = *(yp = &env[PUSH_CLEAR_n_INDEX(yop)]);
+#endif				/* BYTECODE_REDUCE_REF */
+		else
+		    ans = *(yp = &env[PUSH_n_INDEX(yop)]);
+
+		/* the generic ops would count two ticks */
+		if (xp->type != TYPE_INT || ans.type != TYPE_INT
+		    || ticks_remaining <= 2 || task_timed_out) {
+		    op = INT_OP_TO_GENERIC(op, bv);
+		    goto redispatch;
+		}
+		ticks_remaining -= 2;
+
+		switch (bv[1]) {
+		case OP_ADD:
+		    ans.v.num = (UNum) xp->v.num + (UNum) ans.v.num;
+		    break;
+		case OP_MINUS:
+		    ans.v.num = (UNum) xp->v.num - (UNum) ans.v.num;
+		    break;
+		default:
+		    ans.v.num = (UNum) xp->v.num * (UNum) ans.v.num;
+		    break;
+		}
+#ifdef BYTECODE_REDUCE_REF
+		if (yp && !IS_PUSH_n(yop))
+		    yp->type = TYPE_NONE;
+#endif				/* BYTECODE_REDUCE_REF */
+		*xp = ans;
+		if (bv[3] == OP_POP)
+		    bv += 4;
+		else {
+		    PUSH(ans);
+		    bv += 3;
+		}
+	    }
+	    break;
+
+	case OP_EQ_TEST:
+	case OP_NE_TEST:
+	case OP_LT_TEST:
+	case OP_LE_TEST:
+	case OP_GT_TEST:
+	case OP_GE_TEST:
+	    {
+		/* a comparison followed by IF, WHILE, EIF or IF_QUES */
+		Var rhs, lhs;
+		int cond;
+
+		rhs = TOP_RT_VALUE;
+		lhs = NEXT_TOP_RT_VALUE;
+		if (lhs.type != TYPE_INT || rhs.type != TYPE_INT
+		    || ticks_remaining <= 2 || task_timed_out) {
+		    op = (Opcode) INT_TEST_TO_COMPARISON(op);
+		    goto redispatch;
+		}
+		ticks_remaining -= 2;
+
+		switch (op) {
+		case OP_EQ_TEST:
+		    cond = (lhs.v.num == rhs.v.num);
+		    break;
+		case OP_NE_TEST:
+		    cond = (lhs.v.num != rhs.v.num);
+		    break;
+		case OP_LT_TEST:
+		    cond = (lhs.v.num < rhs.v.num);
+		    break;
+		case OP_LE_TEST:
+		    cond = (lhs.v.num <= rhs.v.num);
+		    break;
+		case OP_GT_TEST:
+		    cond = (lhs.v.num > rhs.v.num);
+		    break;
+		default:
+		    cond = (lhs.v.num >= rhs.v.num);
+		    break;
+		}
+		rts -= 2;
+		SKIP_BYTES(bv, 1);	/* the test */
+		if (!cond) {
+		    unsigned lab = READ_BYTES(bv, bc.numbytes_label);
+		    JUMP(lab);
+		} else
+		    SKIP_BYTES(bv, bc.numbytes_label);
+	    }
+	    break;
+#endif				/* BYTECODE_INT_OPS */
+
 	case OP_PUT:
 	case OP_PUT + 1:
 	case OP_PUT + 2:
@@ -2643,36 +3005,100 @@ task_timeout(Timer_ID id, Timer_Data data)
     task_timed_out = timeouts_enabled;
 }
 
+/* The CPU time the server has used, in microseconds, or -1 if that
+ * can't be told.
+ */
+static long long
+cpu_usecs(void)
+{
+#ifdef CLOCK_PROCESS_CPUTIME_ID
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) == 0)
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+#endif
+    return -1;
+}
+
+static long long task_usecs;	/* what the running task had to start with */
+static long long task_started;	/* cpu_usecs() when it started */
+
+/* What the running task has left of its seconds limit, in microseconds.
+ * The virtual timer can't be relied on for this, since the kernel rounds
+ * it up to a whole clock tick every time it's set, and a task preempted
+ * often enough would never run out.
+ */
+static long long
+task_usecs_left(void)
+{
+    long long now = cpu_usecs();
+    long long left;
+
+    if (now < 0 || task_started < 0)
+	return timer_wakeup_interval_ms(task_alarm_id) * 1000LL;
+    left = task_usecs - (now - task_started);
+    return left > 0 ? left : 0;
+}
+
+/* The seconds limit for a new foreground or background task, in
+ * microseconds.
+ */
+static long long
+task_usecs_limit(int is_fg)
+{
+    int seconds = (is_fg
+		   ? server_int_option("fg_seconds", DEFAULT_FG_SECONDS)
+		   : server_int_option("bg_seconds", DEFAULT_BG_SECONDS));
+
+    if (seconds < 1)
+	seconds = 1;
+    else if (seconds > INT_MAX / 1000)
+	seconds = INT_MAX / 1000;
+    return seconds * 1000000LL;
+}
+
 static Timer_ID
-setup_task_execution_limits(int seconds, int ticks)
+setup_task_execution_limits(long long usecs, int ticks, int quantum)
 {
-    task_alarm_id = set_virtual_timer(seconds < 1 ? 1 : seconds,
-				      task_timeout, 0);
-    task_timed_out = 0;
+    task_alarm_id = set_virtual_timer_ms(usecs < 1000 ? 1 : usecs / 1000,
+					 task_timeout, 0);
+    task_usecs = usecs;
+    task_started = cpu_usecs();
+    /* a preempted task that has no time left is out of seconds */
+    task_timed_out = usecs <= 0 ? timeouts_enabled : 0;
     ticks_remaining = (ticks < 100 ? 100 : ticks);
+    ticks_banked = 0;
+    if (quantum > 0 && quantum < ticks_remaining) {
+	ticks_banked = ticks_remaining - quantum;
+	ticks_remaining = quantum;
+    }
     return task_alarm_id;
 }
 
 enum outcome
 run_interpreter(char raise, enum error e,
-		Var * result, int is_fg, int do_db_tracebacks)
+		Var * result, int is_fg, int do_db_tracebacks,
+		int ticks_left, long long usecs_left)
     /* raise is boolean, true iff an error should be raised.
        e is the specific error to be raised if so.
        (in earlier versions, an error was raised iff e != E_NONE,
        but now it's possible to raise E_NONE on resumption from
-       suspend().) */
+       suspend().)
+       ticks_left, if nonzero, and usecs_left are the limits a
+       preempted task has left. */
 {
     enum outcome ret;
     Var args;
 
-    setup_task_execution_limits(is_fg ? server_int_option("fg_seconds",
-						      DEFAULT_FG_SECONDS)
-				: server_int_option("bg_seconds",
-						    DEFAULT_BG_SECONDS),
-				is_fg ? server_int_option("fg_ticks",
+    setup_task_execution_limits(ticks_left ? usecs_left
+				: task_usecs_limit(is_fg),
+				ticks_left ? ticks_left
+				: is_fg ? server_int_option("fg_ticks",
 							DEFAULT_FG_TICKS)
 				: server_int_option("bg_ticks",
-						    DEFAULT_BG_TICKS));
+						    DEFAULT_BG_TICKS),
+				is_fg ? 0
+				: server_int_option_cached(SVO_BG_QUANTUM));
 
     /* handler_verb_* is garbage/unreferenced outside of run()
      * and this is the only place run() is called. */
@@ -2728,7 +3154,9 @@ check_activ_stack_size(int max)
 	if (activ_stack)
 	    myfree(activ_stack, M_VM);
 
-	activ_stack = (activation *)mymalloc(sizeof(activation) * max, M_VM);
+	/* one extra slot for setting up tail calls */
+	activ_stack = (activation *)mymalloc(sizeof(activation) * (max + 1),
+					     M_VM);
 	max_stack_size = max;
     }
 }
@@ -2769,17 +3197,70 @@ do_task(Program * prog, int which_vector, Var * result, int is_fg, int do_db_tra
     RUN_ACTIV.error_pc = 0;
     RUN_ACTIV.bi_func_pc = 0;
     RUN_ACTIV.temp.type = TYPE_NONE;
+    RUN_ACTIV.tail_caller = 0;
 
-    return run_interpreter(0, E_NONE, result, is_fg, do_db_tracebacks);
+    return run_interpreter(0, E_NONE, result, is_fg, do_db_tracebacks, 0, 0);
 }
 
 /* procedure to resume an old task */
 
+void
+compact_vm(vm the_vm)
+{
+    unsigned int i;
+
+    if (the_vm->compacted)
+	return;
+    for (i = 0; i <= the_vm->top_activ_stack; i++) {
+	activation *a = &the_vm->activ_stack[i];
+	int depth = a->top_rt_stack - a->base_rt_stack;
+	Var *stack = 0;
+
+	/* The old stack goes back to malloc rather than to
+	 * rt_stack_quick, which would only hold on to it.
+	 */
+	if (depth > 0) {
+	    stack = (Var *)mymalloc(depth * sizeof(Var), M_RT_STACK);
+	    memcpy(stack, a->base_rt_stack, depth * sizeof(Var));
+	}
+	myfree(a->base_rt_stack, M_RT_STACK);
+	a->base_rt_stack = stack;
+	a->top_rt_stack = stack + depth;
+	/* a->rt_stack_size is left as the size to expand to */
+    }
+    the_vm->compacted = 1;
+}
+
+void
+expand_vm(vm the_vm)
+{
+    unsigned int i;
+
+    if (!the_vm->compacted)
+	return;
+    for (i = 0; i <= the_vm->top_activ_stack; i++) {
+	activation *a = &the_vm->activ_stack[i];
+	int depth = a->top_rt_stack - a->base_rt_stack;
+	Var *stack = a->base_rt_stack;
+
+	alloc_rt_stack(a, a->rt_stack_size);
+	if (stack) {
+	    memcpy(a->base_rt_stack, stack, depth * sizeof(Var));
+	    myfree(stack, M_RT_STACK);
+	}
+	a->top_rt_stack = a->base_rt_stack + depth;
+    }
+    the_vm->compacted = 0;
+}
+
 enum outcome
 resume_from_previous_vm(vm the_vm, Var v)
 {
     unsigned int i;
+    int ticks_left = the_vm->ticks_left;
+    long long usecs_left = the_vm->usecs_left;
 
+    expand_vm(the_vm);
     check_activ_stack_size(the_vm->max_stack_size);
     top_activ_stack = the_vm->top_activ_stack;
     root_activ_vector = the_vm->root_activ_vector;
@@ -2789,12 +3270,14 @@ resume_from_previous_vm(vm the_vm, Var v)
     free_vm(the_vm, 0);
 
     if (v.type == TYPE_ERR)
-	return run_interpreter(1, v.v.err, 0, 0/*bg*/, 1/*traceback*/);
+	return run_interpreter(1, v.v.err, 0, 0/*bg*/, 1/*traceback*/,
+			       ticks_left, usecs_left);
     else {
 	/* PUSH_REF(v) */
 	*(RUN_ACTIV.top_rt_stack++) = var_ref(v);
 
-	return run_interpreter(0, E_NONE, 0, 0/*bg*/, 1/*traceback*/);
+	return run_interpreter(0, E_NONE, 0, 0/*bg*/, 1/*traceback*/,
+			       ticks_left, usecs_left);
     }
 }
 
@@ -2832,7 +3315,7 @@ do_server_program_task(Var _this, const char *verb, Var args, Var vloc,
     RUN_ACTIV.verb = str_dup(verb);
     RUN_ACTIV.verbname = str_dup(verbname);
     RUN_ACTIV.debug = debug;
-    fill_in_rt_consts(env, program->version);
+    fill_in_rt_consts(env, program->version, program->builtin_var_refs);
     set_rt_env_obj(env, SLOT_PLAYER, player);
     set_rt_env_obj(env, SLOT_CALLER, -1);
     set_rt_env_var(env, SLOT_THIS, var_ref(RUN_ACTIV._this));
@@ -2863,21 +3346,21 @@ do_input_task(Objid user, Parsed_Command * pc, Objid recv, db_verb_handle vh)
     RUN_ACTIV.progr = db_verb_owner(vh);
     RUN_ACTIV.recv = recv;
     RUN_ACTIV.vloc = var_ref(db_verb_definer(vh));
-    RUN_ACTIV.verb = str_ref(pc->verb);
+    RUN_ACTIV.verb = str_dup(pc->verb);
     RUN_ACTIV.verbname = str_ref(db_verb_names(vh));
     RUN_ACTIV.debug = (db_verb_flags(vh) & VF_DEBUG);
-    fill_in_rt_consts(env, prog->version);
+    fill_in_rt_consts(env, prog->version, prog->builtin_var_refs);
     set_rt_env_obj(env, SLOT_PLAYER, user);
     set_rt_env_obj(env, SLOT_CALLER, user);
     set_rt_env_var(env, SLOT_THIS, var_ref(RUN_ACTIV._this));
     set_rt_env_obj(env, SLOT_DOBJ, pc->dobj);
     set_rt_env_obj(env, SLOT_IOBJ, pc->iobj);
-    set_rt_env_str(env, SLOT_DOBJSTR, str_ref(pc->dobjstr));
-    set_rt_env_str(env, SLOT_IOBJSTR, str_ref(pc->iobjstr));
-    set_rt_env_str(env, SLOT_ARGSTR, str_ref(pc->argstr));
-    set_rt_env_str(env, SLOT_PREPSTR, str_ref(pc->prepstr));
-    set_rt_env_str(env, SLOT_VERB, str_ref(pc->verb));
-    set_rt_env_var(env, SLOT_ARGS, var_ref(pc->args));
+    set_rt_env_str(env, SLOT_DOBJSTR, str_dup(pc->dobjstr));
+    set_rt_env_str(env, SLOT_IOBJSTR, str_dup(pc->iobjstr));
+    set_rt_env_str(env, SLOT_ARGSTR, str_dup(pc->argstr));
+    set_rt_env_str(env, SLOT_PREPSTR, str_dup(pc->prepstr));
+    set_rt_env_str(env, SLOT_VERB, str_ref(RUN_ACTIV.verb));
+    set_rt_env_var(env, SLOT_ARGS, parsed_command_args(pc));
 
     return do_task(prog, MAIN_VECTOR, 0, 1/*fg*/, 1/*traceback*/);
 }
@@ -2906,7 +3389,7 @@ setup_activ_for_eval(Program * prog)
     RUN_ACTIV.prog = prog;
 
     RUN_ACTIV.rt_env = env = new_rt_env(prog->num_var_names);
-    fill_in_rt_consts(env, prog->version);
+    fill_in_rt_consts(env, prog->version, prog->builtin_var_refs);
     set_rt_env_obj(env, SLOT_PLAYER, CALLER_ACTIV.player);
     set_rt_env_var(env, SLOT_CALLER, var_ref(CALLER_ACTIV._this));
     set_rt_env_obj(env, SLOT_THIS, NOTHING);
@@ -2931,6 +3414,7 @@ setup_activ_for_eval(Program * prog)
     RUN_ACTIV.pc = 0;
     RUN_ACTIV.error_pc = 0;
     RUN_ACTIV.temp.type = TYPE_NONE;
+    RUN_ACTIV.tail_caller = 0;
 
     return 1;
 }
@@ -3137,7 +3621,7 @@ bf_ticks_left(Var arglist, Byte next, void *vdata, Objid progr)
 {
     Var r;
     r.type = TYPE_INT;
-    r.v.num = ticks_remaining;
+    r.v.num = ticks_remaining + ticks_banked;
     free_var(arglist);
     return make_var_pack(r);
 }
@@ -3324,6 +3808,7 @@ read_activ_as_pi(activation * a)
     dbio_read_string();		/* was prepstr */
     a->verb = dbio_read_string_intern();
     a->verbname = dbio_read_string_intern();
+    a->tail_caller = 0;
     return 1;
 }
 
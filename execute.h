@@ -25,7 +25,7 @@
 #include "program.h"
 #include "structures.h"
 
-typedef struct {
+typedef struct activation {
     Program *prog;
     Var *rt_env;		/* same length as prog.var_names */
     Var *base_rt_stack;
@@ -58,6 +58,14 @@ typedef struct {
     const char *verb;
     const char *verbname;
     int debug;
+
+    /* When a verb is entered by a tail call the activation of the
+     * verb that made the call is reused.  Enough of the replaced
+     * activation to show it in `callers()' and tracebacks is kept
+     * here; it has no runtime environment or stack.  Not saved
+     * with suspended tasks.
+     */
+    struct activation *tail_caller;
 } activation;
 
 extern void free_activation(activation *, char data_too);
@@ -72,6 +80,11 @@ typedef struct {
     /* root_activ_vector == MAIN_VECTOR
        means root activation is main_vector */
     unsigned func_id;
+    int compacted;		/* see compact_vm() */
+    int ticks_left;		/* if the task was preempted (see
+				   preempt_task()), what it had left of
+				   its limits; otherwise zero */
+    long long usecs_left;	/* in microseconds */
 } vmstruct;
 
 typedef vmstruct *vm;
@@ -90,6 +103,10 @@ extern enum error call_verb2(Objid obj, const char *vname,
 
 extern int setup_activ_for_eval(Program * prog);
 
+/* fills in the built-in variables that the running verb doesn't use
+   itself but that a copy of its environment would inherit */
+extern void fill_in_inherited_vars(Var * env);
+
 enum outcome {
     OUTCOME_DONE,		/* Task ran successfully to completion */
     OUTCOME_ABORTED,		/* Task aborted, either by kill_task() or
@@ -115,7 +132,22 @@ extern enum outcome do_server_program_task(Var _this, const char *verb,
 					   int do_db_tracebacks);
 extern enum outcome resume_from_previous_vm(vm the_vm, Var value);
 
+/* Trims the rt_stacks of a suspended task's activations to just the
+ * values on them, to save memory while the task waits.  expand_vm()
+ * gives them back their full size; resume_from_previous_vm() and
+ * free_vm() do that as needed.
+ */
+extern void compact_vm(vm the_vm);
+extern void expand_vm(vm the_vm);
+
 extern int task_timed_out;
+
+/* Takes N ticks from the running task for work a builtin does on its
+ * behalf.  Returns false, leaving the task with no ticks to spare, if it
+ * hasn't that many left; the builtin should then abort it with
+ * make_abort_pack(ABORT_TICKS).
+ */
+extern int charge_ticks(int n);
 extern void abort_running_task(void);
 extern void print_error_backtrace(const char *, void (*)(const char *));
 extern Var caller();
@@ -24,6 +24,7 @@
 #include "list.h"
 #include "log.h"
 #include "map.h"
+#include "query.h"
 #include "server.h"
 #include "storage.h"
 #include "streams.h"
@@ -66,6 +67,7 @@ static registry bi_function_registries[] =
     register_fileio,
     register_system,
     register_exec,
+    register_query,
     register_crypto
 };
 
@@ -208,6 +210,9 @@ call_bi_func(unsigned n, Var arglist, Byte func_pc,
 	int k, max;
 	Var *args = arglist.v.list;
 
+	if (in_parallel_worker && !parallel_safe_function(n))
+	    abandon_parallel_call(f->name);
+
 	/*
 	 * Check permissions, if protected
 	 */
@@ -477,6 +482,8 @@ load_server_options(void)
     SERVER_OPTIONS_CACHED_MISC(_SVO_DO, value);
 
 # undef _SVO_DO
+
+    load_connection_options();
 }
 
 static package
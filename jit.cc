@@ -0,0 +1,929 @@
+/* A baseline translator from MOO bytecodes to x86-64 machine code.
+ *
+ * Each opcode is translated in isolation by stitching together a short,
+ * fixed template of machine instructions.  Nothing is kept in registers
+ * across opcodes except the environment, the top of the runtime stack
+ * and the tick counter, so at any opcode boundary the state of the
+ * activation is exactly what the interpreter would have built, and
+ * control can be handed back to the interpreter simply by telling it
+ * which pc to continue from.
+ *
+ * Only opcodes that work on integers (and on objects and errors, where
+ * they are just copied around) are translated.  Before doing anything
+ * else, each template checks the types of its operands; if they aren't
+ * what the template expects, it "bails" -- returns to the interpreter
+ * without having changed anything, so that the interpreter runs the
+ * opcode for real.  Any opcode without a template is a "side exit" that
+ * works the same way.  Since nothing that could allocate, call out,
+ * raise an error or suspend is ever run natively, all of that still
+ * happens in the interpreter.
+ *
+ * Register use in the generated code:
+ *   rbx  -- the activation's rt_env
+ *   r12  -- the next empty slot on the runtime stack
+ *   r13d -- ticks remaining
+ *   r14  -- the jit_state passed in
+ * rax, rcx and rdx are scratch.
+ */
+
+#include <stddef.h>
+#include <sys/mman.h>
+#include "my-string.h"
+
+#include "config.h"
+#include "execute.h"
+#include "jit.h"
+#include "opcode.h"
+#include "options.h"
+#include "program.h"
+#include "storage.h"
+#include "structures.h"
+
+#ifdef JIT
+
+/* The templates below know how a Var is laid out. */
+typedef char jit_var_layout_check[(sizeof(Var) == 16
+				   && offsetof(Var, type) == 8
+				   && sizeof(var_type) == 4
+				   && sizeof(int32) == 4) ? 1 : -1];
+
+enum jit_exit {
+    JIT_EXIT_LEAVE,		/* left the translated region */
+    JIT_EXIT_BAIL,		/* operands of an unexpected type */
+    JIT_EXIT_TICKS		/* out of ticks or seconds */
+};
+
+struct jit_state {
+    Var *env;
+    Var *rts;
+    int32 ticks;
+    unsigned pc;		/* where the interpreter should continue */
+    int32 exit;			/* an enum jit_exit */
+};
+
+typedef void (*jit_code) (struct jit_state *);
+
+struct JIT_Loop {
+    struct JIT_Loop *next;
+    const Byte *vector;
+    unsigned head;
+    unsigned count;		/* times reached before translation */
+    unsigned runs, bails;
+    void *code;
+    size_t code_size;
+    char failed;		/* not worth translating */
+};
+
+/**** emitting machine code ****/
+
+enum reg {
+    RAX = 0, RCX = 1, RDX = 2, RBX = 3,
+    R12 = 12, R13 = 13, R14 = 14
+};
+
+enum cond {
+    CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7,
+    CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF
+};
+
+typedef struct {
+    unsigned at;		/* offset of a rel32 to fill in */
+    unsigned pc;		/* bytecode pc it should lead to */
+    int reason;			/* exit reason if pc isn't translated */
+} Fixup;
+
+typedef struct {
+    unsigned pc;
+    int reason;
+    unsigned offset;
+} Stub;
+
+typedef struct {
+    Byte *buf;
+    unsigned len, max;
+    Fixup *fixups;
+    unsigned num_fixups, max_fixups;
+} Emitter;
+
+static void
+emit_byte(Emitter * e, int b)
+{
+    if (e->len == e->max) {
+	e->max *= 2;
+	e->buf = (Byte *) myrealloc(e->buf, e->max, M_CODE_GEN);
+    }
+    e->buf[e->len++] = b;
+}
+
+static void
+emit_bytes(Emitter * e, const char *bytes, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+	emit_byte(e, (Byte) bytes[i]);
+}
+
+static void
+emit_int32(Emitter * e, int32 v)
+{
+    unsigned u = (unsigned) v;
+
+    emit_byte(e, u & 0xFF);
+    emit_byte(e, (u >> 8) & 0xFF);
+    emit_byte(e, (u >> 16) & 0xFF);
+    emit_byte(e, (u >> 24) & 0xFF);
+}
+
+static void
+patch_int32(Emitter * e, unsigned at, int32 v)
+{
+    unsigned u = (unsigned) v;
+
+    e->buf[at] = u & 0xFF;
+    e->buf[at + 1] = (u >> 8) & 0xFF;
+    e->buf[at + 2] = (u >> 16) & 0xFF;
+    e->buf[at + 3] = (u >> 24) & 0xFF;
+}
+
+/* Emits the opcode OPC (preceded by REX.W if W) with a ModRM byte
+ * addressing [BASE + DISP]; REG goes in the reg field, and is either a
+ * register or an opcode extension.
+ */
+static void
+emit_mem(Emitter * e, int w, const char *opc, int nopc,
+	 int reg, int base, int32 disp)
+{
+    int rex = 0x40 | (w << 3) | ((reg & 8) >> 1) | ((base & 8) >> 3);
+    int mod = (disp >= -128 && disp <= 127) ? 1 : 2;
+
+    if (rex != 0x40)
+	emit_byte(e, rex);
+    emit_bytes(e, opc, nopc);
+    emit_byte(e, (mod << 6) | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == 4)
+	emit_byte(e, 0x24);	/* SIB: no index */
+    if (mod == 1)
+	emit_byte(e, disp & 0xFF);
+    else
+	emit_int32(e, disp);
+}
+
+#define LOAD32(r, b, d)		emit_mem(e, 0, "\x8B", 1, r, b, d)
+#define STORE32(r, b, d)	emit_mem(e, 0, "\x89", 1, r, b, d)
+#define LOAD64(r, b, d)		emit_mem(e, 1, "\x8B", 1, r, b, d)
+#define STORE64(r, b, d)	emit_mem(e, 1, "\x89", 1, r, b, d)
+
+static void
+emit_store_imm(Emitter * e, int base, int32 disp, int32 imm)
+{
+    emit_mem(e, 0, "\xC7", 1, 0, base, disp);
+    emit_int32(e, imm);
+}
+
+static void
+emit_cmp_imm(Emitter * e, int base, int32 disp, int32 imm)
+{
+    if (imm >= -128 && imm <= 127) {
+	emit_mem(e, 0, "\x83", 1, 7, base, disp);
+	emit_byte(e, imm & 0xFF);
+    } else {
+	emit_mem(e, 0, "\x81", 1, 7, base, disp);
+	emit_int32(e, imm);
+    }
+}
+
+static void
+emit_test_imm(Emitter * e, int base, int32 disp, int32 imm)
+{
+    emit_mem(e, 0, "\xF7", 1, 0, base, disp);
+    emit_int32(e, imm);
+}
+
+static void
+emit_copy(Emitter * e, int to_base, int32 to_disp,
+	  int from_base, int32 from_disp)
+{
+    LOAD64(RAX, from_base, from_disp);
+    LOAD64(RCX, from_base, from_disp + 8);
+    STORE64(RAX, to_base, to_disp);
+    STORE64(RCX, to_base, to_disp + 8);
+}
+
+/* Emits a conditional (or, if CC < 0, unconditional) jump with a zero
+ * displacement, and returns the offset of the displacement.
+ */
+static unsigned
+emit_jump(Emitter * e, int cc)
+{
+    if (cc < 0)
+	emit_byte(e, 0xE9);
+    else {
+	emit_byte(e, 0x0F);
+	emit_byte(e, 0x80 + cc);
+    }
+    emit_int32(e, 0);
+    return e->len - 4;
+}
+
+static void
+patch_jump(Emitter * e, unsigned at, unsigned target)
+{
+    patch_int32(e, at, (int32) target - (int32) (at + 4));
+}
+
+static void
+emit_jump_to_pc(Emitter * e, int cc, unsigned pc, int reason)
+{
+    Fixup *f;
+
+    if (e->num_fixups == e->max_fixups) {
+	e->max_fixups *= 2;
+	e->fixups = (Fixup *) myrealloc(e->fixups,
+					e->max_fixups * sizeof(Fixup),
+					M_CODE_GEN);
+    }
+    f = &e->fixups[e->num_fixups++];
+    f->at = emit_jump(e, cc);
+    f->pc = pc;
+    f->reason = reason;
+}
+
+#define ADD_RTS(n)	emit_bytes(e, "\x49\x83\xC4", 3), emit_byte(e, n)
+#define SUB_RTS(n)	emit_bytes(e, "\x49\x83\xEC", 3), emit_byte(e, n)
+#define DEC_TICKS()	emit_bytes(e, "\x41\xFF\xCD", 3)
+
+/* Offsets of the top two values on the stack, relative to r12. */
+#define TOP	(-16)
+#define NEXT	(-32)
+#define TYPE	8
+#define ENV(id)	((int32) (id) * (int32) sizeof(Var))
+
+/**** templates ****/
+
+static void
+check_ticks(Emitter * e, unsigned pc)
+{
+    /* The interpreter aborts the task if this opcode would use up the
+     * last tick; let it do so.
+     */
+    emit_bytes(e, "\x41\x83\xFD\x01", 4);	/* cmp r13d, 1 */
+    emit_jump_to_pc(e, CC_LE, pc, JIT_EXIT_TICKS);
+}
+
+static void
+check_timeout(Emitter * e, unsigned pc)
+{
+    unsigned long p = (unsigned long) &task_timed_out;
+    int i;
+
+    emit_bytes(e, "\x48\xB8", 2);	/* mov rax, imm64 */
+    for (i = 0; i < 8; i++)
+	emit_byte(e, (p >> (8 * i)) & 0xFF);
+    emit_bytes(e, "\x83\x38\x00", 3);	/* cmp dword [rax], 0 */
+    emit_jump_to_pc(e, CC_NE, pc, JIT_EXIT_TICKS);
+}
+
+static void
+guard_type(Emitter * e, unsigned pc, int base, int32 disp, var_type type)
+{
+    emit_cmp_imm(e, base, disp + TYPE, type);
+    emit_jump_to_pc(e, CC_NE, pc, JIT_EXIT_BAIL);
+}
+
+static void
+guard_not_type(Emitter * e, unsigned pc, int base, int32 disp, var_type type)
+{
+    emit_cmp_imm(e, base, disp + TYPE, type);
+    emit_jump_to_pc(e, CC_E, pc, JIT_EXIT_BAIL);
+}
+
+/* free_var() is a no-op on the value at [BASE + DISP] */
+static void
+guard_simple(Emitter * e, unsigned pc, int base, int32 disp)
+{
+    emit_test_imm(e, base, disp + TYPE, TYPE_COMPLEX_FLAG);
+    emit_jump_to_pc(e, CC_NE, pc, JIT_EXIT_BAIL);
+}
+
+/* the value at [BASE + DISP] is an integer, object or error */
+static void
+guard_scalar(Emitter * e, unsigned pc, int base, int32 disp)
+{
+    emit_cmp_imm(e, base, disp + TYPE, TYPE_ERR);
+    emit_jump_to_pc(e, CC_A, pc, JIT_EXIT_BAIL);
+}
+
+static void
+guard_ints(Emitter * e, unsigned pc, int n)
+{
+    guard_type(e, pc, R12, TOP, TYPE_INT);
+    if (n > 1)
+	guard_type(e, pc, R12, NEXT, TYPE_INT);
+}
+
+static void
+push_constant(Emitter * e, var_type type, int32 num)
+{
+    emit_store_imm(e, R12, 0, num);
+    emit_store_imm(e, R12, TYPE, type);
+    ADD_RTS(sizeof(Var));
+}
+
+/* Pops the condition from the stack and jumps to LAB if it's false. */
+static void
+test_and_branch(Emitter * e, unsigned lab)
+{
+    LOAD32(RAX, R12, TOP);
+    SUB_RTS(sizeof(Var));
+    emit_bytes(e, "\x85\xC0", 2);	/* test eax, eax */
+    emit_jump_to_pc(e, CC_E, lab, JIT_EXIT_LEAVE);
+}
+
+/* Replaces the top two integers on the stack with the integer result of
+ * applying OPC (an `op r32, r/m32' opcode) to them.
+ */
+static void
+binary_op(Emitter * e, const char *opc, int nopc)
+{
+    LOAD32(RAX, R12, NEXT);
+    emit_mem(e, 0, opc, nopc, RAX, R12, TOP);
+    STORE32(RAX, R12, NEXT);
+    SUB_RTS(sizeof(Var));
+}
+
+static void
+compare_op(Emitter * e, int cc)
+{
+    LOAD32(RAX, R12, NEXT);
+    emit_mem(e, 0, "\x3B", 1, RAX, R12, TOP);	/* cmp eax, [top] */
+    emit_byte(e, 0x0F);
+    emit_byte(e, 0x90 + cc);
+    emit_byte(e, 0xC0);		/* setcc al */
+    emit_bytes(e, "\x0F\xB6\xC0", 3);	/* movzx eax, al */
+    STORE32(RAX, R12, NEXT);
+    SUB_RTS(sizeof(Var));
+}
+
+static unsigned
+read_operand(const Byte * v, unsigned *pc, int nb)
+{
+    unsigned n = 0;
+
+    while (nb--)
+	n = (n << 8) + v[(*pc)++];
+    return n;
+}
+
+/* Returns the pc of the opcode after the one at PC, or 0 if we don't
+ * know how long the opcode at PC is.
+ */
+static unsigned
+skip_opcode(const Bytecodes * bc, unsigned pc)
+{
+    const Byte *v = bc->vector;
+    unsigned op = v[pc++];
+
+    if (IS_PUSH_n(op) || IS_PUT_n(op) || IS_OPTIM_NUM_OPCODE(op))
+	return pc;
+#ifdef BYTECODE_REDUCE_REF
+    if (IS_PUSH_CLEAR_n(op))
+	return pc;
+#endif
+
+    switch (op) {
+    case OP_IF:
+    case OP_WHILE:
+    case OP_EIF:
+    case OP_IF_QUES:
+    case OP_AND:
+    case OP_OR:
+    case OP_JUMP:
+	return pc + bc->numbytes_label;
+    case OP_FORK:
+	return pc + bc->numbytes_fork;
+    case OP_FORK_WITH_ID:
+	return pc + bc->numbytes_fork + bc->numbytes_var_name;
+    case OP_FOR_LIST:
+    case OP_FOR_RANGE:
+	return pc + bc->numbytes_var_name + bc->numbytes_label;
+    case OP_G_PUSH:
+#ifdef BYTECODE_REDUCE_REF
+    case OP_G_PUSH_CLEAR:
+#endif
+    case OP_G_PUT:
+	return pc + bc->numbytes_var_name;
+    case OP_IMM:
+	return pc + bc->numbytes_literal;
+    case OP_BI_FUNC_CALL:
+	return pc + 1;
+    case OP_EXTENDED:
+	switch (v[pc++]) {
+	case EOP_WHILE_ID:
+	case EOP_FOR_LIST_1:
+	    return pc + bc->numbytes_var_name + bc->numbytes_label;
+	case EOP_FOR_LIST_2:
+	    return pc + 2 * bc->numbytes_var_name + bc->numbytes_label;
+	case EOP_EXIT_ID:
+	    pc += bc->numbytes_var_name;
+	    /* fall thru */
+	case EOP_EXIT:
+	    return pc + bc->numbytes_stack + bc->numbytes_label;
+	case EOP_PUSH_LABEL:
+	case EOP_END_CATCH:
+	case EOP_END_EXCEPT:
+	case EOP_TRY_FINALLY:
+	    return pc + bc->numbytes_label;
+	case EOP_TRY_EXCEPT:
+	    return pc + 1;
+	case EOP_FIRST:
+	case EOP_LAST:
+	    return pc + bc->numbytes_stack;
+	case EOP_RANGESET:
+	case EOP_END_FINALLY:
+	case EOP_CONTINUE:
+	case EOP_EXP:
+	case EOP_BITOR:
+	case EOP_BITAND:
+	case EOP_BITXOR:
+	case EOP_BITSHL:
+	case EOP_BITSHR:
+	case EOP_COMPLEMENT:
+	    return pc;
+	default:		/* EOP_SCATTER, mostly */
+	    return 0;
+	}
+    default:
+	return pc;
+    }
+}
+
+/* Emits the template for the opcode at PC and returns the pc of the
+ * following opcode, or 0 if there is no template for it.
+ */
+static unsigned
+translate_opcode(Emitter * e, const Program * prog, const Bytecodes * bc,
+		 unsigned pc)
+{
+    const Byte *v = bc->vector;
+    unsigned op = v[pc];
+    unsigned next = pc + 1;
+    unsigned id, lab;
+
+#ifdef BYTECODE_INT_OPS
+    /* integer opcodes are translated as the sequences they stand for */
+    if (IS_INT_OP(op))
+	op = INT_OP_TO_GENERIC(op, v + next);
+#endif
+
+    if (IS_OPTIM_NUM_OPCODE(op)) {
+	push_constant(e, TYPE_INT, OPCODE_TO_OPTIM_NUM(op));
+	return next;
+    }
+    if (IS_PUSH_n(op) || op == OP_G_PUSH) {
+	id = (op == OP_G_PUSH ? read_operand(v, &next, bc->numbytes_var_name)
+	      : PUSH_n_INDEX(op));
+	guard_not_type(e, pc, RBX, ENV(id), TYPE_NONE);
+	guard_simple(e, pc, RBX, ENV(id));
+	emit_copy(e, R12, 0, RBX, ENV(id));
+	ADD_RTS(sizeof(Var));
+	return next;
+    }
+#ifdef BYTECODE_REDUCE_REF
+    if (IS_PUSH_CLEAR_n(op) || op == OP_G_PUSH_CLEAR) {
+	id = (op == OP_G_PUSH_CLEAR
+	      ? read_operand(v, &next, bc->numbytes_var_name)
+	      : PUSH_CLEAR_n_INDEX(op));
+	guard_not_type(e, pc, RBX, ENV(id), TYPE_NONE);
+	emit_copy(e, R12, 0, RBX, ENV(id));
+	emit_store_imm(e, RBX, ENV(id) + TYPE, TYPE_NONE);
+	ADD_RTS(sizeof(Var));
+	return next;
+    }
+#endif
+    if (IS_PUT_n(op) || op == OP_G_PUT) {
+	int pop;
+
+	id = (op == OP_G_PUT ? read_operand(v, &next, bc->numbytes_var_name)
+	      : PUT_n_INDEX(op));
+	/* like the interpreter, do a following OP_POP at the same time */
+	pop = (v[next] == OP_POP);
+	check_ticks(e, pc);
+	guard_simple(e, pc, RBX, ENV(id));
+	if (!pop)
+	    guard_simple(e, pc, R12, TOP);
+	DEC_TICKS();
+	emit_copy(e, RBX, ENV(id), R12, TOP);
+	if (pop) {
+	    SUB_RTS(sizeof(Var));
+	    next++;
+	}
+	return next;
+    }
+
+    switch (op) {
+    case OP_IMM:
+	{
+	    Var lit;
+
+	    id = read_operand(v, &next, bc->numbytes_literal);
+	    lit = prog->literals[id];
+	    /* like the interpreter, skip an OP_IMM that's immediately popped */
+	    if (v[next] == OP_POP)
+		return next + 1;
+	    if (lit.type != TYPE_INT && lit.type != TYPE_OBJ
+		&& lit.type != TYPE_ERR)
+		return 0;
+	    push_constant(e, lit.type, lit.v.num);
+	}
+	return next;
+
+    case OP_POP:
+	guard_simple(e, pc, R12, TOP);
+	SUB_RTS(sizeof(Var));
+	return next;
+
+    case OP_JUMP:
+	lab = read_operand(v, &next, bc->numbytes_label);
+	if (lab <= pc)
+	    check_timeout(e, lab);
+	emit_jump_to_pc(e, -1, lab, JIT_EXIT_LEAVE);
+	return next;
+
+    case OP_IF:
+    case OP_WHILE:
+    case OP_EIF:
+    case OP_IF_QUES:
+	lab = read_operand(v, &next, bc->numbytes_label);
+	if (lab <= pc)
+	    return 0;
+	check_ticks(e, pc);
+	guard_ints(e, pc, 1);
+	DEC_TICKS();
+	test_and_branch(e, lab);
+	return next;
+
+    case OP_AND:
+    case OP_OR:
+	lab = read_operand(v, &next, bc->numbytes_label);
+	if (lab <= pc)
+	    return 0;
+	check_ticks(e, pc);
+	guard_ints(e, pc, 1);
+	DEC_TICKS();
+	/* short-circuit, leaving the value on the stack */
+	emit_cmp_imm(e, R12, TOP, 0);
+	emit_jump_to_pc(e, op == OP_AND ? CC_E : CC_NE, lab, JIT_EXIT_LEAVE);
+	SUB_RTS(sizeof(Var));
+	return next;
+
+    case OP_FOR_RANGE:
+	{
+	    unsigned body;
+
+	    id = read_operand(v, &next, bc->numbytes_var_name);
+	    lab = read_operand(v, &next, bc->numbytes_label);
+	    if (lab <= pc)
+		return 0;
+	    check_ticks(e, pc);
+	    guard_ints(e, pc, 2);
+	    guard_simple(e, pc, RBX, ENV(id));
+	    /* let the interpreter deal with running up against MAXINT */
+	    emit_cmp_imm(e, R12, NEXT, MAXINT);
+	    emit_jump_to_pc(e, CC_E, pc, JIT_EXIT_BAIL);
+	    DEC_TICKS();
+	    LOAD32(RAX, R12, NEXT);
+	    emit_mem(e, 0, "\x3B", 1, RAX, R12, TOP);	/* cmp eax, [top] */
+	    body = emit_jump(e, CC_LE);
+	    SUB_RTS(2 * sizeof(Var));
+	    emit_jump_to_pc(e, -1, lab, JIT_EXIT_LEAVE);
+	    patch_jump(e, body, e->len);
+	    STORE32(RAX, RBX, ENV(id));
+	    emit_store_imm(e, RBX, ENV(id) + TYPE, TYPE_INT);
+	    emit_bytes(e, "\x83\xC0\x01", 3);	/* add eax, 1 */
+	    STORE32(RAX, R12, NEXT);
+	}
+	return next;
+
+    case OP_ADD:
+    case OP_MINUS:
+    case OP_MULT:
+	check_ticks(e, pc);
+	guard_ints(e, pc, 2);
+	DEC_TICKS();
+	if (op == OP_ADD)
+	    binary_op(e, "\x03", 1);
+	else if (op == OP_MINUS)
+	    binary_op(e, "\x2B", 1);
+	else
+	    binary_op(e, "\x0F\xAF", 2);
+	return next;
+
+    case OP_DIV:
+    case OP_MOD:
+	check_ticks(e, pc);
+	guard_ints(e, pc, 2);
+	/* E_DIV and MININT / -1 are the interpreter's problem */
+	emit_cmp_imm(e, R12, TOP, 0);
+	emit_jump_to_pc(e, CC_E, pc, JIT_EXIT_BAIL);
+	emit_cmp_imm(e, R12, TOP, -1);
+	emit_jump_to_pc(e, CC_E, pc, JIT_EXIT_BAIL);
+	DEC_TICKS();
+	LOAD32(RCX, R12, TOP);
+	LOAD32(RAX, R12, NEXT);
+	emit_bytes(e, "\x99\xF7\xF9", 3);	/* cdq; idiv ecx */
+	STORE32(op == OP_DIV ? RAX : RDX, R12, NEXT);
+	SUB_RTS(sizeof(Var));
+	return next;
+
+    case OP_LT:
+    case OP_LE:
+    case OP_GT:
+    case OP_GE:
+	check_ticks(e, pc);
+	guard_ints(e, pc, 2);
+	DEC_TICKS();
+	compare_op(e, (op == OP_LT ? CC_L : op == OP_LE ? CC_LE
+		       : op == OP_GT ? CC_G : CC_GE));
+	return next;
+
+    case OP_EQ:
+    case OP_NE:
+	check_ticks(e, pc);
+	guard_scalar(e, pc, R12, TOP);
+	guard_scalar(e, pc, R12, NEXT);
+	DEC_TICKS();
+	LOAD32(RAX, R12, NEXT);
+	emit_mem(e, 0, "\x3B", 1, RAX, R12, TOP);	/* cmp eax, [top] */
+	emit_bytes(e, "\x0F\x94\xC0", 3);	/* sete al */
+	LOAD32(RCX, R12, NEXT + TYPE);
+	emit_mem(e, 0, "\x3B", 1, RCX, R12, TOP + TYPE);	/* cmp ecx, [top] */
+	emit_bytes(e, "\x0F\x94\xC1", 3);	/* sete cl */
+	emit_bytes(e, "\x20\xC8", 2);	/* and al, cl */
+	if (op == OP_NE)
+	    emit_bytes(e, "\x34\x01", 2);	/* xor al, 1 */
+	emit_bytes(e, "\x0F\xB6\xC0", 3);	/* movzx eax, al */
+	STORE32(RAX, R12, NEXT);
+	emit_store_imm(e, R12, NEXT + TYPE, TYPE_INT);
+	SUB_RTS(sizeof(Var));
+	return next;
+
+    case OP_UNARY_MINUS:
+	check_ticks(e, pc);
+	guard_ints(e, pc, 1);
+	DEC_TICKS();
+	emit_mem(e, 0, "\xF7", 1, 3, R12, TOP);	/* neg dword [top] */
+	return next;
+
+    case OP_NOT:
+	check_ticks(e, pc);
+	guard_ints(e, pc, 1);
+	DEC_TICKS();
+	emit_cmp_imm(e, R12, TOP, 0);
+	emit_bytes(e, "\x0F\x94\xC0", 3);	/* sete al */
+	emit_bytes(e, "\x0F\xB6\xC0", 3);	/* movzx eax, al */
+	STORE32(RAX, R12, TOP);
+	return next;
+
+    case OP_EXTENDED:
+	next++;
+	/* extended opcodes use up their tick without checking */
+	switch (v[pc + 1]) {
+	case EOP_WHILE_ID:
+	    id = read_operand(v, &next, bc->numbytes_var_name);
+	    lab = read_operand(v, &next, bc->numbytes_label);
+	    if (lab <= pc)
+		return 0;
+	    guard_ints(e, pc, 1);
+	    guard_simple(e, pc, RBX, ENV(id));
+	    DEC_TICKS();
+	    emit_copy(e, RBX, ENV(id), R12, TOP);
+	    test_and_branch(e, lab);
+	    return next;
+
+	case EOP_BITOR:
+	case EOP_BITAND:
+	case EOP_BITXOR:
+	    guard_ints(e, pc, 2);
+	    DEC_TICKS();
+	    binary_op(e, (v[pc + 1] == EOP_BITOR ? "\x0B"
+			  : v[pc + 1] == EOP_BITAND ? "\x23" : "\x33"), 1);
+	    return next;
+
+	case EOP_COMPLEMENT:
+	    guard_ints(e, pc, 1);
+	    DEC_TICKS();
+	    emit_mem(e, 0, "\xF7", 1, 2, R12, TOP);	/* not dword [top] */
+	    return next;
+
+	default:
+	    return 0;
+	}
+
+    default:
+	return 0;
+    }
+}
+
+/* Translates the loop from HEAD through the backward jump at BACK.
+ * Returns true if there's anything worth running.
+ */
+static int
+translate_loop(struct JIT_Loop *loop, const Program * prog,
+	       const Bytecodes * bc, unsigned head, unsigned back)
+{
+    Emitter em, *e = &em;
+    unsigned n = back - head + 1;
+    int *offsets = (int *) mymalloc(n * sizeof(int), M_CODE_GEN);
+    Stub *stubs;
+    unsigned num_stubs = 0, epilogue, pc, next, i, j;
+    size_t size;
+    void *code;
+
+    e->len = 0;
+    e->max = 1024;
+    e->buf = (Byte *) mymalloc(e->max, M_CODE_GEN);
+    e->num_fixups = 0;
+    e->max_fixups = 64;
+    e->fixups = (Fixup *) mymalloc(e->max_fixups * sizeof(Fixup),
+				   M_CODE_GEN);
+    for (i = 0; i < n; i++)
+	offsets[i] = -1;
+
+    emit_bytes(e, "\x53\x41\x54\x41\x55\x41\x56", 7);	/* push rbx .. r14 */
+    emit_bytes(e, "\x49\x89\xFE", 3);	/* mov r14, rdi */
+    LOAD64(RBX, R14, offsetof(struct jit_state, env));
+    LOAD64(R12, R14, offsetof(struct jit_state, rts));
+    LOAD32(R13, R14, offsetof(struct jit_state, ticks));
+
+    for (pc = head; pc <= back; pc = next) {
+	unsigned len = e->len, nfix = e->num_fixups;
+
+	offsets[pc - head] = len;
+	next = translate_opcode(e, prog, bc, pc);
+	if (!next) {
+	    /* side exit */
+	    e->len = len;
+	    e->num_fixups = nfix;
+	    offsets[pc - head] = -1;
+	    if (pc == head)
+		break;
+	    emit_jump_to_pc(e, -1, pc, JIT_EXIT_LEAVE);
+	    next = skip_opcode(bc, pc);
+	    if (!next)
+		break;
+	}
+    }
+    if (pc > back)
+	emit_jump_to_pc(e, -1, pc, JIT_EXIT_LEAVE);
+
+    epilogue = e->len;
+    STORE64(R12, R14, offsetof(struct jit_state, rts));
+    STORE32(R13, R14, offsetof(struct jit_state, ticks));
+    emit_bytes(e, "\x41\x5E\x41\x5D\x41\x5C\x5B\xC3", 8);	/* pop; ret */
+
+    stubs = (Stub *) mymalloc((e->num_fixups + 1) * sizeof(Stub),
+			      M_CODE_GEN);
+    for (i = 0; i < e->num_fixups; i++) {
+	Fixup *f = &e->fixups[i];
+
+	if (f->reason == JIT_EXIT_LEAVE && f->pc >= head && f->pc <= back
+	    && offsets[f->pc - head] >= 0) {
+	    patch_jump(e, f->at, offsets[f->pc - head]);
+	    continue;
+	}
+	for (j = 0; j < num_stubs; j++)
+	    if (stubs[j].pc == f->pc && stubs[j].reason == f->reason)
+		break;
+	if (j == num_stubs) {
+	    stubs[j].pc = f->pc;
+	    stubs[j].reason = f->reason;
+	    stubs[j].offset = e->len;
+	    num_stubs++;
+	    emit_store_imm(e, R14, offsetof(struct jit_state, pc), f->pc);
+	    emit_store_imm(e, R14, offsetof(struct jit_state, exit),
+			   f->reason);
+	    patch_jump(e, emit_jump(e, -1), epilogue);
+	}
+	patch_jump(e, f->at, stubs[j].offset);
+    }
+
+    code = 0;
+    size = 0;
+    if (offsets[0] >= 0) {
+	size = e->len;
+	code = mmap(0, size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED)
+	    code = 0;
+	else {
+	    memcpy(code, e->buf, size);
+	    if (mprotect(code, size, PROT_READ | PROT_EXEC) < 0) {
+		munmap(code, size);
+		code = 0;
+	    }
+	}
+    }
+
+    myfree(stubs, M_CODE_GEN);
+    myfree(e->fixups, M_CODE_GEN);
+    myfree(e->buf, M_CODE_GEN);
+    myfree(offsets, M_CODE_GEN);
+
+    loop->code = code;
+    loop->code_size = size;
+    return code != 0;
+}
+
+/**** running translated code ****/
+
+static void
+discard_code(struct JIT_Loop *loop)
+{
+    if (loop->code)
+	munmap(loop->code, loop->code_size);
+    loop->code = 0;
+    loop->failed = 1;
+}
+
+unsigned
+jit_run_loop(Program * prog, const Bytecodes * bc, unsigned head,
+	     unsigned back, Var * env, Var ** rts, int *ticks)
+{
+    struct JIT_Loop *loop;
+    struct jit_state state;
+
+    for (loop = prog->jit_loops; loop; loop = loop->next)
+	if (loop->head == head && loop->vector == bc->vector)
+	    break;
+
+    if (!loop) {
+	loop = (struct JIT_Loop *) mymalloc(sizeof(struct JIT_Loop), M_STRUCT);
+	loop->vector = bc->vector;
+	loop->head = head;
+	loop->count = loop->runs = loop->bails = 0;
+	loop->code = 0;
+	loop->code_size = 0;
+	loop->failed = 0;
+	loop->next = prog->jit_loops;
+	prog->jit_loops = loop;
+    }
+
+    if (loop->failed)
+	return head;
+    if (!loop->code) {
+	if (++loop->count < JIT_THRESHOLD)
+	    return head;
+	if (!translate_loop(loop, prog, bc, head, back)) {
+	    loop->failed = 1;
+	    return head;
+	}
+    }
+
+    state.env = env;
+    state.rts = *rts;
+    state.ticks = *ticks;
+    ((jit_code) loop->code) (&state);
+    *rts = state.rts;
+    *ticks = state.ticks;
+
+    /* If the loop's values usually aren't what the templates expect,
+     * stop bothering with the translation.
+     */
+    loop->runs++;
+    if (state.exit == JIT_EXIT_BAIL
+	&& ++loop->bails > JIT_THRESHOLD && loop->bails * 2 > loop->runs)
+	discard_code(loop);
+
+    return state.pc;
+}
+
+void
+jit_free_program(Program * prog)
+{
+    struct JIT_Loop *loop, *next;
+
+    for (loop = prog->jit_loops; loop; loop = next) {
+	next = loop->next;
+	if (loop->code)
+	    munmap(loop->code, loop->code_size);
+	myfree(loop, M_STRUCT);
+    }
+    prog->jit_loops = 0;
+}
+
+#else				/* !JIT */
+
+unsigned
+jit_run_loop(Program * prog, const Bytecodes * bc, unsigned head,
+	     unsigned back, Var * env, Var ** rts, int *ticks)
+{
+    return head;
+}
+
+void
+jit_free_program(Program * prog)
+{
+}
+
+#endif				/* JIT */
@@ -0,0 +1,30 @@
+/* A translator from MOO bytecodes to x86-64 machine code.
+ *
+ * The interpreter offers each loop to the translator as it jumps back
+ * to the top of the loop.  Once a loop has come around often enough,
+ * its bytecodes are translated into native code, which runs until it
+ * reaches an opcode it doesn't handle, a value of an unexpected type,
+ * or the end of the task's ticks -- at which point the interpreter
+ * picks up again from the same pc.  See jit.cc and options.h.
+ */
+
+#ifndef JIT_H
+#define JIT_H 1
+
+#include "program.h"
+#include "structures.h"
+
+/* Runs the loop beginning at HEAD in BC (a vector of PROG), whose
+ * backward jump is at BACK, against the environment ENV and the stack
+ * *RTS.  Returns the pc at which the interpreter should continue, which
+ * is HEAD itself if nothing was run.  *RTS and *TICKS are updated to
+ * reflect the work done.
+ */
+extern unsigned jit_run_loop(Program *prog, const Bytecodes *bc,
+			     unsigned head, unsigned back,
+			     Var *env, Var **rts, int *ticks);
+
+/* Frees any translations hanging off of PROG. */
+extern void jit_free_program(Program *prog);
+
+#endif				/* !JIT_H */
@@ -212,6 +212,45 @@ rbdelete(rbtree *tree)
 #endif
 }
 
+/*
+ * Released traversal objects are kept on a short free list.  Every
+ * `for' loop over a map allocates one, and they are large enough
+ * (the traversal path is fixed size) that recycling them is
+ * noticeably cheaper than going back to the allocator.
+ */
+#define TRAV_CACHE_SIZE 16
+
+static rbtrav *trav_cache[TRAV_CACHE_SIZE];
+static int trav_cache_count = 0;
+
+/*
+ * Creates a new traversal object.  The traversal object is not
+ * initialized until `rbtfirst' or `rbtlast' are called.  The
+ * pointer must be released with `rbtdelete'.
+ */
+static rbtrav *
+rbtnew(void)
+{
+    if (trav_cache_count > 0) {
+	rbtrav *trav = trav_cache[--trav_cache_count];
+	addref(trav);		/* released at a count of zero */
+	return trav;
+    }
+    return (rbtrav *)mymalloc(sizeof(rbtrav), M_TRAV);
+}
+
+/*
+ * Releases a traversal object.
+ */
+static void
+rbtdelete(rbtrav *trav)
+{
+    if (trav_cache_count < TRAV_CACHE_SIZE)
+	trav_cache[trav_cache_count++] = trav;
+    else
+	myfree(trav, M_TRAV);
+}
+
 /*
  * Searches for a copy of the specified node data in a red black tree.
  * Returns a pointer to the data value stored in the tree, or a null
@@ -247,7 +286,7 @@ rbfind(rbtree *tree, rbnode *node, int case_matters)
 static rbtrav *
 rbseek(rbtree *tree, rbnode *node, int case_matters)
 {
-    rbtrav *trav = (rbtrav *)mymalloc(sizeof(rbtrav), M_TRAV);
+    rbtrav *trav = rbtnew();
 
     trav->tree = tree;
     trav->it = tree->root;
@@ -454,25 +493,6 @@ rberase(rbtree *tree, rbnode *node)
     return ret;
 }
 
-/*
- * Creates a new traversal object.  The traversal object is not
- * initialized until `rbtfirst' or `rbtlast' are called.  The
- * pointer must be released with `rbtdelete'.
- */
-static rbtrav *
-rbtnew(void)
-{
-    return (rbtrav *)mymalloc(sizeof(rbtrav), M_TRAV);
-}
-
-/*
- * Releases a traversal object.
- */
-static void
-rbtdelete(rbtrav *trav)
-{
-    myfree(trav, M_TRAV);
-}
 
 /*
  * Initializes a traversal object. The user-specified direction
@@ -47,35 +47,146 @@ struct match_data {
     Objid exact, partial;
 };
 
+/* Returns true if `name' (for `oid') makes an ambiguous exact match. */
+static int
+match_name(struct match_data *d, const char *name, Objid oid)
+{
+    if (!mystrncasecmp(name, d->name, d->lname)) {
+	if (name[d->lname] == '\0') {	/* exact match */
+	    if (d->exact == NOTHING || d->exact == oid)
+		d->exact = oid;
+	    else
+		return 1;
+	} else {		/* partial match */
+	    if (d->partial == FAILED_MATCH || d->partial == oid)
+		d->partial = oid;
+	    else
+		d->partial = AMBIGUOUS;
+	}
+    }
+
+    return 0;
+}
+
 static int
 match_proc(void *data, Objid oid)
 {
     struct match_data *d = (struct match_data *)data;
     Var *names = aliases(oid);
     int i;
+
+    if (match_name(d, db_object_name(oid), oid))
+	return 1;
+
+    for (i = 1; i <= names[0].v.num; i++)
+	if (names[i].type == TYPE_STR && match_name(d, names[i].v.str, oid))
+	    return 1;
+
+    return 0;
+}
+
+/*
+ * Places with many objects in them get a sorted index of the names and
+ * aliases of their contents, so that a match only looks at the names
+ * that begin with what was typed.  An index is good until the contents
+ * stamp of its place changes.
+ */
+
+#define MATCH_INDEX_THRESHOLD	16	/* contents needed to get an index */
+#define MATCH_CACHE_SIZE	256	/* places indexed at once */
+
+struct match_key {
     const char *name;
+    Objid oid;
+};
 
-    for (i = 0; i <= names[0].v.num; i++) {
-	if (i == 0)
-	    name = db_object_name(oid);
-	else if (names[i].type != TYPE_STR)
-	    continue;
+struct match_index {
+    Objid where;
+    unsigned stamp;
+    int count, max;
+    struct match_key *keys;
+};
+
+static struct match_index match_cache[MATCH_CACHE_SIZE];
+
+static void
+add_key(struct match_index *ix, const char *name, Objid oid)
+{
+    if (ix->count == ix->max) {
+	ix->max = ix->max ? ix->max * 2 : 64;
+	ix->keys = (struct match_key *)
+	    myrealloc(ix->keys, ix->max * sizeof(struct match_key), M_ARRAY);
+    }
+    ix->keys[ix->count].name = str_ref(name);
+    ix->keys[ix->count++].oid = oid;
+}
+
+static int
+index_proc(void *data, Objid oid)
+{
+    struct match_index *ix = (struct match_index *)data;
+    Var *names = aliases(oid);
+    int i;
+
+    add_key(ix, db_object_name(oid), oid);
+    for (i = 1; i <= names[0].v.num; i++)
+	if (names[i].type == TYPE_STR)
+	    add_key(ix, names[i].v.str, oid);
+
+    return 0;
+}
+
+static int
+compare_keys(const void *a, const void *b)
+{
+    return mystrcasecmp(((const struct match_key *)a)->name,
+			((const struct match_key *)b)->name);
+}
+
+static struct match_index *
+find_index(Objid where)
+{
+    struct match_index *ix = &match_cache[where % MATCH_CACHE_SIZE];
+    unsigned stamp = db_contents_stamp(where);
+    int i;
+
+    /* stamps start at 1, so unused entries never match */
+    if (ix->where == where && ix->stamp == stamp)
+	return ix;
+
+    for (i = 0; i < ix->count; i++)
+	free_str(ix->keys[i].name);
+    ix->count = 0;
+    ix->where = where;
+    ix->stamp = stamp;
+
+    db_for_all_contents(where, index_proc, ix);
+    qsort(ix->keys, ix->count, sizeof(struct match_key), compare_keys);
+
+    return ix;
+}
+
+static int
+match_indexed(Objid where, struct match_data *d)
+{
+    struct match_index *ix = find_index(where);
+    int lo = 0, hi = ix->count;
+
+    /* find the first name at or after the typed prefix */
+    while (lo < hi) {
+	int mid = (lo + hi) / 2;
+
+	if (mystrncasecmp(ix->keys[mid].name, d->name, d->lname) < 0)
+	    lo = mid + 1;
 	else
-	    name = names[i].v.str;
-
-	if (!mystrncasecmp(name, d->name, d->lname)) {
-	    if (name[d->lname] == '\0') {	/* exact match */
-		if (d->exact == NOTHING || d->exact == oid)
-		    d->exact = oid;
-		else
-		    return 1;
-	    } else {		/* partial match */
-		if (d->partial == FAILED_MATCH || d->partial == oid)
-		    d->partial = oid;
-		else
-		    d->partial = AMBIGUOUS;
-	    }
-	}
+	    hi = mid;
+    }
+
+    for (; lo < ix->count; lo++) {
+	if (mystrncasecmp(ix->keys[lo].name, d->name, d->lname))
+	    break;
+	if (match_name(d, ix->keys[lo].name, ix->keys[lo].oid))
+	    return 1;
     }
 
     return 0;
@@ -101,7 +212,9 @@ match_contents(Objid player, const char *name)
     for (oid = player, step = 0; step < 2; oid = loc, step++) {
 	if (!valid(oid))
 	    continue;
-	if (db_for_all_contents(oid, match_proc, &d))
+	if (db_count_contents(oid) >= MATCH_INDEX_THRESHOLD
+	    ? match_indexed(oid, &d)
+	    : db_for_all_contents(oid, match_proc, &d))
 	    /* We only abort the enumeration for exact ambiguous matches... */
 	    return AMBIGUOUS;
     }
@@ -15,8 +15,6 @@
     Pavel@Xerox.Com
  *****************************************************************************/
 
-#include <stdexcept>
-
 /* Multi-user networking protocol implementation for TCP/IP on BSD UNIX */
 
 #include "my-inet.h"		/* inet_addr() */
@@ -30,17 +28,19 @@
 				   * connect() */
 #include "my-stdlib.h"		/* strtoul() */
 #include "my-string.h"		/* memcpy() */
+#include "my-time.h"		/* time() */
 #include "my-unistd.h"		/* close() */
 
 #include "config.h"
 #include "list.h"
 #include "log.h"
 #include "name_lookup.h"
+#include "net_mplex.h"
+#include "net_multi.h"
 #include "net_proto.h"
 #include "options.h"
 #include "server.h"
 #include "streams.h"
-#include "timers.h"
 #include "utils.h"
 
 #include "net_tcp.cc"
@@ -181,22 +181,42 @@ proto_close_listener(int fd)
 
 #include "structures.h"
 
-class timeout_exception: public std::exception
+/* Connects S to ADDR, giving up after TIMEOUT seconds.  The connection is
+ * made without blocking and waited for here, rather than interrupting a
+ * blocking connect() with a timer.
+ */
+static int
+connect_with_timeout(int s, struct sockaddr_in *addr, int timeout)
 {
-public:
-    timeout_exception() throw() {}
-
-    virtual ~timeout_exception() throw() {}
+    time_t deadline = time(0) + timeout;
+    int error;
+    socklen_t length = sizeof(error);
 
-    virtual const char* what() const throw() {
-	return "timeout";
+    if (!network_set_nonblocking(s))
+	return connect(s, (struct sockaddr *) addr, sizeof(*addr));
+    if (connect(s, (struct sockaddr *) addr, sizeof(*addr)) == 0)
+	return 0;
+    if (errno != EINPROGRESS)
+	return -1;
+    for (;;) {
+	time_t now = time(0);
+
+	if (now >= deadline) {
+	    errno = ETIMEDOUT;
+	    return -1;
+	}
+	mplex_clear();
+	mplex_add_writer(s);
+	if (!mplex_wait(deadline - now) && mplex_is_writable(s))
+	    break;
     }
-};
-
-static void
-timeout_proc(Timer_ID id, Timer_Data data)
-{
-    throw timeout_exception();
+    if (getsockopt(s, SOL_SOCKET, SO_ERROR, (char *) &error, &length) < 0)
+	return -1;
+    if (error) {
+	errno = error;
+	return -1;
+    }
+    return 0;
 }
 
 enum error
@@ -209,7 +229,6 @@ proto_open_connection(Var arglist, int *read_fd, int *write_fd,
      */
     static const char *host_name;
     static int port;
-    static Timer_ID id;
     socklen_t length;
     int s, result;
     int timeout = server_int_option("name_lookup_timeout", 5);
@@ -263,17 +282,8 @@ proto_open_connection(Var arglist, int *read_fd, int *write_fd,
 	    return e;
 	}
     }	 
-    try {
-	id = set_timer(server_int_option("outbound_connect_timeout", 5),
-		       timeout_proc, 0);
-	result = connect(s, (struct sockaddr *) &addr, sizeof(addr));
-	cancel_timer(id);
-    }
-    catch (timeout_exception& exception) {
-	result = -1;
-	errno = ETIMEDOUT;
-	reenable_timers();
-    }
+    result = connect_with_timeout(s, &addr,
+			server_int_option("outbound_connect_timeout", 5));
 
     if (result < 0) {
 	close(s);
@@ -61,7 +61,9 @@ static int *pocket_descriptors = 0;	/* fds we keep around in case we need
 typedef struct text_block {
     struct text_block *next;
     int length;
-    char *buffer;
+    char *buffer;		/* refcounted, and maybe shared with other
+				 * connections' blocks; see
+				 * network_send_to_many() */
     char *start;
 } text_block;
 
@@ -184,7 +186,7 @@ check_registered_fds(void)
 static void
 free_text_block(text_block * b)
 {
-    myfree(b->buffer, M_NETWORK);
+    free_str(b->buffer);
     myfree(b, M_NETWORK);
 }
 
@@ -427,15 +429,13 @@ accept_new_connection(nlistener * l)
     }
 }
 
+/* Makes room for LENGTH more bytes of output on H, discarding older
+ * output if necessary and FLUSH_OK is true.  Returns false if there
+ * isn't room.
+ */
 static int
-enqueue_output(network_handle nh, const char *line, int line_length,
-	       int add_eol, int flush_ok)
+make_room_for_output(nhandle * h, int length, int flush_ok)
 {
-    nhandle *h = (nhandle *)nh.ptr;
-    int length = line_length + (add_eol ? eol_length : 0);
-    char *buffer;
-    text_block *block;
-
     if (h->output_length != 0
 	&& h->output_length + length > MAX_QUEUED_OUTPUT) {	/* must flush... */
 	int to_flush;
@@ -455,17 +455,51 @@ enqueue_output(network_handle nh, const char *line, int line_length,
 	if (h->output_head == 0)
 	    h->output_tail = &(h->output_head);
     }
-    buffer = (char *) mymalloc(length * sizeof(char), M_NETWORK);
-    block = (text_block *) mymalloc(sizeof(text_block), M_NETWORK);
-    memcpy(buffer, line, line_length);
-    if (add_eol)
-	memcpy(buffer + line_length, proto.eol_out_string, eol_length);
+    return 1;
+}
+
+/* Queues the LENGTH bytes of BUFFER, a refcounted string whose
+ * reference passes to the new block, for output on H.
+ */
+static void
+append_output(nhandle * h, char *buffer, int length)
+{
+    text_block *block = (text_block *) mymalloc(sizeof(text_block), M_NETWORK);
+
     block->buffer = block->start = buffer;
     block->length = length;
     block->next = 0;
     *(h->output_tail) = block;
     h->output_tail = &(block->next);
     h->output_length += length;
+}
+
+/* Returns a new refcounted copy of LINE, with the end-of-line sequence
+ * appended if ADD_EOL is true.
+ */
+static char *
+make_output(const char *line, int line_length, int add_eol)
+{
+    int length = line_length + (add_eol ? eol_length : 0);
+    char *buffer = (char *) mymalloc(length + 1, M_STRING);
+
+    memcpy(buffer, line, line_length);
+    if (add_eol)
+	memcpy(buffer + line_length, proto.eol_out_string, eol_length);
+    buffer[length] = '\0';
+    return buffer;
+}
+
+static int
+enqueue_output(network_handle nh, const char *line, int line_length,
+	       int add_eol, int flush_ok)
+{
+    nhandle *h = (nhandle *)nh.ptr;
+    int length = line_length + (add_eol ? eol_length : 0);
+
+    if (!make_room_for_output(h, length, flush_ok))
+	return 0;
+    append_output(h, make_output(line, line_length, add_eol), length);
 
     return 1;
 }
@@ -545,6 +579,32 @@ network_send_bytes(network_handle nh, const char *buffer, int buflen,
     return enqueue_output(nh, buffer, buflen, 0, flush_ok);
 }
 
+int
+network_send_to_many(const network_handle * nhs, int count,
+		     const char *buffer, int buflen, int add_eol,
+		     int flush_ok)
+{
+    int length = buflen + (add_eol ? eol_length : 0);
+    char *shared;
+    int i, sent = 0;
+
+    if (count == 0)
+	return 0;
+
+    shared = make_output(buffer, buflen, add_eol);
+    for (i = 0; i < count; i++) {
+	nhandle *h = (nhandle *)nhs[i].ptr;
+
+	if (!make_room_for_output(h, length, flush_ok))
+	    continue;
+	append_output(h, (char *) str_ref(shared), length);
+	sent++;
+    }
+    free_str(shared);
+
+    return sent;
+}
+
 int
 network_buffered_output_length(network_handle nh)
 {
@@ -98,6 +98,23 @@ network_send_bytes(network_handle nh, const char *buffer, int buflen,
     return 1;
 }
 
+int
+network_send_to_many(const network_handle * nhs, int count,
+		     const char *buffer, int buflen, int add_eol,
+		     int flush_ok)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+	fwrite((void *) buffer, sizeof(char), buflen, stdout);
+	if (add_eol)
+	    putchar('\n');
+    }
+    fflush(stdout);
+
+    return count;
+}
+
 int
 network_buffered_output_length(network_handle nh)
 {
@@ -124,6 +124,17 @@ extern int network_send_bytes(network_handle nh,
 				 * fail if FLUSH_OK is false.
 				 */
 
+extern int network_send_to_many(const network_handle * nhs, int count,
+				const char *buffer, int buflen,
+				int add_eol, int flush_ok);
+				/* Like network_send_bytes() for each of the
+				 * COUNT connections in NHS, appending the
+				 * end-of-line sequence to the bytes if ADD_EOL
+				 * is true.  The connections share a single
+				 * copy of the output.  Returns the number of
+				 * connections on which the output was queued.
+				 */
+
 extern int network_buffered_output_length(network_handle nh);
 				/* Returns the number of bytes of output
 				 * currently queued up on the given connection.
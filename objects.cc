@@ -286,6 +286,17 @@ bf_valid(Var arglist, Byte next, void *vdata, Objid progr)
     return make_var_pack(r);
 }
 
+static package
+bf_object_table_stats(Var arglist, Byte next, void *vdata, Objid progr)
+{
+    free_var(arglist);
+
+    if (!is_wizard(progr))
+	return make_error_pack(E_PERM);
+
+    return make_var_pack(db_object_table_stats());
+}
+
 static package
 bf_max_object(Var arglist, Byte next, void *vdata, Objid progr)
 {				/* () */
@@ -451,6 +462,124 @@ bf_create_read(void)
 	return 0;
 }
 
+struct bf_create_many_data {
+    Var oids;
+    int next;			/* the next object to initialize */
+};
+
+static package
+bf_create_many(Var arglist, Byte next, void *vdata, Objid progr)
+{				/* (OBJ|LIST parent(s), OBJ owner, INT count) */
+    struct bf_create_many_data *data = (bf_create_many_data *)vdata;
+    Var r, args;
+    enum error e;
+
+    if (next == 1) {
+	Var parents = arglist.v.list[1];
+	Objid owner = arglist.v.list[2].v.obj;
+	int count = arglist.v.list[3].v.num;
+
+	if (!is_obj_or_list_of_objs(parents)) {
+	    free_var(arglist);
+	    return make_error_pack(E_TYPE);
+	}
+	else if (count < 0
+		 || (!valid(owner) && owner != NOTHING)
+		 || (parents.type == TYPE_OBJ
+		     && !valid(parents.v.obj)
+		     && parents.v.obj != NOTHING)
+		 || (parents.type == TYPE_LIST
+		     && !all_valid(parents))) {
+	    free_var(arglist);
+	    return make_error_pack(E_INVARG);
+	}
+	else if ((progr != owner && !is_wizard(progr))
+		 || (parents.type == TYPE_OBJ
+		     && valid(parents.v.obj)
+		     && !db_object_allows(parents, progr, FLAG_FERTILE))
+		 || (parents.type == TYPE_LIST
+		     && !all_allowed(parents, progr, FLAG_FERTILE))) {
+	    free_var(arglist);
+	    return make_error_pack(E_PERM);
+	}
+	else if (count == 0) {
+	    free_var(arglist);
+	    return make_var_pack(new_list(0));
+	}
+	else if (count > server_int_option_cached(SVO_MAX_CREATE_MANY)
+		 || count > MAXOBJ - 1 - db_last_used_objid()
+		 || (valid(owner) && !decr_quota_by(owner, count))) {
+	    free_var(arglist);
+	    return make_error_pack(E_QUOTA);
+	}
+	else if (!charge_ticks(count)) {
+	    incr_quota_by(owner, count);
+	    free_var(arglist);
+	    return make_abort_pack(ABORT_TICKS);
+	}
+
+	r = db_create_children(parents, owner, count);
+	free_var(arglist);
+	if (r.type == TYPE_NONE) {
+	    incr_quota_by(owner, count);
+	    return make_error_pack(E_INVARG);
+	}
+
+	data = (bf_create_many_data *)alloc_data(sizeof(*data));
+	data->oids = r;
+	data->next = 1;
+    } else			/* next == 2, returns from initialize verb_call */
+	free_var(arglist);
+
+    while (data->next <= listlength(data->oids)) {
+	Objid oid = data->oids.v.list[data->next++].v.obj;
+
+	if (!valid(oid))	/* recycled by an earlier `initialize' */
+	    continue;
+
+	args = new_list(0);
+	e = call_verb(oid, "initialize", new_obj(oid), args, 0);
+	/* e will not be E_INVIND */
+
+	if (e == E_NONE)
+	    return make_call_pack(2, data);
+
+	free_var(args);
+	if (e == E_MAXREC) {
+	    free_var(data->oids);
+	    free_data(data);
+	    return make_error_pack(e);
+	}
+	/* else e == E_VERBNF, go on to the next one */
+    }
+
+    r = data->oids;
+    free_data(data);
+    return make_var_pack(r);
+}
+
+static void
+bf_create_many_write(void *vdata)
+{
+    struct bf_create_many_data *data = (bf_create_many_data *)vdata;
+
+    dbio_printf("bf_create_many data: next = %d\n", data->next);
+    dbio_write_var(data->oids);
+}
+
+static void *
+bf_create_many_read(void)
+{
+    struct bf_create_many_data *data =
+	(bf_create_many_data *)alloc_data(sizeof(*data));
+
+    if (dbio_scanf("bf_create_many data: next = %d\n", &data->next) == 1) {
+	data->oids = dbio_read_var();
+	return data;
+    } else
+	return 0;
+}
+
 static package
 bf_chparent_chparents(Var arglist, Byte next, void *vdata, Objid progr)
 {				/* (OBJ obj, OBJ|LIST what, LIST anon) */
@@ -779,6 +908,7 @@ bf_recycle(Var arglist, Byte func_pc, void *vdata, Objid progr)
 	    incr_quota(db_object_owner(oid));
 
 	    db_destroy_object(oid);
+	    recheck_connection(oid);
 
 	    free_var(obj);
 	    free_var(*data);
@@ -950,6 +1080,10 @@ register_objects(void)
     register_function_with_read_write("create", 1, 4, bf_create,
 				      bf_create_read, bf_create_write,
 				      TYPE_ANY, TYPE_ANY, TYPE_ANY, TYPE_ANY);
+    register_function_with_read_write("create_many", 3, 3, bf_create_many,
+				      bf_create_many_read,
+				      bf_create_many_write,
+				      TYPE_ANY, TYPE_OBJ, TYPE_INT);
     register_function_with_read_write("recycle", 1, 1, bf_recycle,
 				      bf_recycle_read, bf_recycle_write,
 				      TYPE_ANY);
@@ -967,6 +1101,7 @@ register_objects(void)
     register_function("descendants", 1, 2, bf_descendants,
 		      TYPE_ANY, TYPE_ANY);
     register_function("max_object", 0, 0, bf_max_object);
+    register_function("object_table_stats", 0, 0, bf_object_table_stats);
     register_function("players", 0, 0, bf_players);
     register_function("is_player", 1, 1, bf_is_player, TYPE_OBJ);
     register_function("set_player_flag", 2, 2, bf_set_player_flag,
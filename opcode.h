@@ -94,6 +94,21 @@ enum Opcode {
 
     OP_MAP_CREATE, OP_MAP_INSERT,
 
+#ifdef BYTECODE_INT_OPS
+    /* integer specializations, each of which replaces the first byte of
+     * a generic sequence and falls back to it for other types; see
+     * `BYTECODE_INT_OPS' in options.h.  Ticks are counted as for the
+     * generic sequence.
+     */
+    OP_UPDATE_INT,		/* PUSH_n  ...  ADD|MINUS|MULT PUT_n */
+#ifdef BYTECODE_REDUCE_REF
+    OP_UPDATE_INT_CLEAR,	/* PUSH_CLEAR_n  ...  ADD|MINUS|MULT PUT_n */
+#endif				/* BYTECODE_REDUCE_REF */
+    OP_EQ_TEST, OP_NE_TEST,	/* EQ|NE  IF|WHILE|EIF|IF_QUES */
+    OP_LT_TEST, OP_LE_TEST,	/* LT|LE  IF|WHILE|EIF|IF_QUES */
+    OP_GT_TEST, OP_GE_TEST,	/* GT|GE  IF|WHILE|EIF|IF_QUES */
+#endif				/* BYTECODE_INT_OPS */
+
     OPTIM_NUM_START,
 
     /* storage optimized imm-numbers can occupy 113-255, for 143 of them */
@@ -121,6 +136,26 @@ enum Opcode {
 #define OPTIM_NUM_TO_OPCODE(i)   (OPTIM_NUM_START + (i) - OPTIM_NUM_LOW)
 #define IN_OPTIM_NUM_RANGE(i)    ((i) >= OPTIM_NUM_LOW && (i) <= OPTIM_NUM_HI)
 
+#ifdef BYTECODE_INT_OPS
+#define IS_INT_OP(o)             ((o) >= (unsigned) OP_UPDATE_INT \
+				  && (o) <= (unsigned) OP_GE_TEST)
+#define IS_INT_TEST_OP(o)        ((o) >= (unsigned) OP_EQ_TEST \
+				  && (o) <= (unsigned) OP_GE_TEST)
+#define INT_TEST_TO_COMPARISON(o) ((o) - OP_EQ_TEST + OP_EQ)
+#ifdef BYTECODE_REDUCE_REF
+#define INT_UPDATE_TO_PUSH(o, id) \
+	((o) == OP_UPDATE_INT ? OP_PUSH + (id) : OP_PUSH_CLEAR + (id))
+#else
+#define INT_UPDATE_TO_PUSH(o, id) (OP_PUSH + (id))
+#endif				/* BYTECODE_REDUCE_REF */
+/* The generic opcode that the integer opcode O stands in for; BV points
+ * just past O.
+ */
+#define INT_OP_TO_GENERIC(o, bv) \
+	((Opcode) (IS_INT_TEST_OP(o) ? INT_TEST_TO_COMPARISON(o) \
+		   : INT_UPDATE_TO_PUSH(o, PUT_n_INDEX((bv)[2]))))
+#endif				/* BYTECODE_INT_OPS */
+
 /* ARITH_COMP_BIN_OP does not include AND, OR */
 #define IS_ARITH_COMP_BIN_OP(o)  ((o) >= (unsigned) OP_MULT \
 				  && (o) <= (unsigned) OP_IN)
@@ -116,6 +116,17 @@
 #define DEFAULT_FG_SECONDS	5
 #define DEFAULT_BG_SECONDS	3
 
+/******************************************************************************
+ * If DEFAULT_BG_QUANTUM is positive, a background task is preempted each time
+ * it has used that many ticks, and put back on its queue behind whatever else
+ * is ready to run, so that commands don't wait on long computations.  It
+ * carries on later with the ticks and seconds it had left.
+ * $server_options.bg_quantum, if defined, overrides this default.
+ ******************************************************************************
+ */
+
+#define DEFAULT_BG_QUANTUM	0
+
 /******************************************************************************
  * NETWORK_PROTOCOL must be defined as one of the following:
  *
@@ -217,7 +228,8 @@
  *			   forcibly closed by the server; this can be
  *			   overridden by defining the `connect_timeout'
  *			   property on $server_options or on L, for connections
- *			   accepted by a given listener L.
+ *			   accepted by a given listener L.  The property is
+ *			   cached; see load_server_options().
  */
 
 #define MAX_QUEUED_OUTPUT	65536
@@ -286,6 +298,24 @@
 
 #define BYTECODE_REDUCE_REF /* */
 
+/******************************************************************************
+ * The code generator can also mark the bytecode sequences that make up the
+ * inner loops of most numeric code -- `x = x + y', `x = x - 1', `x = x * 2'
+ * on local variables, and comparisons whose result is immediately tested
+ * by `if', `while' or `? |' -- with opcodes that assume integer operands.
+ * When the operands are integers, the interpreter runs the whole sequence
+ * at once; otherwise it falls back to the generic opcodes.  The marked
+ * sequences are exactly as long as the generic ones, so program counters
+ * are unaffected, but the extra opcodes reduce the range of small integers
+ * that fit in a single byte (and so the length of some code), which means
+ * the NOTE WELL above applies to this option as well: a database holding
+ * suspended or forked tasks saved without it can't be loaded with it, or
+ * the other way around.  For that reason it is off by default.
+ ******************************************************************************
+ */
+
+/* #define BYTECODE_INT_OPS */
+
 /******************************************************************************
  * The server can merge duplicate strings on load to conserve memory.  This
  * involves a rather expensive step at startup to dispose of the table used
@@ -315,6 +345,24 @@
 
 #define MEMO_VALUE_BYTES /* */
 
+/******************************************************************************
+ * On x86-64 hosts the server can translate hot loops into native machine
+ * code.  A loop is considered hot once its head has been reached
+ * JIT_THRESHOLD times; from then on, each time the interpreter jumps back
+ * to the loop head it runs the translated code instead, falling back to
+ * the interpreter for anything other than simple integer arithmetic,
+ * comparisons and variable references.  Ticks are counted exactly as
+ * the interpreter counts them.
+ *
+ * The translator is experimental and is left out of the server unless
+ * JIT is defined.  Even then it is only used while $server_options.jit
+ * is set to a true value.
+ ******************************************************************************
+ */
+
+/* #define JIT */
+#define JIT_THRESHOLD 100
+
 /******************************************************************************
  * DEFAULT_MAX_STRING_CONCAT,      if set to a postive value, is the length
  *                                 of the largest constructible string.
@@ -352,6 +400,38 @@
 #define MIN_LIST_VALUE_BYTES_LIMIT 1021
 #define MIN_MAP_VALUE_BYTES_LIMIT  1021
 
+/******************************************************************************
+ * descendants() on an object with at least DEFAULT_DESCENDANTS_CACHE_THRESHOLD
+ * descendants caches its result with the object and keeps it up to date as
+ * objects are created, recycled and reparented, so the next call can simply
+ * return the same list.  $server_options.descendants_cache_threshold, if
+ * defined, overrides this default; zero disables the cache.
+ ******************************************************************************
+ */
+
+#define DEFAULT_DESCENDANTS_CACHE_THRESHOLD 1000
+
+/******************************************************************************
+ * A task suspended for at least DEFAULT_COMPACT_SUSPENDED_AFTER seconds (or
+ * forever) has the stacks of its activations trimmed to the values on them
+ * while it waits, and given back their full size when it resumes.  This
+ * saves memory when many tasks are suspended for a long time, at the cost of
+ * copying the stacks twice.  $server_options.compact_suspended_after, if
+ * defined, overrides this default; a negative value disables compaction.
+ ******************************************************************************
+ */
+
+#define DEFAULT_COMPACT_SUSPENDED_AFTER 10
+
+/******************************************************************************
+ * create_many() makes at most DEFAULT_MAX_CREATE_MANY objects at a time, and
+ * charges the calling task a tick for each.  $server_options.max_create_many,
+ * if defined, overrides this default.
+ ******************************************************************************
+ */
+
+#define DEFAULT_MAX_CREATE_MANY 10000
+
 /******************************************************************************
  * In the original LambdaMOO server, last chance command processing
  * occured in the `huh' verb defined on the player's location.  The
@@ -367,13 +447,34 @@
 /******************************************************************************
  * Configurable options for the Exec subsystem.  EXEC_SUBDIR is the
  * directory inside the working directory in which all executable
- * files must reside.
+ * files must reside.  At most EXEC_MAX_PROCESSES processes started by
+ * exec() may be running at once; $server_options.max_exec_processes, if
+ * defined, overrides this default, and zero disables exec() entirely.
  ******************************************************************************
  */
 
 #define EXEC_SUBDIR "executables/"
 #define EXEC_MAX_PROCESSES 256
 
+/******************************************************************************
+ * Configurable options for the query builtins, objects_where() and
+ * find_verbs_matching(), which scan the database in forked worker
+ * processes, and call_in_parallel(), which runs verbs in them.  A query
+ * uses at most QUERY_MAX_WORKERS workers (and no more than there are
+ * processors), and never gives a worker fewer than QUERY_MIN_OBJECTS
+ * object numbers to scan.  At most QUERY_MAX_QUERIES queries may run at
+ * once.  The server makes again, itself, at most QUERY_MAX_RERUNS of the
+ * calls passed to call_in_parallel() that could not be finished in a
+ * worker, since it does so while every other task waits; a batch that
+ * needs more fails with E_QUOTA.
+ ******************************************************************************
+ */
+
+#define QUERY_MAX_WORKERS 8
+#define QUERY_MIN_OBJECTS 2000
+#define QUERY_MAX_QUERIES 16
+#define QUERY_MAX_RERUNS 10
+
 /******************************************************************************
  * Configurable options for the FileIO subsystem.  FILE_SUBDIR is the
  * directory inside the working directory in which all files must
@@ -438,6 +539,10 @@
 #  error Illegal match() pattern cache size!
 #endif
 
+#if defined(JIT) && !defined(__x86_64__)
+#undef JIT
+#endif
+
 #define NP_SINGLE	1
 #define NP_TCP		2
 #define NP_LOCAL	3
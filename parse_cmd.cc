@@ -30,35 +30,25 @@
 #include "structures.h"
 #include "utils.h"
 
-char **
-parse_into_words(char *input, int *nwords)
+/* Copies the words of INPUT into OUT, one after another and each
+ * terminated by a NUL, and points WORDS at them.  A word runs up to the
+ * next space outside of double quotes; quotes are dropped and a
+ * backslash takes the following character literally.  OUT needs room
+ * for strlen(INPUT) + 1 characters, and WORDS for strlen(INPUT) / 2 + 1
+ * entries.  OUT may be INPUT itself.  If REST isn't null, *REST is set
+ * to the place in INPUT where the second word begins.  Returns the
+ * number of words.
+ */
+static int
+split_words(const char *input, char *out, char **words, const char **rest)
 {
-    static char **words = 0;
-    static int max_words = 0;
-    int in_quotes = 0;
-    char *ptr = input;
+    int nwords, in_quotes = 0;
 
-    if (!words) {
-	max_words = 50;
-	words = (char **)mymalloc(max_words * sizeof(char *), M_STRING_PTRS);
-    }
     while (*input == ' ')
 	input++;
 
-    for (*nwords = 0; *input != '\0'; (*nwords)++) {
-	if (*nwords == max_words) {
-	    int new_max = max_words * 2;
-	    char **_new = (char **)mymalloc(new_max * sizeof(char *), M_STRING_PTRS);
-	    int i;
-
-	    for (i = 0; i < max_words; i++)
-		_new[i] = words[i];
-
-	    myfree(words, M_STRING_PTRS);
-	    words = _new;
-	    max_words = new_max;
-	}
-	words[*nwords] = ptr;
+    for (nwords = 0; *input != '\0'; nwords++) {
+	words[nwords] = out;
 	while (*input != '\0' && (in_quotes || *input != ' ')) {
 	    char c = *(input++);
 
@@ -66,137 +56,140 @@ parse_into_words(char *input, int *nwords)
 		in_quotes = !in_quotes;
 	    else if (c == '\\') {
 		if (*input != '\0')
-		    *(ptr++) = *(input++);
+		    *(out++) = *(input++);
 	    } else
-		*(ptr++) = c;
+		*(out++) = c;
 	}
 	while (*input == ' ')
 	    input++;
-	*(ptr++) = '\0';
+	*(out++) = '\0';
+	if (nwords == 0 && rest)
+	    *rest = input;
     }
+    if (nwords == 0 && rest)
+	*rest = input;
 
-    return words;
+    return nwords;
 }
 
-static char *
-build_string(int argc, char *argv[])
+char **
+parse_into_words(char *input, int *nwords)
 {
-    int i, len = 0;
-    char *str;
-
-    if (!argc)
-	return str_dup("");
-
-    len = strlen(argv[0]);
-    for (i = 1; i < argc; i++)
-	len += 1 + strlen(argv[i]);
-
-    str = (char *) mymalloc(len + 1, M_STRING);
+    static char **words = 0;
+    static int max_words = 0;
+    int needed = strlen(input) / 2 + 1;
 
-    strcpy(str, argv[0]);
-    for (i = 1; i < argc; i++) {
-	strcat(str, " ");
-	strcat(str, argv[i]);
+    if (needed > max_words) {
+	if (words)
+	    myfree(words, M_STRING_PTRS);
+	max_words = needed > 50 ? needed : 50;
+	words = (char **)mymalloc(max_words * sizeof(char *), M_STRING_PTRS);
     }
+    *nwords = split_words(input, input, words, 0);
 
-    return str;
+    return words;
 }
 
-#define MAXWORDS		500	/* maximum number of words in a line */
-					/* This limit should be removed...   */
-
 Var
 parse_into_wordlist(const char *command)
 {
+    int len = strlen(command);
+    char **argv = (char **)mymalloc((len / 2 + 1) * sizeof(char *)
+				    + len + 1, M_STRING_PTRS);
     int argc, i;
-    char **argv;
     Var args;
-    char *s = str_dup(command);
 
-    argv = parse_into_words(s, &argc);
+    argc = split_words(command, (char *)(argv + len / 2 + 1), argv, 0);
     args = new_list(argc);
     for (i = 1; i <= argc; i++) {
 	args.v.list[i].type = TYPE_STR;
 	args.v.list[i].v.str = str_dup(argv[i - 1]);
     }
-    free_str(s);
+    myfree(argv, M_STRING_PTRS);
     return args;
 }
 
-Parsed_Command *
-parse_command(const char *command, Objid user)
+/* Joins ARGC adjacent words from split_words() with single spaces,
+ * writing the result at *OUT and advancing *OUT past it.
+ */
+static const char *
+join_words(int argc, char *argv[], char **out)
+{
+    char *str = *out;
+    const char *p;
+
+    if (argc == 0)
+	return "";
+
+    for (p = argv[0]; p < argv[argc - 1]; p++)
+	*(*out)++ = *p ? *p : ' ';
+    strcpy(*out, argv[argc - 1]);
+    *out += strlen(argv[argc - 1]) + 1;
+
+    return str;
+}
+
+int
+parse_command(const char *command, Objid user, Parsed_Command *pc)
 {
-    static Parsed_Command pc;
-    const char *argstr;
-    char *buf;
-    const char *verb;
-    int argc;
+    const char *argstr, *verb = 0;
+    char *out;
+    int len, argc, max_words;
     char **argv;
-    int pstart, pend, dlen;
-    int i;
+    int pstart, pend;
 
     while (*command == ' ')
 	command++;
     switch (*command) {
     case '"':
 	verb = "say";
-	goto finish_specials;
+	break;
     case ':':
 	verb = "emote";
-	goto finish_specials;
+	break;
     case ';':
 	verb = "eval";
-	goto finish_specials;
-
-      finish_specials:
-	argstr = command + 1;
-	buf = (char *) mymalloc(strlen(argstr) + strlen(verb) + 2,
-				M_STRING);
-	strcpy(buf, verb);
-	strcat(buf, " ");
-	strcat(buf, argstr);
-	break;
-
-    default:
-	buf = str_dup(command);
-	{			/* Skip past even complexly-quoted verbs */
-	    int in_quotes = 0;
-
-	    argstr = command;
-	    while (*argstr && (in_quotes || *argstr != ' ')) {
-		char c = *(argstr++);
-
-		if (c == '"')
-		    in_quotes = !in_quotes;
-		else if (c == '\\' && *argstr)
-		    argstr++;
-	    }
-	}
-	while (*argstr == ' ')
-	    argstr++;
 	break;
     }
-    argv = parse_into_words(buf, &argc);
 
-    if (argc == 0) {
-	free_str(buf);
-	return 0;
+    /* Everything lives in one buffer: the word pointers, the words
+     * themselves, a copy of the argument string, and the object and
+     * preposition strings, which are never longer than the words they
+     * are made of.
+     */
+    len = strlen(command);
+    max_words = len / 2 + 2;
+    pc->buf = (char *)mymalloc(max_words * sizeof(char *) + 3 * (len + 1),
+			       M_STRING_PTRS);
+    argv = (char **) pc->buf;
+    out = (char *) (argv + max_words);
+
+    if (verb) {
+	argv[0] = (char *) verb;
+	argstr = command + 1;
+	argc = 1 + split_words(argstr, out, argv + 1, 0);
+    } else {
+	argc = split_words(command, out, argv, &argstr);
+	if (argc == 0) {
+	    myfree(pc->buf, M_STRING_PTRS);
+	    return 0;
+	}
     }
-    pc.verb = str_dup(argv[0]);
-    pc.argstr = str_dup(argstr);
+    out += len + 1;
 
-    pc.args = new_list(argc - 1);
-    for (i = 1; i < argc; i++) {
-	pc.args.v.list[i].type = TYPE_STR;
-	pc.args.v.list[i].v.str = str_dup(argv[i]);
-    }
+    pc->verb = argv[0];
+    pc->argstr = out;
+    strcpy(out, argstr);
+    out += strlen(argstr) + 1;
+    pc->argc = argc - 1;
+    pc->argv = argv + 1;
 
     /*
      * look for a preposition
      */
     if (argc > 1) {
-	pc.prep = db_find_prep(argc - 1, argv + 1, &pstart, &pend);
-	if (pc.prep == PREP_NONE) {
+	pc->prep = db_find_prep(argc - 1, argv + 1, &pstart, &pend);
+	if (pc->prep == PREP_NONE) {
 	    pstart = argc;
 	    pend = argc;
 	} else {
@@ -204,7 +197,7 @@ parse_command(const char *command, Objid user)
 	    pend++;
 	}
     } else {
-	pc.prep = PREP_NONE;
+	pc->prep = PREP_NONE;
 	pstart = argc;
 	pend = argc;
     }
@@ -213,37 +206,42 @@ parse_command(const char *command, Objid user)
      * if there's a preposition,
      * find the iobj & dobj around it, if any
      */
-    if (pc.prep != PREP_NONE) {
-	pc.prepstr = build_string(pend - pstart + 1, argv + pstart);
-	pc.iobjstr = build_string(argc - (pend + 1), argv + (pend + 1));
-	pc.iobj = match_object(user, pc.iobjstr);
+    if (pc->prep != PREP_NONE) {
+	pc->prepstr = join_words(pend - pstart + 1, argv + pstart, &out);
+	pc->iobjstr = join_words(argc - (pend + 1), argv + (pend + 1), &out);
+	pc->iobj = match_object(user, pc->iobjstr);
     } else {
-	pc.prepstr = str_dup("");
-	pc.iobjstr = str_dup("");
-	pc.iobj = NOTHING;
+	pc->prepstr = "";
+	pc->iobjstr = "";
+	pc->iobj = NOTHING;
     }
 
-    dlen = pstart - 1;
-    if (dlen == 0) {
-	pc.dobjstr = str_dup("");
-	pc.dobj = NOTHING;
+    if (pstart == 1) {
+	pc->dobjstr = "";
+	pc->dobj = NOTHING;
     } else {
-	pc.dobjstr = build_string(dlen, argv + 1);
-	pc.dobj = match_object(user, pc.dobjstr);
+	pc->dobjstr = join_words(pstart - 1, argv + 1, &out);
+	pc->dobj = match_object(user, pc->dobjstr);
     }
 
-    free_str(buf);
+    return 1;
+}
 
-    return &pc;
+Var
+parsed_command_args(const Parsed_Command *pc)
+{
+    Var args = new_list(pc->argc);
+    int i;
+
+    for (i = 1; i <= pc->argc; i++) {
+	args.v.list[i].type = TYPE_STR;
+	args.v.list[i].v.str = str_dup(pc->argv[i - 1]);
+    }
+    return args;
 }
 
 void
 free_parsed_command(Parsed_Command * pc)
 {
-    free_str(pc->verb);
-    free_str(pc->argstr);
-    free_var(pc->args);
-    free_str(pc->dobjstr);
-    free_str(pc->prepstr);
-    free_str(pc->iobjstr);
+    myfree(pc->buf, M_STRING_PTRS);
 }
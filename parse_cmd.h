@@ -22,10 +22,17 @@
 #include "db.h"
 #include "structures.h"
 
+/* All of the strings below point into BUF, which is allocated once per
+ * command and released by free_parsed_command(); they are plain C
+ * strings, not MOO strings.
+ */
 typedef struct {
+    char *buf;			/* storage for everything below */
+
     const char *verb;		/* verb (as typed by player) */
     const char *argstr;		/* arguments to verb */
-    Var args;			/* arguments to the verb */
+    int argc;			/* number of words following the verb */
+    char **argv;		/* the words themselves */
 
     const char *dobjstr;	/* direct object string */
     Objid dobj;			/* direct object */
@@ -39,7 +46,9 @@ typedef struct {
 
 extern char **parse_into_words(char *input, int *nwords);
 extern Var parse_into_wordlist(const char *command);
-extern Parsed_Command *parse_command(const char *command, Objid user);
+extern int parse_command(const char *command, Objid user,
+			 Parsed_Command *pc);
+extern Var parsed_command_args(const Parsed_Command *);
 extern void free_parsed_command(Parsed_Command *);
 
 #endif				/* !Parse_Cmd_H */
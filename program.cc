@@ -16,6 +16,7 @@
  *****************************************************************************/
 
 #include "ast.h"
+#include "jit.h"
 #include "list.h"
 #include "parser.h"
 #include "program.h"
@@ -31,9 +32,11 @@ new_program(void)
 
     p->ref_count = 1;
     p->first_lineno = 1;
+    p->builtin_var_refs = ~0U;
     p->cached_lineno = 1;
     p->cached_lineno_pc = 0;
     p->cached_lineno_vec = MAIN_VECTOR;
+    p->jit_loops = 0;
     return p;
 }
 
@@ -109,6 +112,8 @@ free_program(Program * p)
 
 	myfree(p->main_vector.vector, M_BYTECODES);
 
+	jit_free_program(p);
+
 	myfree(p, M_PROGRAM);
     }
 }
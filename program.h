@@ -46,10 +46,14 @@ typedef struct {
 
     unsigned num_var_names;
     const char **var_names;
+    unsigned builtin_var_refs;	/* bit n set if the code mentions the
+				   built-in variable in slot n */
 
     unsigned cached_lineno;
     unsigned cached_lineno_pc;
     int cached_lineno_vec;
+
+    struct JIT_Loop *jit_loops;	/* see jit.cc */
 } Program;
 
 #define MAIN_VECTOR 	-1	/* As opposed to an index into fork_vectors */
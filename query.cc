@@ -0,0 +1,1044 @@
+/* Read-only queries over the whole database, and verb calls run side
+ * by side.
+ *
+ * Scanning every object from MOO code (`for o in [#0..max_object()]')
+ * takes a lot of interpreter time and has to suspend every so often,
+ * during which the database can change under the scan.  The builtins
+ * here do the same scans natively instead.  The calling task is
+ * suspended, and the object numbers are split into slices, each handed
+ * to a worker process forked off of the server.  Since a forked worker
+ * sees the database exactly as it was when the query started, no
+ * locking is needed, every worker sees the same consistent picture, and
+ * the server goes on running other tasks while the workers scan.
+ *
+ * Each worker writes its matches, as lines of text, down a pipe and
+ * then exits; the last line of a complete answer is a single `.'.  Once
+ * every pipe has been read to the end, the answers are put together in
+ * order of object number and handed to the suspended task.
+ *
+ * call_in_parallel() uses the same machinery to run a list of verb
+ * calls, handing each worker a slice of the calls instead.  A worker
+ * runs its calls one after another, each as a task of its own, and
+ * sends back the value of each along with whatever notifications it
+ * made.  The workers are all the more useful on a machine with many
+ * processors, since the server itself only ever runs one task at a time.
+ * Instead of locking objects against each other, the calls run against
+ * a snapshot of the database; nothing a worker does can last beyond it,
+ * so a call that tries to change anything (assigning to a property,
+ * calling a builtin not known to be harmless, forking a task) is
+ * abandoned, and the worker reports the conflict and stops.  Once the
+ * workers are done, the server sends the notifications of the calls
+ * that finished before the first one that didn't, in order, and makes
+ * that call and every one after it itself, just as if call_in_parallel()
+ * had never been involved.
+ *
+ * A command whose verb has the `p' flag is tried the same way, by a
+ * single worker, so that a long-running command that only looks at
+ * things doesn't hold up everyone else's; see do_command_task() in
+ * tasks.cc.  If the worker has to abandon the command, the server runs
+ * it over again itself.
+ */
+
+#include <errno.h>
+#include <float.h>
+
+#include "my-signal.h"
+#include "my-stdlib.h"
+#include "my-string.h"
+#include "my-unistd.h"
+
+#include "net_multi.h"
+
+#include "db.h"
+#include "execute.h"
+#include "functions.h"
+#include "list.h"
+#include "log.h"
+#include "map.h"
+#include "numbers.h"
+#include "parse_cmd.h"
+#include "pattern.h"
+#include "query.h"
+#include "server.h"
+#include "storage.h"
+#include "streams.h"
+#include "structures.h"
+#include "tasks.h"
+#include "timers.h"
+#include "unparse.h"
+#include "utils.h"
+
+typedef enum {
+    Q_OBJECTS_WHERE, Q_FIND_VERBS, Q_CALLS, Q_COMMAND
+} query_kind;
+
+typedef struct query_worker {
+    pid_t pid;
+    int fd;			/* -1 once the pipe has been read to the end */
+    int first, last;		/* its slice */
+    Stream *out;
+} query_worker;
+
+typedef struct query {
+    query_kind kind;
+    const char *name;		/* property name, pattern or command, if any */
+    Var value;			/* for Q_OBJECTS_WHERE; the calls for Q_CALLS */
+    Pattern pattern;		/* for Q_FIND_VERBS */
+    Objid player;		/* for Q_CALLS and Q_COMMAND */
+    task_queue tq;		/* for Q_COMMAND */
+    Parsed_Command *pc;		/* for Q_COMMAND, until the worker starts */
+    Objid _this;
+    db_verb_handle vh;
+    int nworkers;
+    int running;		/* workers whose pipes are still open */
+    query_worker workers[QUERY_MAX_WORKERS];
+    vm the_vm;			/* null for a command, or if the task
+				 * has been killed */
+} query;
+
+static query *query_table[QUERY_MAX_QUERIES];
+
+/* Workers that haven't been reaped yet.  A worker may well be reaped
+ * after its query is over, so these are kept apart from the queries.
+ */
+static pid_t worker_pids[QUERY_MAX_QUERIES * QUERY_MAX_WORKERS];
+
+/* For parallel_call_stats() */
+static struct {
+    int batches;		/* calls to call_in_parallel() */
+    int calls;			/* calls handed to workers */
+    int conflicts;		/* calls and commands abandoned by workers */
+    int retried;		/* calls and commands run again by the server */
+    int commands;		/* commands handed to workers */
+    char *last_conflict;	/* why the last one was abandoned */
+} parallel_stats;
+
+static sigset_t block_sigchld;
+
+#define BLOCK_SIGCHLD sigprocmask(SIG_BLOCK, &block_sigchld, NULL)
+#define UNBLOCK_SIGCHLD sigprocmask(SIG_UNBLOCK, &block_sigchld, NULL)
+
+static const char *
+query_builtin_name(query * q)
+{
+    return q->kind == Q_OBJECTS_WHERE ? "objects_where"
+	: q->kind == Q_FIND_VERBS ? "find_verbs_matching"
+	: "call_in_parallel";
+}
+
+static query *
+new_query(query_kind kind, const char *name)
+{
+    query *q = (query *) mymalloc(sizeof(query), M_TASK);
+
+    q->kind = kind;
+    q->name = name ? str_ref(name) : 0;
+    q->value = none;
+    q->pattern.ptr = 0;
+    q->player = NOTHING;
+    q->pc = 0;
+    q->nworkers = 0;
+    q->running = 0;
+    q->the_vm = 0;
+    return q;
+}
+
+static void
+free_query(query * q)
+{
+    int i;
+
+    for (i = 0; i < q->nworkers; i++) {
+	if (q->workers[i].fd >= 0) {
+	    network_unregister_fd(q->workers[i].fd);
+	    close(q->workers[i].fd);
+	}
+	free_stream(q->workers[i].out);
+    }
+    if (q->name)
+	free_str(q->name);
+    free_var(q->value);
+    if (q->pattern.ptr)
+	free_pattern(q->pattern);
+    myfree(q, M_TASK);
+}
+
+/*** The workers ***/
+
+struct verb_scan {
+    Pattern pattern;
+    int line;			/* lines seen so far */
+    int found;			/* line number of the first match, or 0 */
+};
+
+static void
+scan_line(void *data, const char *line)
+{
+    struct verb_scan *vs = (struct verb_scan *)data;
+    Match_Indices regs[10];
+
+    vs->line++;
+    if (!vs->found
+	&& match_pattern(vs->pattern, line, regs, 0) == MATCH_SUCCEEDED)
+	vs->found = vs->line;
+}
+
+static void
+scan_objects(query * q, Objid first, Objid last, Stream * s)
+{
+    Objid oid;
+
+    for (oid = first; oid <= last; oid++) {
+	if (!valid(oid))
+	    continue;
+
+	if (q->kind == Q_OBJECTS_WHERE) {
+	    Var value;
+	    db_prop_handle h = db_find_property(new_obj(oid), q->name, &value);
+
+	    if (!h.ptr)
+		continue;
+	    if (equality(value, q->value, 0))
+		stream_printf(s, "%d\n", oid);
+	    if (h.built_in)
+		free_var(value);
+	} else {
+	    Var obj = new_obj(oid);
+	    int i, count = db_count_verbs(obj);
+
+	    for (i = 1; i <= count; i++) {
+		db_verb_handle h = db_find_indexed_verb(obj, i);
+		struct verb_scan vs;
+		const char *names;
+
+		if (!h.ptr)
+		    continue;
+		vs.pattern = q->pattern;
+		vs.line = vs.found = 0;
+		unparse_program(db_verb_program(h), scan_line, &vs, 0, 1,
+				MAIN_VECTOR);
+		if (vs.found) {
+		    names = db_verb_names(h);
+		    stream_printf(s, "%d %d %d:%s\n", oid, vs.found,
+				  (int) strlen(names), names);
+		}
+	    }
+	}
+    }
+    stream_add_string(s, ".\n");
+}
+
+/* Writes everything in S down the pipe and exits. */
+static void
+finish_worker(Stream * s, int fd)
+{
+    const char *p = stream_contents(s);
+    int length = stream_length(s);
+
+    while (length > 0) {
+	ssize_t count = write(fd, p, length);
+
+	if (count < 0 && errno != EINTR)
+	    break;
+	if (count > 0) {
+	    p += count;
+	    length -= count;
+	}
+    }
+    _exit(length ? 1 : 0);
+}
+
+/*** Parallel calls: the workers ***/
+
+int in_parallel_worker = 0;
+
+static Stream *worker_out;	/* the finished calls, so far */
+static int worker_fd;
+static Var worker_notes;	/* the notifications of the current call */
+
+/* Values go back to the server as lines of text, one per scalar; a
+ * string is written as its length and its characters, so that it can
+ * hold anything, and a list or map as its length, followed by its
+ * elements (or keys and values).  The values of a call must mean the
+ * same thing in the server as in the worker, which rules out anonymous
+ * objects.
+ */
+static int write_element(Var v, void *data, int first);
+static int write_entry(Var key, Var value, void *data, int first);
+
+static void
+write_value(Stream * s, Var v)
+{
+    switch (v.type) {
+    case TYPE_INT:
+	stream_printf(s, "i%d\n", v.v.num);
+	break;
+    case TYPE_OBJ:
+	stream_printf(s, "o%d\n", v.v.obj);
+	break;
+    case TYPE_ERR:
+	stream_printf(s, "e%d\n", (int) v.v.err);
+	break;
+    case TYPE_FLOAT:
+	{
+	    char buffer[50];
+
+	    sprintf(buffer, "f%.*g\n", DBL_DIG + 4, *v.v.fnum);
+	    stream_add_string(s, buffer);
+	}
+	break;
+    case TYPE_STR:
+	stream_printf(s, "s%d:", (int) memo_strlen(v.v.str));
+	stream_add_string(s, v.v.str);
+	stream_add_char(s, '\n');
+	break;
+    case TYPE_LIST:
+	stream_printf(s, "l%d\n", v.v.list[0].v.num);
+	listforeach(v, write_element, s);
+	break;
+    case TYPE_MAP:
+	stream_printf(s, "m%d\n", maplength(v));
+	mapforeach(v, write_entry, s);
+	break;
+    default:
+	abandon_parallel_call("anonymous object");
+    }
+}
+
+static int
+write_element(Var v, void *data, int first)
+{
+    write_value((Stream *) data, v);
+    return 0;
+}
+
+static int
+write_entry(Var key, Var value, void *data, int first)
+{
+    write_value((Stream *) data, key);
+    write_value((Stream *) data, value);
+    return 0;
+}
+
+static void
+run_calls(query * q, int first, int last, int fd)
+{
+    Stream *record = new_stream(100);
+    int i;
+
+    reset_virtual_timer();
+    in_parallel_worker = 1;
+    worker_out = new_stream(1000);
+    worker_fd = fd;
+
+    for (i = first; i <= last; i++) {
+	Var call = q->value.v.list[i + 1];
+	Var result;
+
+	worker_notes = new_list(0);
+	if (run_server_task(q->player, call.v.list[1], call.v.list[2].v.str,
+			    var_ref(call.v.list[3]), "", &result)
+	    != OUTCOME_DONE)
+	    result = zero;
+	write_value(record, worker_notes);
+	write_value(record, result);
+	stream_add_string(worker_out, reset_stream(record));
+	free_var(worker_notes);
+	free_var(result);
+    }
+    stream_add_string(worker_out, ".\n");
+    finish_worker(worker_out, fd);
+}
+
+static void
+run_command(query * q, int fd)
+{
+    reset_virtual_timer();
+    in_parallel_worker = 1;
+    worker_out = new_stream(100);
+    worker_fd = fd;
+    worker_notes = new_list(0);
+
+    do_input_task(q->player, q->pc, q->_this, q->vh);
+    write_value(worker_out, worker_notes);
+    stream_add_string(worker_out, ".\n");
+    finish_worker(worker_out, fd);
+}
+
+void
+abandon_parallel_call(const char *why)
+{
+    stream_printf(worker_out, "!%s\n", why);
+    finish_worker(worker_out, worker_fd);
+}
+
+void
+parallel_notify(Objid player, const char *line)
+{
+    Var note = new_list(2);
+
+    note.v.list[1] = new_obj(player);
+    note.v.list[2] = str_dup_to_var(line);
+    worker_notes = listappend(worker_notes, note);
+}
+
+/* The builtins a worker may call, since all they do is look at things
+ * or work out values.  Kept in order, for bsearch().
+ */
+static const char *safe_functions[] = {
+    "abs", "acos", "ancestors", "asin", "atan", "binary_hash", "binary_hmac",
+    "call_function", "caller_perms", "callers", "ceil", "children",
+    "connected_players", "connected_seconds", "connection_name", "cos",
+    "cosh", "ctime", "decode_base64", "decode_binary", "descendants",
+    "encode_base64", "encode_binary", "equal", "eval", "exp", "floatstr",
+    "floor", "function_info", "generate_json", "idle_seconds", "index",
+    "is_clear_property", "is_member", "is_player", "isa", "length",
+    "listappend", "listdelete", "listinsert", "listset", "log", "log10",
+    "mapdelete", "mapkeys", "mapvalues", "match", "max", "max_object", "min",
+    "notify", "parent", "parents", "parse_json", "pass", "players",
+    "properties", "property_info", "raise", "respond_to",
+    "rindex", "rmatch", "seconds_left", "server_version", "set_task_local",
+    "set_task_perms", "setadd", "setremove", "sin", "sinh", "sqrt",
+    "strcmp", "string_hash", "string_hmac", "strsub", "strtr", "substitute",
+    "tan", "tanh", "task_id", "task_local", "task_perms", "ticks_left",
+    "time", "tofloat", "toint", "toliteral", "tonum", "toobj", "tostr",
+    "trunc", "typeof", "valid", "value_bytes", "value_hash", "value_hmac",
+    "verb_args", "verb_code", "verb_info", "verbs"
+};
+
+static int
+compare_names(const void *a, const void *b)
+{
+    return strcmp(*(const char **) a, *(const char **) b);
+}
+
+int
+parallel_safe_function(unsigned n)
+{
+    const char *name = name_func_by_num(n);
+
+    return name && bsearch(&name, safe_functions, Arraysize(safe_functions),
+			   sizeof(*safe_functions), compare_names);
+}
+
+static void
+run_worker(query * q, Objid first, Objid last, int fd)
+{
+    Stream *s;
+
+    if (q->kind == Q_CALLS)
+	run_calls(q, first, last, fd);
+    else if (q->kind == Q_COMMAND)
+	run_command(q, fd);
+
+    s = new_stream(1000);
+    scan_objects(q, first, last, s);
+    finish_worker(s, fd);
+}
+
+/*** Collecting the answers ***/
+
+static Var
+parse_answers(query * q)
+{
+    Var r = new_list(0);
+    int i;
+
+    for (i = 0; i < q->nworkers; i++) {
+	const char *p = stream_contents(q->workers[i].out);
+	const char *end = p + stream_length(q->workers[i].out);
+
+	while (p < end && *p != '.') {
+	    char *rest;
+	    Var v;
+	    Objid oid = strtol(p, &rest, 10);
+
+	    if (q->kind == Q_OBJECTS_WHERE)
+		v = new_obj(oid);
+	    else {
+		int line = strtol(rest, &rest, 10);
+		int length = strtol(rest, &rest, 10);
+		char *names;
+
+		if (length < 0 || rest + 1 + length >= end) {
+		    p = end;
+		    break;
+		}
+		names = (char *) mymalloc(length + 1, M_STRING);
+		memcpy(names, rest + 1, length);
+		names[length] = '\0';
+		rest += 1 + length;
+		v = new_list(3);
+		v.v.list[1] = new_obj(oid);
+		v.v.list[2].type = TYPE_STR;
+		v.v.list[2].v.str = names;
+		v.v.list[3].type = TYPE_INT;
+		v.v.list[3].v.num = line;
+	    }
+	    r = listappend(r, v);
+	    p = rest + 1;	/* past the newline */
+	}
+	if (p >= end) {		/* the worker died before it finished */
+	    free_var(r);
+	    r.type = TYPE_ERR;
+	    r.v.err = E_EXEC;
+	    break;
+	}
+    }
+    return r;
+}
+
+/*** Parallel calls: collecting the results ***/
+
+/* Reads a value written by write_value() from *PP into *V, moving *PP
+ * past it.  Returns false, leaving *V alone, at the end of the calls or
+ * if the worker stopped in the middle of a value.
+ */
+static int
+read_value(const char **pp, const char *end, Var * v)
+{
+    const char *p = *pp;
+    char *rest;
+    char kind;
+    int i, n;
+    Var r;
+
+    if (p >= end)
+	return 0;
+    kind = *p++;
+    switch (kind) {
+    case 'i':
+    case 'o':
+    case 'e':
+	r.type = kind == 'i' ? TYPE_INT : kind == 'o' ? TYPE_OBJ : TYPE_ERR;
+	r.v.num = strtol(p, &rest, 10);
+	break;
+    case 'f':
+	r = new_float(strtod(p, &rest));
+	break;
+    case 's':
+	n = strtol(p, &rest, 10);
+	if (*rest != ':' || n < 0 || rest + 1 + n >= end)
+	    return 0;
+	{
+	    char *str = (char *) mymalloc(n + 1, M_STRING);
+
+	    memcpy(str, rest + 1, n);
+	    str[n] = '\0';
+	    r.type = TYPE_STR;
+	    r.v.str = str;
+	}
+	rest += 1 + n;
+	break;
+    case 'l':
+    case 'm':
+	n = strtol(p, &rest, 10);
+	if (*rest != '\n' || n < 0)
+	    return 0;
+	p = rest + 1;
+	if (kind == 'l') {
+	    r = new_list(n);
+	    for (i = 1; i <= n; i++)
+		r.v.list[i] = zero;
+	    for (i = 1; i <= n; i++)
+		if (!read_value(&p, end, &r.v.list[i])) {
+		    free_var(r);
+		    return 0;
+		}
+	} else {
+	    r = new_map();
+	    for (i = 0; i < n; i++) {
+		Var key, value;
+
+		if (!read_value(&p, end, &key)) {
+		    free_var(r);
+		    return 0;
+		}
+		if (!read_value(&p, end, &value)) {
+		    free_var(key);
+		    free_var(r);
+		    return 0;
+		}
+		r = mapinsert(r, key, value);
+	    }
+	}
+	*v = r;
+	*pp = p;
+	return 1;
+    default:			/* `.' or `!' */
+	return 0;
+    }
+    if (rest >= end || *rest != '\n') {
+	free_var(r);
+	return 0;
+    }
+    *v = r;
+    *pp = rest + 1;
+    return 1;
+}
+
+/* Records the reason a worker gave for abandoning a call or command. */
+static void
+note_conflict(const char *why, const char *end)
+{
+    const char *eol = (const char *) memchr(why, '\n', end - why);
+    Stream *s = new_stream(20);
+
+    stream_add_raw_bytes_to_clean(s, why, eol ? eol - why : end - why);
+    if (parallel_stats.last_conflict)
+	free_str(parallel_stats.last_conflict);
+    parallel_stats.last_conflict = str_dup(stream_contents(s));
+    parallel_stats.conflicts++;
+    free_stream(s);
+}
+
+static Var
+finish_calls(query * q)
+{
+    int ncalls = q->value.v.list[0].v.num;
+    Var r = new_list(ncalls);
+    Var *notes = (Var *) mymalloc(sizeof(Var) * (ncalls + 1), M_TASK);
+    int i, j;
+
+    for (i = 1; i <= ncalls; i++)
+	r.v.list[i] = notes[i] = none;
+
+    for (i = 0; i < q->nworkers; i++) {
+	query_worker *w = &q->workers[i];
+	const char *p = stream_contents(w->out);
+	const char *end = p + stream_length(w->out);
+	int k;
+
+	for (k = w->first + 1; k <= w->last + 1; k++) {
+	    if (!read_value(&p, end, &notes[k]))
+		break;
+	    if (!read_value(&p, end, &r.v.list[k])) {
+		free_var(notes[k]);
+		notes[k] = none;
+		break;
+	    }
+	}
+	if (p < end && *p == '!')
+	    note_conflict(p + 1, end);
+    }
+
+    /* Send the notifications of the calls that finished before the first
+     * that didn't, and make that one and every one after it, in order.
+     * A later call may well have finished in another worker, but it saw
+     * the database as it was before the calls the server now makes, so
+     * its value has to be thrown away.  The server makes those calls
+     * here, one after another, while everything else waits, so if there
+     * are more than QUERY_MAX_RERUNS of them it makes none at all; since
+     * nothing the workers did lasts, the batch then simply fails.
+     */
+    for (i = 1; i <= ncalls && notes[i].type == TYPE_LIST; i++)
+	continue;
+    if (ncalls - i + 1 > QUERY_MAX_RERUNS) {
+	for (i = 1; i <= ncalls; i++)
+	    free_var(notes[i]);
+	myfree(notes, M_TASK);
+	free_var(r);
+	r.type = TYPE_ERR;
+	r.v.err = E_QUOTA;
+	return r;
+    }
+    for (i = 1; i <= ncalls && notes[i].type == TYPE_LIST; i++) {
+	for (j = 1; j <= notes[i].v.list[0].v.num; j++) {
+	    Var note = notes[i].v.list[j];
+
+	    notify(note.v.list[1].v.obj, note.v.list[2].v.str);
+	}
+	free_var(notes[i]);
+    }
+    for (; i <= ncalls; i++) {
+	Var call = q->value.v.list[i];
+
+	free_var(notes[i]);
+	free_var(r.v.list[i]);
+	parallel_stats.retried++;
+	if (run_server_task(q->player, call.v.list[1], call.v.list[2].v.str,
+			    var_ref(call.v.list[3]), "", &r.v.list[i])
+	    != OUTCOME_DONE)
+	    r.v.list[i] = zero;
+    }
+    myfree(notes, M_TASK);
+
+    return r;
+}
+
+/* Sends the notifications of a command that finished in its worker, or
+ * has the server run it over again, and lets tasks.cc know it's done.
+ */
+static void
+finish_command(query * q)
+{
+    query_worker *w = &q->workers[0];
+    const char *p = stream_contents(w->out);
+    const char *end = p + stream_length(w->out);
+    Var notes;
+    int i;
+
+    if (read_value(&p, end, &notes)) {
+	for (i = 1; i <= notes.v.list[0].v.num; i++) {
+	    Var note = notes.v.list[i];
+
+	    notify(note.v.list[1].v.obj, note.v.list[2].v.str);
+	}
+	free_var(notes);
+	parallel_command_done(q->tq, q->name, 1);
+    } else {
+	if (p < end && *p == '!')
+	    note_conflict(p + 1, end);
+	parallel_stats.retried++;
+	parallel_command_done(q->tq, q->name, 0);
+    }
+}
+
+static void
+worker_readable(int fd, void *data)
+{
+    query *q = (query *) data;
+    query_worker *w = 0;
+    char buffer[4096];
+    int i, n;
+
+    for (i = 0; i < q->nworkers; i++)
+	if (q->workers[i].fd == fd)
+	    w = &q->workers[i];
+    if (!w)
+	return;
+
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+	for (i = 0; i < n; i++)
+	    stream_add_char(w->out, buffer[i]);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+	return;
+
+    /* end of file (or an error, which amounts to the same thing) */
+    network_unregister_fd(fd);
+    close(fd);
+    w->fd = -1;
+    if (--q->running > 0)
+	return;
+
+    BLOCK_SIGCHLD;
+    for (i = 0; i < QUERY_MAX_QUERIES; i++)
+	if (query_table[i] == q)
+	    query_table[i] = 0;
+    UNBLOCK_SIGCHLD;
+
+    if (q->kind == Q_COMMAND)
+	finish_command(q);
+    else if (q->the_vm)
+	resume_task(q->the_vm, q->kind == Q_CALLS ? finish_calls(q)
+		    : parse_answers(q));
+    free_query(q);
+}
+
+/*** Starting a query ***/
+
+/* Forks the workers for Q.  If that fails, Q is freed. */
+static enum error
+start_query(query * q)
+{
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int slot, i, j, n, last, per_worker;
+
+    if (q->kind == Q_CALLS) {
+	last = q->value.v.list[0].v.num - 1;
+	n = last + 1;
+    } else if (q->kind == Q_COMMAND) {
+	last = 0;
+	n = 1;
+    } else {
+	last = db_last_used_objid();
+	n = (last + QUERY_MIN_OBJECTS) / QUERY_MIN_OBJECTS;
+    }
+    if (n > ncpus)
+	n = ncpus;
+    if (n > QUERY_MAX_WORKERS)
+	n = QUERY_MAX_WORKERS;
+    if (n < 1)
+	n = 1;
+    per_worker = (last + n) / n;
+    if (q->kind == Q_CALLS)	/* no empty slices */
+	n = (last + per_worker) / per_worker;
+
+    BLOCK_SIGCHLD;
+
+    for (slot = 0; slot < QUERY_MAX_QUERIES; slot++)
+	if (!query_table[slot])
+	    break;
+    if (slot == QUERY_MAX_QUERIES) {
+	UNBLOCK_SIGCHLD;
+	free_query(q);
+	return E_QUOTA;
+    }
+
+    for (i = 0; i < n; i++) {
+	query_worker *w = &q->workers[i];
+	int fds[2];
+	pid_t pid;
+
+	for (j = 0; j < (int) Arraysize(worker_pids); j++)
+	    if (!worker_pids[j])
+		break;
+	if (j == (int) Arraysize(worker_pids))
+	    break;
+	if (pipe(fds) < 0) {
+	    log_perror("QUERY: Couldn't create pipe");
+	    break;
+	}
+	if ((pid = fork_helper("query worker")) < 0) {
+	    close(fds[0]);
+	    close(fds[1]);
+	    break;
+	} else if (pid == 0) {
+	    close(fds[0]);
+	    run_worker(q, i * per_worker,
+		       i == n - 1 ? last : (i + 1) * per_worker - 1, fds[1]);
+	}
+	close(fds[1]);
+	network_set_nonblocking(fds[0]);
+	worker_pids[j] = pid;
+	w->pid = pid;
+	w->fd = fds[0];
+	w->first = i * per_worker;
+	w->last = i == n - 1 ? last : (i + 1) * per_worker - 1;
+	w->out = new_stream(1000);
+	q->nworkers++;
+    }
+
+    if (q->nworkers < n) {	/* give up, letting any workers run out */
+	for (i = 0; i < q->nworkers; i++)
+	    kill(q->workers[i].pid, SIGKILL);
+	UNBLOCK_SIGCHLD;
+	free_query(q);
+	return E_EXEC;
+    }
+
+    for (i = 0; i < n; i++)
+	network_register_fd(q->workers[i].fd, worker_readable, NULL, q);
+    q->running = n;
+    if (q->kind == Q_CALLS) {
+	parallel_stats.batches++;
+	parallel_stats.calls += last + 1;
+    } else if (q->kind == Q_COMMAND)
+	parallel_stats.commands++;
+    query_table[slot] = q;
+
+    UNBLOCK_SIGCHLD;
+    return E_NONE;
+}
+
+static enum error
+query_suspender(vm the_vm, void *data)
+{
+    query *q = (query *) data;
+
+    if (q->kind == Q_CALLS)
+	q->player = the_vm->activ_stack[0].player;
+    q->the_vm = the_vm;
+    return start_query(q);
+}
+
+int
+run_command_in_parallel(task_queue tq, Objid player, const char *command,
+			Parsed_Command * pc, Objid _this, db_verb_handle vh)
+{
+    query *q = new_query(Q_COMMAND, 0);
+
+    q->name = str_dup(command);
+    q->tq = tq;
+    q->player = player;
+    q->pc = pc;
+    q->_this = _this;
+    q->vh = vh;
+    if (start_query(q) != E_NONE)
+	return 0;
+    q->pc = 0;			/* the worker has its own copy */
+    return 1;
+}
+
+pid_t
+query_complete(pid_t p)
+{
+    int i;
+
+    for (i = 0; i < (int) Arraysize(worker_pids); i++)
+	if (worker_pids[i] == p) {
+	    worker_pids[i] = 0;
+	    return p;
+	}
+    return 0;
+}
+
+static task_enum_action
+query_enumerator(task_closure closure, void *data)
+{
+    task_enum_action action = TEA_CONTINUE;
+    int i, j;
+
+    for (i = 0; i < QUERY_MAX_QUERIES; i++) {
+	query *q = query_table[i];
+
+	if (!q || !q->the_vm)
+	    continue;
+	action = (*closure) (q->the_vm, query_builtin_name(q), data);
+	if (action == TEA_KILL) {
+	    /* The task is gone; stop the workers, whose pipes will then
+	     * close and let the query be cleaned up as usual.
+	     */
+	    q->the_vm = 0;
+	    for (j = 0; j < q->nworkers; j++)
+		if (q->workers[j].fd >= 0)
+		    kill(q->workers[j].pid, SIGKILL);
+	}
+	if (action != TEA_CONTINUE)
+	    break;
+    }
+    return action;
+}
+
+/*** The builtins ***/
+
+static package
+bf_objects_where(Var arglist, Byte next, void *vdata, Objid progr)
+{				/* (name, value) */
+    query *q;
+
+    if (!is_wizard(progr)) {
+	free_var(arglist);
+	return make_error_pack(E_PERM);
+    }
+    q = new_query(Q_OBJECTS_WHERE, arglist.v.list[1].v.str);
+    q->value = var_ref(arglist.v.list[2]);
+    free_var(arglist);
+
+    return make_suspend_pack(query_suspender, q);
+}
+
+static package
+bf_find_verbs_matching(Var arglist, Byte next, void *vdata, Objid progr)
+{				/* (pattern [, case-matters]) */
+    int case_matters = (arglist.v.list[0].v.num > 1
+			&& is_true(arglist.v.list[2]));
+    Pattern pattern;
+    query *q;
+
+    if (!is_wizard(progr)) {
+	free_var(arglist);
+	return make_error_pack(E_PERM);
+    }
+    pattern = new_pattern(arglist.v.list[1].v.str, case_matters);
+    if (!pattern.ptr) {
+	free_var(arglist);
+	return make_error_pack(E_INVARG);
+    }
+    q = new_query(Q_FIND_VERBS, arglist.v.list[1].v.str);
+    q->pattern = pattern;
+    free_var(arglist);
+
+    return make_suspend_pack(query_suspender, q);
+}
+
+static package
+bf_call_in_parallel(Var arglist, Byte next, void *vdata, Objid progr)
+{				/* (calls) */
+    Var calls = arglist.v.list[1];
+    Var normal;
+    query *q;
+    int i;
+
+    if (!is_wizard(progr)) {
+	free_var(arglist);
+	return make_error_pack(E_PERM);
+    }
+    normal = new_list(calls.v.list[0].v.num);
+    for (i = 1; i <= calls.v.list[0].v.num; i++) {
+	Var c = calls.v.list[i];
+	enum error e = E_NONE;
+
+	normal.v.list[i] = zero;
+	if (c.type != TYPE_LIST || c.v.list[0].v.num < 2
+	    || c.v.list[0].v.num > 3
+	    || c.v.list[1].type != TYPE_OBJ || c.v.list[2].type != TYPE_STR
+	    || (c.v.list[0].v.num == 3 && c.v.list[3].type != TYPE_LIST))
+	    e = E_INVARG;
+	else if (!valid(c.v.list[1].v.obj))
+	    e = E_INVIND;
+	else if (!db_find_callable_verb(c.v.list[1], c.v.list[2].v.str).ptr)
+	    e = E_VERBNF;
+	if (e != E_NONE) {
+	    free_var(normal);
+	    free_var(arglist);
+	    return make_error_pack(e);
+	}
+	normal.v.list[i] = new_list(3);
+	normal.v.list[i].v.list[1] = var_ref(c.v.list[1]);
+	normal.v.list[i].v.list[2] = var_ref(c.v.list[2]);
+	normal.v.list[i].v.list[3] = c.v.list[0].v.num == 3
+	    ? var_ref(c.v.list[3]) : new_list(0);
+    }
+    free_var(arglist);
+
+    if (normal.v.list[0].v.num == 0)
+	return make_var_pack(normal);
+
+    q = new_query(Q_CALLS, 0);
+    q->value = normal;
+    return make_suspend_pack(query_suspender, q);
+}
+
+static Var
+stats_entry(Var map, const char *key, Var value)
+{
+    Var k;
+
+    k.type = TYPE_STR;
+    k.v.str = str_dup(key);
+    return mapinsert(map, k, value);
+}
+
+static package
+bf_parallel_call_stats(Var arglist, Byte next, void *vdata, Objid progr)
+{
+    Var r = new_map(), v;
+
+    free_var(arglist);
+    if (!is_wizard(progr)) {
+	free_var(r);
+	return make_error_pack(E_PERM);
+    }
+    v.type = TYPE_INT;
+    v.v.num = parallel_stats.batches;
+    r = stats_entry(r, "batches", v);
+    v.v.num = parallel_stats.calls;
+    r = stats_entry(r, "calls", v);
+    v.v.num = parallel_stats.conflicts;
+    r = stats_entry(r, "conflicts", v);
+    v.v.num = parallel_stats.retried;
+    r = stats_entry(r, "retried", v);
+    v.v.num = parallel_stats.commands;
+    r = stats_entry(r, "commands", v);
+    r = stats_entry(r, "last_conflict",
+		    str_dup_to_var(parallel_stats.last_conflict
+				   ? parallel_stats.last_conflict : ""));
+    return make_var_pack(r);
+}
+
+void
+register_query(void)
+{
+    sigemptyset(&block_sigchld);
+    sigaddset(&block_sigchld, SIGCHLD);
+
+    register_task_queue(query_enumerator);
+    register_function("objects_where", 2, 2, bf_objects_where,
+		      TYPE_STR, TYPE_ANY);
+    register_function("find_verbs_matching", 1, 2, bf_find_verbs_matching,
+		      TYPE_STR, TYPE_ANY);
+    register_function("call_in_parallel", 1, 1, bf_call_in_parallel,
+		      TYPE_LIST);
+    register_function("parallel_call_stats", 0, 0, bf_parallel_call_stats);
+}
@@ -0,0 +1,51 @@
+/* Read-only queries over the whole database, such as objects_where()
+ * and find_verbs_matching(), verb calls run side by side by
+ * call_in_parallel(), and commands tried in a worker first.  Each
+ * query is run by a small pool of forked worker processes, each taking
+ * a slice of the object numbers (or of the calls) in its own copy of
+ * the database as it stood when the query started, while the calling
+ * task is suspended.  See query.cc and options.h.
+ */
+
+#ifndef QUERY_H
+#define QUERY_H 1
+
+#include "config.h"
+#include "my-types.h"
+
+#include "db.h"
+#include "parse_cmd.h"
+#include "tasks.h"
+
+/* Called from child_completed_signal() in server.cc, with SIGCHLD
+ * blocked.  Returns P if it was one of the query workers.
+ */
+extern pid_t query_complete(pid_t p);
+
+/* True in a worker running verbs for call_in_parallel().  Nothing such
+ * a worker does may last beyond it, so anything that would change the
+ * database, or otherwise reach outside of the worker, must first call
+ * abandon_parallel_call(), which never returns; the call is then made
+ * again by the server itself.  Notifications are the exception: they
+ * are handed to parallel_notify() and sent by the server once the call
+ * is over.
+ */
+extern int in_parallel_worker;
+
+extern void abandon_parallel_call(const char *why);
+extern int parallel_safe_function(unsigned n);
+extern void parallel_notify(Objid player, const char *line);
+
+/* Starts running the verb VH on _THIS for the command PC, typed as
+ * COMMAND by PLAYER (whose task queue is TQ), in a worker; the verb has
+ * the VF_PARALLEL flag.  Once the worker is done, the server sends its
+ * notifications and calls parallel_command_done() in tasks.cc, which
+ * runs the command over again if the worker had to abandon it.  Returns
+ * false if no worker could be started, in which case the caller should
+ * run the command itself.
+ */
+extern int run_command_in_parallel(task_queue tq, Objid player,
+				   const char *command, Parsed_Command * pc,
+				   Objid _this, db_verb_handle vh);
+
+#endif				/* !QUERY_H */
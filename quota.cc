@@ -23,7 +23,7 @@
 static const char *quota_name = "ownership_quota";
 
 int
-decr_quota(Objid player)
+decr_quota_by(Objid player, int count)
 {
     db_prop_handle h;
     Var v;
@@ -38,16 +38,22 @@ decr_quota(Objid player)
     if (v.type != TYPE_INT)
 	return 1;
 
-    if (v.v.num <= 0)
+    if (v.v.num < count)
 	return 0;
 
-    v.v.num--;
+    v.v.num -= count;
     db_set_property_value(h, v);
     return 1;
 }
 
+int
+decr_quota(Objid player)
+{
+    return decr_quota_by(player, 1);
+}
+
 void
-incr_quota(Objid player)
+incr_quota_by(Objid player, int count)
 {
     db_prop_handle h;
     Var v;
@@ -62,6 +68,12 @@ incr_quota(Objid player)
     if (v.type != TYPE_INT)
 	return;
 
-    v.v.num++;
+    v.v.num += count;
     db_set_property_value(h, v);
 }
+
+void
+incr_quota(Objid player)
+{
+    incr_quota_by(player, 1);
+}
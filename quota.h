@@ -18,4 +18,6 @@
 #include "structures.h"
 
 extern int decr_quota(Objid player);
+extern int decr_quota_by(Objid player, int count);
 extern void incr_quota(Objid player);
+extern void incr_quota_by(Objid player, int count);
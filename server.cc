@@ -39,11 +39,13 @@
 #include "garbage.h"
 #include "list.h"
 #include "log.h"
+#include "net_multi.h"
 #include "nettle/sha2.h"
 #include "network.h"
 #include "numbers.h"
 #include "options.h"
 #include "parser.h"
+#include "query.h"
 #include "quota.h"
 #include "random.h"
 #include "server.h"
@@ -62,6 +64,7 @@ extern "C" {
 
 static pid_t parent_pid;
 int in_child = 0;
+static int in_helper = 0;
 
 static const char *shutdown_message = 0;	/* shut down if non-zero */
 static int in_emergency_mode = 0;
@@ -76,11 +79,15 @@ static int checkpoint_finished = 0;	/* 1 = failure, 2 = success */
 
 typedef struct shandle {
     struct shandle *next, **prev;
+    struct shandle *hash_next;	/* in shandle_table */
+    struct shandle *wheel_next, **wheel_prev;	/* in check_wheel */
+    time_t check_time;		/* when it's due in check_wheel */
     network_handle nhandle;
     time_t connection_time;
     time_t last_activity_time;
     Objid player;
     Objid listener;
+    int connect_timeout;	/* cached; 0 means never */
     task_queue tasks;
     int disconnect_me;
     int outbound, binary;
@@ -89,12 +96,33 @@ typedef struct shandle {
 
 static shandle *all_shandles = 0;
 
+/* The same shandles, hashed on `player', for find_shandle().  The table
+ * doubles whenever it's fuller than one shandle per bucket.
+ */
+static shandle **shandle_table = 0;
+static unsigned shandle_table_size = 0, shandle_count = 0;
+
+#define SHANDLE_BUCKET(p)  ((unsigned) (p) & (shandle_table_size - 1))
+
+/* Shandles that main_loop() needs to look at in the future, because
+ * they might time out waiting for login, or right away, because they
+ * have been booted or their player recycled; see schedule_check().
+ * This is a hashed timing wheel of one-second slots: a shandle due at
+ * time T is in slot T % CHECK_WHEEL_SLOTS, and main_loop() only looks
+ * at the slots for the seconds that have gone by since it last looked.
+ */
+#define CHECK_WHEEL_SLOTS 1024
+
+static shandle *check_wheel[CHECK_WHEEL_SLOTS];
+static time_t check_wheel_time = 0;	/* the earliest slot not yet done */
+
 typedef struct slistener {
     struct slistener *next, **prev;
     network_listener nlistener;
     Objid oid;			/* listen(OID, DESC, PRINT_MESSAGES) */
     Var desc;
     int print_messages;
+    int connect_timeout;	/* cached; 0 means never */
     const char *name;
 } slistener;
 
@@ -115,18 +143,119 @@ static unsigned int pending_count = 0;
 /* used once when the server loads the database */
 static Var pending_list = new_list(0);
 
+static void
+hash_shandle(shandle * h)
+{
+    unsigned b;
+
+    if (shandle_count >= shandle_table_size) {
+	unsigned old_size = shandle_table_size, i;
+	shandle **old_table = shandle_table;
+
+	shandle_table_size = old_size ? old_size * 2 : 64;
+	shandle_table = (shandle **) mymalloc(shandle_table_size
+					      * sizeof(shandle *),
+					      M_NETWORK);
+	for (i = 0; i < shandle_table_size; i++)
+	    shandle_table[i] = 0;
+	for (i = 0; i < old_size; i++) {
+	    shandle *hh, *next;
+
+	    for (hh = old_table[i]; hh; hh = next) {
+		unsigned b = SHANDLE_BUCKET(hh->player);
+
+		next = hh->hash_next;
+		hh->hash_next = shandle_table[b];
+		shandle_table[b] = hh;
+	    }
+	}
+	if (old_table)
+	    myfree(old_table, M_NETWORK);
+    }
+
+    b = SHANDLE_BUCKET(h->player);
+    h->hash_next = shandle_table[b];
+    shandle_table[b] = h;
+    shandle_count++;
+}
+
+static void
+unhash_shandle(shandle * h)
+{
+    shandle **hh;
+
+    for (hh = &shandle_table[SHANDLE_BUCKET(h->player)]; *hh;
+	 hh = &(*hh)->hash_next)
+	if (*hh == h) {
+	    *hh = h->hash_next;
+	    shandle_count--;
+	    return;
+	}
+}
+
+/* Changes the player of H, keeping shandle_table up to date.  While two
+ * shandles share a player, find_shandle() returns the later one.
+ */
+static void
+set_shandle_player(shandle * h, Objid player)
+{
+    unhash_shandle(h);
+    h->player = player;
+    hash_shandle(h);
+}
+
+static void
+unschedule_check(shandle * h)
+{
+    if (h->wheel_prev) {
+	*(h->wheel_prev) = h->wheel_next;
+	if (h->wheel_next)
+	    h->wheel_next->wheel_prev = h->wheel_prev;
+	h->wheel_prev = 0;
+    }
+}
+
+/* Arranges for main_loop() to look at H at time WHEN, or as soon as
+ * possible if that's sooner.  A shandle is only ever due once; the
+ * earlier time wins.
+ */
+static void
+schedule_check(shandle * h, time_t when)
+{
+    shandle **slot;
+
+    if (when < check_wheel_time)
+	when = check_wheel_time;
+    if (h->wheel_prev) {
+	if (h->check_time <= when)
+	    return;
+	unschedule_check(h);
+    }
+    h->check_time = when;
+    slot = &check_wheel[when % CHECK_WHEEL_SLOTS];
+    h->wheel_next = *slot;
+    h->wheel_prev = slot;
+    if (*slot)
+	(*slot)->wheel_prev = &(h->wheel_next);
+    *slot = h;
+}
+
 static void
 free_shandle(shandle * h)
 {
     *(h->prev) = h->next;
     if (h->next)
 	h->next->prev = h->prev;
+    unhash_shandle(h);
+    unschedule_check(h);
 
     free_task_queue(h->tasks);
 
     myfree(h, M_NETWORK);
 }
 
+static int read_connect_timeout(Objid listener);
+
 static slistener *
 new_slistener(Objid oid, Var desc, int print_messages, enum error *ee)
 {
@@ -147,6 +276,7 @@ new_slistener(Objid oid, Var desc, int print_messages, enum error *ee)
     }
     l->oid = oid;
     l->print_messages = print_messages;
+    l->connect_timeout = read_connect_timeout(oid);
     l->name = str_dup(name);
 
     l->next = all_slisteners;
@@ -240,6 +370,8 @@ panic(const char *message)
 
     log_command_history();
 
+    if (in_helper)		/* We're a forked helper; just give up */
+	_exit(1);
     if (in_child) {		/* We're a forked checkpointer */
 	errlog("Child shutting down parent via USR1 signal\n");
 	kill(parent_pid, SIGUSR1);
@@ -274,6 +406,22 @@ fork_server(const char *subtask_name)
 	return FORK_PARENT;
 }
 
+pid_t
+fork_helper(const char *subtask_name)
+{
+    pid_t pid = fork();
+
+    if (pid < 0) {
+	Stream *s = new_stream(100);
+
+	stream_printf(s, "Forking %s", subtask_name);
+	log_perror(stream_contents(s));
+	free_stream(s);
+    } else if (pid == 0)
+	in_child = in_helper = 1;
+    return pid;
+}
+
 static void
 panic_signal(int sig)
 {
@@ -316,28 +464,28 @@ child_completed_signal(int sig)
     int status;
 
     /* Signal every child's completion to the exec subsystem and let
-     * it decide if it's relevant.
+     * it decide if it's relevant, then to the query workers.
      */
 #if HAVE_WAITPID
     while ((p = waitpid(-1, &status, WNOHANG)) > 0) {
-	if (!exec_complete(p, WEXITSTATUS(status)))
+	if (!exec_complete(p, WEXITSTATUS(status)) && !query_complete(p))
 	    checkpoint_child = p;
     }
 #else
 #if HAVE_WAIT3
     while ((p = wait3(&status, WNOHANG, 0)) > 0) {
-	if (!exec_complete(p, WEXITSTATUS(status)))
+	if (!exec_complete(p, WEXITSTATUS(status)) && !query_complete(p))
 	    checkpoint_child = p;
     }
 #else
 #if HAVE_WAIT2
     while ((p = wait2(&status, WNOHANG)) > 0) {
-	if (!exec_complete(p, WEXITSTATUS(status)))
+	if (!exec_complete(p, WEXITSTATUS(status)) && !query_complete(p))
 	    checkpoint_child = p;
     }
 #else
     p = wait(&status);
-    if (!exec_complete(p, WEXITSTATUS(status)))
+    if (!exec_complete(p, WEXITSTATUS(status)) && !query_complete(p))
 	checkpoint_child = p;
 #endif
 #endif
@@ -462,6 +610,109 @@ send_message(Objid listener, network_handle nh, const char *msg_name,...)
     va_end(args);
 }
 
+/* Returns the connect_timeout option for connections accepted by
+ * LISTENER, or 0 if they should never time out.
+ */
+static int
+read_connect_timeout(Objid listener)
+{
+    Var v;
+
+    if (get_server_option(listener, "connect_timeout", &v))
+	return v.type == TYPE_INT && v.v.num > 0 ? v.v.num : 0;
+    else
+	return DEFAULT_CONNECT_TIMEOUT;
+}
+
+/* Gets rid of H if it has timed out waiting for login, if its player
+ * has been recycled or if it has been booted.  Otherwise, arranges to
+ * look at it again when it might time out.
+ */
+static void
+check_connection(shandle * h, time_t now)
+{
+    int waiting = !h->outbound && h->connection_time == 0
+	&& h->connect_timeout > 0;
+
+    if (waiting && now - h->last_activity_time > h->connect_timeout) {
+	call_notifier(h->player, h->listener, "user_disconnected");
+	oklog("TIMEOUT: #%d on %s\n",
+	      h->player,
+	      network_connection_name(h->nhandle));
+	if (h->print_messages)
+	    send_message(h->listener, h->nhandle, "timeout_msg",
+			 "*** Timed-out waiting for login. ***",
+			 0);
+	network_close(h->nhandle);
+	free_shandle(h);
+    } else if (h->connection_time != 0 && !valid(h->player)) {
+	oklog("RECYCLED: #%d on %s\n",
+	      h->player,
+	      network_connection_name(h->nhandle));
+	if (h->print_messages)
+	    send_message(h->listener, h->nhandle,
+			 "recycle_msg", "*** Recycled ***", 0);
+	network_close(h->nhandle);
+	free_shandle(h);
+    } else if (h->disconnect_me) {
+	call_notifier(h->player, h->listener,
+		      "user_disconnected");
+	oklog("DISCONNECTED: %s on %s\n",
+	      object_name(h->player),
+	      network_connection_name(h->nhandle));
+	if (h->print_messages)
+	    send_message(h->listener, h->nhandle, "boot_msg",
+			 "*** Disconnected ***", 0);
+	network_close(h->nhandle);
+	free_shandle(h);
+    } else if (waiting)
+	schedule_check(h, h->last_activity_time + h->connect_timeout + 1);
+}
+
+/* Looks at every shandle that has come due in check_wheel since the
+ * last call.  Checking one connection can run tasks that schedule or
+ * get rid of others, so each slot is searched afresh after each check.
+ */
+static void
+check_connections(time_t now)
+{
+    time_t t = check_wheel_time;
+
+    if (now - t >= CHECK_WHEEL_SLOTS)
+	t = now - CHECK_WHEEL_SLOTS + 1;
+    for (; t <= now; t++) {
+	shandle **slot = &check_wheel[t % CHECK_WHEEL_SLOTS];
+	shandle *h;
+
+	for (;;) {
+	    for (h = *slot; h && h->check_time > now; h = h->wheel_next);
+	    if (!h)
+		break;
+	    unschedule_check(h);
+	    check_connection(h, now);
+	}
+    }
+    check_wheel_time = now;
+}
+
+void
+load_connection_options(void)
+{
+    slistener *l;
+    shandle *h;
+
+    for (l = all_slisteners; l; l = l->next)
+	l->connect_timeout = read_connect_timeout(l->oid);
+    for (h = all_shandles; h; h = h->next)
+	if (!h->outbound && h->connection_time == 0) {
+	    h->connect_timeout = read_connect_timeout(h->listener);
+	    unschedule_check(h);
+	    if (h->connect_timeout > 0)
+		schedule_check(h, (h->last_activity_time
+				   + h->connect_timeout + 1));
+	}
+}
+
 /* Queue an anonymous object for eventual recycling.  This is the
  * entry-point for anonymous objects that lose all references (see
  * utils.c), and for anonymous objects that the garbage collector
@@ -601,11 +852,31 @@ read_values_pending_finalization(void)
     return 1;
 }
 
+#if NETWORK_PROTOCOL != NP_SINGLE && NETWORK_STYLE == NS_BSD
+static void
+timers_readable(int fd, void *data)
+{
+    run_timers();
+}
+#endif
+
 static void
 main_loop(void)
 {
     int i;
 
+#if NETWORK_PROTOCOL != NP_SINGLE && NETWORK_STYLE == NS_BSD
+    /* Let timers wake the main loop rather than interrupt it.  (The SysV
+     * networking code still needs SIGALRM to break out of a connect().)
+     */
+    {
+	int fd = use_timer_fd();
+
+	if (fd >= 0)
+	    network_register_fd(fd, timers_readable, 0, 0);
+    }
+#endif
+
     /* First, queue anonymous objects */
     for (i = 1; i <= pending_list.v.list[0].v.num; i++) {
 	Var v;
@@ -643,7 +914,6 @@ main_loop(void)
 	 */
 	int task_seconds = next_task_start();
 	int seconds_left = task_seconds < 0 ? 2 : task_seconds;
-	shandle *h, *nexth;
 
 #ifdef ENABLE_GC
 	if (gc_run_called || gc_roots_count > GC_ROOTS_LIMIT
@@ -685,53 +955,7 @@ main_loop(void)
 	/* If a exec'd child process exited, deal with it here */
 	deal_with_child_exit();
 
-	{			/* Get rid of old un-logged-in or useless connections */
-	    int now = time(0);
-
-	    for (h = all_shandles; h; h = nexth) {
-		Var v;
-
-		nexth = h->next;
-
-		if (!h->outbound && h->connection_time == 0
-		    && (get_server_option(h->listener, "connect_timeout", &v)
-			? (v.type == TYPE_INT && v.v.num > 0
-			   && now - h->last_activity_time > v.v.num)
-			: (now - h->last_activity_time
-			   > DEFAULT_CONNECT_TIMEOUT))) {
-		    call_notifier(h->player, h->listener, "user_disconnected");
-		    oklog("TIMEOUT: #%d on %s\n",
-			  h->player,
-			  network_connection_name(h->nhandle));
-		    if (h->print_messages)
-			send_message(h->listener, h->nhandle, "timeout_msg",
-				     "*** Timed-out waiting for login. ***",
-				     0);
-		    network_close(h->nhandle);
-		    free_shandle(h);
-		} else if (h->connection_time != 0 && !valid(h->player)) {
-		    oklog("RECYCLED: #%d on %s\n",
-			  h->player,
-			  network_connection_name(h->nhandle));
-		    if (h->print_messages)
-			send_message(h->listener, h->nhandle,
-				     "recycle_msg", "*** Recycled ***", 0);
-		    network_close(h->nhandle);
-		    free_shandle(h);
-		} else if (h->disconnect_me) {
-		    call_notifier(h->player, h->listener,
-				  "user_disconnected");
-		    oklog("DISCONNECTED: %s on %s\n",
-			  object_name(h->player),
-			  network_connection_name(h->nhandle));
-		    if (h->print_messages)
-			send_message(h->listener, h->nhandle, "boot_msg",
-				     "*** Disconnected ***", 0);
-		    network_close(h->nhandle);
-		    free_shandle(h);
-		}
-	    }
-	}
+	check_connections(time(0));
     }
 
     applog(LOG_WARNING, "SHUTDOWN: %s\n", shutdown_message);
@@ -743,7 +967,9 @@ find_shandle(Objid player)
 {
     shandle *h;
 
-    for (h = all_shandles; h; h = h->next)
+    if (!shandle_table)
+	return 0;
+    for (h = shandle_table[SHANDLE_BUCKET(player)]; h; h = h->hash_next)
 	if (h->player == player)
 	    return h;
 
@@ -1299,7 +1525,14 @@ server_new_connection(server_listener sl, network_handle nh, int outbound)
     h->connection_time = 0;
     h->last_activity_time = time(0);
     h->player = next_unconnected_player--;
+    hash_shandle(h);
     h->listener = l ? l->oid : SYSTEM_OBJECT;
+    h->connect_timeout = (outbound ? 0
+			  : l ? l->connect_timeout
+			  : read_connect_timeout(SYSTEM_OBJECT));
+    h->wheel_prev = 0;
+    if (h->connect_timeout > 0)
+	schedule_check(h, h->last_activity_time + h->connect_timeout + 1);
     h->tasks = new_task_queue(h->player, h->listener);
     h->disconnect_me = 0;
     h->outbound = outbound;
@@ -1387,7 +1620,7 @@ player_connected_silent(Objid old_id, Objid new_id, int is_newly_created)
     if (!new_h)
 	panic("Non-existent shandle connected");
 
-    new_h->player = new_id;
+    set_shandle_player(new_h, new_id);
     new_h->connection_time = time(0);
 
     if (existing_h) {
@@ -1419,7 +1652,7 @@ player_connected(Objid old_id, Objid new_id, int is_newly_created)
     if (!new_h)
 	panic("Non-existent shandle connected");
 
-    new_h->player = new_id;
+    set_shandle_player(new_h, new_id);
     new_h->connection_time = time(0);
 
     if (existing_h) {
@@ -1484,8 +1717,13 @@ is_player_connected(Objid player)
 void
 notify(Objid player, const char *message)
 {
-    shandle *h = find_shandle(player);
+    shandle *h;
 
+    if (in_parallel_worker) {
+	parallel_notify(player, message);
+	return;
+    }
+    h = find_shandle(player);
     if (h && !h->disconnect_me)
 	network_send_line(h->nhandle, message, 1);
     else if (in_emergency_mode)
@@ -1497,8 +1735,19 @@ boot_player(Objid player)
 {
     shandle *h = find_shandle(player);
 
-    if (h)
+    if (h) {
 	h->disconnect_me = 1;
+	schedule_check(h, 0);
+    }
+}
+
+void
+recheck_connection(Objid player)
+{
+    shandle *h = find_shandle(player);
+
+    if (h)
+	schedule_check(h, 0);
 }
 
 void
@@ -1758,6 +2007,7 @@ bf_renumber(Var arglist, Byte next, void *vdata, Objid progr)
 
     r.type = TYPE_OBJ;
     r.v.obj = db_renumber_object(o);
+    recheck_connection(o);
     return make_var_pack(r);
 }
 
@@ -2017,7 +2267,12 @@ bf_notify(Var arglist, Byte next, void *vdata, Objid progr)
 	return make_error_pack(E_PERM);
     }
     r.type = TYPE_INT;
-    if (h && !h->disconnect_me) {
+    if (in_parallel_worker) {
+	if (h && h->binary)
+	    abandon_parallel_call("notify");
+	parallel_notify(conn, line);
+	r.v.num = 1;
+    } else if (h && !h->disconnect_me) {
 	if (h->binary) {
 	    int length;
 
@@ -2038,6 +2293,74 @@ bf_notify(Var arglist, Byte next, void *vdata, Objid progr)
     return make_var_pack(r);
 }
 
+static package
+bf_notify_many(Var arglist, Byte next, void *vdata, Objid progr)
+{				/* (players, string [, no_flush]) */
+    Var players = arglist.v.list[1];
+    const char *line = arglist.v.list[2].v.str;
+    int no_flush = (arglist.v.list[0].v.num > 2
+		    ? is_true(arglist.v.list[3])
+		    : 0);
+    int count = players.v.list[0].v.num;
+    int wizard = is_wizard(progr);
+    network_handle *text, *binary;
+    int ntext = 0, nbinary = 0;
+    int i, notified = 0;
+    Var r;
+
+    /* Check everything before sending anything. */
+    for (i = 1; i <= count; i++) {
+	if (players.v.list[i].type != TYPE_OBJ) {
+	    free_var(arglist);
+	    return make_error_pack(E_TYPE);
+	}
+	if (!wizard && players.v.list[i].v.obj != progr) {
+	    free_var(arglist);
+	    return make_error_pack(E_PERM);
+	}
+    }
+
+    text = (network_handle *) mymalloc(2 * count * sizeof(network_handle) + 1,
+				       M_NETWORK);
+    binary = text + count;
+    for (i = 1; i <= count; i++) {
+	Objid conn = players.v.list[i].v.obj;
+	shandle *h = find_shandle(conn);
+
+	if (h && !h->disconnect_me) {
+	    if (h->binary)
+		binary[nbinary++] = h->nhandle;
+	    else
+		text[ntext++] = h->nhandle;
+	} else {
+	    if (in_emergency_mode)
+		emergency_notify(conn, line);
+	    notified++;
+	}
+    }
+
+    if (nbinary) {
+	int length;
+	const char *bytes = binary_to_raw_bytes(line, &length);
+
+	if (!bytes) {
+	    myfree(text, M_NETWORK);
+	    free_var(arglist);
+	    return make_error_pack(E_INVARG);
+	}
+	notified += network_send_to_many(binary, nbinary, bytes, length,
+					 0, !no_flush);
+    }
+    notified += network_send_to_many(text, ntext, line, strlen(line),
+				     1, !no_flush);
+    myfree(text, M_NETWORK);
+
+    r.type = TYPE_INT;
+    r.v.num = notified;
+    free_var(arglist);
+    return make_var_pack(r);
+}
+
 static package
 bf_boot_player(Var arglist, Byte next, void *vdata, Objid progr)
 {				/* (object) */
@@ -2234,6 +2557,8 @@ register_server(void)
     register_function("idle_seconds", 1, 1, bf_idle_seconds, TYPE_OBJ);
     register_function("connection_name", 1, 1, bf_connection_name, TYPE_OBJ);
     register_function("notify", 2, 3, bf_notify, TYPE_OBJ, TYPE_STR, TYPE_ANY);
+    register_function("notify_many", 2, 3, bf_notify_many,
+		      TYPE_LIST, TYPE_STR, TYPE_ANY);
     register_function("boot_player", 1, 1, bf_boot_player, TYPE_OBJ);
     register_function("set_connection_option", 3, 3, bf_set_connection_option,
 		      TYPE_OBJ, TYPE_STR, TYPE_ANY);
@@ -27,6 +27,7 @@
 #define Server_H 1
 
 #include "my-stdio.h"
+#include "my-types.h"
 
 #include "config.h"
 
@@ -209,7 +210,51 @@ extern int read_values_pending_finalization(void);
 								\
   DEFINE( SVO_MAX_CONCAT_CATCHABLE, max_concat_catchable,	\
 	  flag, 0, /* already canonical */			\
-	  )
+	  )							\
+								\
+  DEFINE( SVO_TAIL_CALLS, tail_calls,				\
+	  flag, 0, /* already canonical */			\
+	  )							\
+								\
+  DEFINE( SVO_JIT, jit,						\
+	  flag, 0, /* already canonical */			\
+	  )							\
+								\
+  DEFINE( SVO_DESCENDANTS_CACHE_THRESHOLD, descendants_cache_threshold, \
+								\
+	  int, DEFAULT_DESCENDANTS_CACHE_THRESHOLD,		\
+	 _STATEMENT({						\
+	     if (value < 0)					\
+		 value = 0;					\
+	   }))							\
+								\
+  DEFINE( SVO_COMPACT_SUSPENDED_AFTER, compact_suspended_after,	\
+	  int, DEFAULT_COMPACT_SUSPENDED_AFTER,			\
+	 _STATEMENT({						\
+	     if (value < 0)					\
+		 value = -1;					\
+	   }))							\
+								\
+  DEFINE( SVO_MAX_CREATE_MANY, max_create_many,		\
+	  int, DEFAULT_MAX_CREATE_MANY,				\
+	 _STATEMENT({						\
+	     if (value < 0)					\
+		 value = 0;					\
+	   }))							\
+								\
+  DEFINE( SVO_MAX_EXEC_PROCESSES, max_exec_processes,		\
+	  int, EXEC_MAX_PROCESSES,				\
+	 _STATEMENT({						\
+	     if (value < 0)					\
+		 value = 0;					\
+	   }))							\
+								\
+  DEFINE( SVO_BG_QUANTUM, bg_quantum,				\
+	  int, DEFAULT_BG_QUANTUM,				\
+	 _STATEMENT({						\
+	     if (value < 0)					\
+		 value = 0;					\
+	   }))
 
 /* List of all category (2) and (3) cached server options */
 enum Server_Option {
@@ -249,6 +294,11 @@ enum Fork_Result {
 };
 extern enum Fork_Result fork_server(const char *subtask_name);
 
+/* Forks a short-lived helper process, returning as fork() does.  A
+ * panic in the helper ends only the helper.
+ */
+extern pid_t fork_helper(const char *subtask_name);
+
 extern void player_connected_silent(Objid old_id, Objid new_id,
 				    int is_newly_created);
 extern void player_connected(Objid old_id, Objid new_id,
@@ -256,6 +306,16 @@ extern void player_connected(Objid old_id, Objid new_id,
 extern int is_player_connected(Objid player);
 extern void notify(Objid player, const char *message);
 extern void boot_player(Objid player);
+extern void recheck_connection(Objid player);
+				/* Arranges for the connection to PLAYER, if
+				 * any, to be closed between tasks if PLAYER
+				 * is no longer valid, e.g., after recycle().
+				 */
+extern void load_connection_options(void);
+				/* Rereads the connection options that are
+				 * cached, such as connect_timeout; called
+				 * from load_server_options().
+				 */
 
 extern void write_active_connections(void);
 extern int read_active_connections(void);
@@ -36,6 +36,7 @@
 #include "options.h"
 #include "parse_cmd.h"
 #include "parser.h"
+#include "query.h"
 #include "random.h"
 #include "server.h"
 #include "storage.h"
@@ -148,6 +149,7 @@ typedef struct tqueue {
      * If an unconnected queue becomes empty, it is destroyed.
      */
     struct tqueue *next, **prev;	/* prev only valid on idle_tqueues */
+    struct tqueue *hash_next;	/* in tqueue_table */
     Objid player;
     Objid handler;
     int connected;
@@ -189,6 +191,7 @@ typedef struct tqueue {
     int disable_oob:1;		/* treat all input lines as inband */
     int reading:1;		/* some task is blocked on read() */
     int parsing:1;		/* some task is blocked on read_http() */
+    int parallel:1;		/* a command is running in a worker */
     int icmds:8;		/* which of .program/PREFIX/... are enabled */
 
     /* Once a `http_parsing_state' is allocated and assigned to a task
@@ -214,6 +217,14 @@ typedef struct ext_queue {
 Var current_local;
 int current_task_id;
 static tqueue *idle_tqueues = 0, *active_tqueues = 0;
+
+/* All tqueues, active or idle, hashed on `player', for find_tqueue().
+ * The table doubles whenever it's fuller than one tqueue per bucket.
+ */
+static tqueue **tqueue_table = 0;
+static unsigned tqueue_table_size = 0, tqueue_count = 0;
+
+#define TQUEUE_BUCKET(p)  ((unsigned) (p) & (tqueue_table_size - 1))
 static task *waiting_tasks = 0;	/* forked and suspended tasks */
 static ext_queue *external_queues = 0;
 
@@ -230,6 +241,8 @@ struct qcl_data {
 static task_enum_action
 counting_closure(vm the_vm, const char *status, void *data);
 
+struct queued_filter;
+
 static task_enum_action
 listing_closure(vm the_vm, const char *status, void *data);
 
@@ -397,6 +410,65 @@ ensure_usage(tqueue * tq)
     }
 }
 
+static void
+hash_tqueue(tqueue * tq)
+{
+    unsigned b;
+
+    if (tqueue_count >= tqueue_table_size) {
+	unsigned old_size = tqueue_table_size, i;
+	tqueue **old_table = tqueue_table;
+
+	tqueue_table_size = old_size ? old_size * 2 : 64;
+	tqueue_table = (tqueue **) mymalloc(tqueue_table_size
+					    * sizeof(tqueue *), M_TASK);
+	for (i = 0; i < tqueue_table_size; i++)
+	    tqueue_table[i] = 0;
+	for (i = 0; i < old_size; i++) {
+	    tqueue *t, *next;
+
+	    for (t = old_table[i]; t; t = next) {
+		b = TQUEUE_BUCKET(t->player);
+		next = t->hash_next;
+		t->hash_next = tqueue_table[b];
+		tqueue_table[b] = t;
+	    }
+	}
+	if (old_table)
+	    myfree(old_table, M_TASK);
+    }
+
+    b = TQUEUE_BUCKET(tq->player);
+    tq->hash_next = tqueue_table[b];
+    tqueue_table[b] = tq;
+    tqueue_count++;
+}
+
+static void
+unhash_tqueue(tqueue * tq)
+{
+    tqueue **t;
+
+    for (t = &tqueue_table[TQUEUE_BUCKET(tq->player)]; *t;
+	 t = &(*t)->hash_next)
+	if (*t == tq) {
+	    *t = tq->hash_next;
+	    tqueue_count--;
+	    return;
+	}
+}
+
+/* Changes the player of TQ, keeping tqueue_table up to date.  While two
+ * tqueues share a player, find_tqueue() returns the later one.
+ */
+static void
+set_tqueue_player(tqueue * tq, Objid player)
+{
+    unhash_tqueue(tq);
+    tq->player = player;
+    hash_tqueue(tq);
+}
+
 char *
 default_flush_command(void)
 {
@@ -410,13 +482,10 @@ find_tqueue(Objid player, int create_if_not_found)
 {
     tqueue *tq;
 
-    for (tq = active_tqueues; tq; tq = tq->next)
-	if (tq->player == player)
-	    return tq;
-
-    for (tq = idle_tqueues; tq; tq = tq->next)
-	if (tq->player == player)
-	    return tq;
+    if (tqueue_table)
+	for (tq = tqueue_table[TQUEUE_BUCKET(player)]; tq; tq = tq->hash_next)
+	    if (tq->player == player)
+		return tq;
 
     if (!create_if_not_found)
 	return 0;
@@ -426,6 +495,7 @@ find_tqueue(Objid player, int create_if_not_found)
     deactivate_tqueue(tq);
 
     tq->player = player;
+    hash_tqueue(tq);
     tq->handler = 0;
     tq->connected = 0;
 
@@ -442,6 +512,7 @@ find_tqueue(Objid player, int create_if_not_found)
     tq->reading = 0;
     tq->parsing = 0;
     tq->hold_input = 0;
+    tq->parallel = 0;
     tq->disable_oob = 0;
     tq->icmds = ICMD_ALL_CMDS;
     tq->num_bg_tasks = 0;
@@ -475,6 +546,7 @@ free_tqueue(tqueue * tq)
     *(tq->prev) = tq->next;
     if (tq->next)
 	tq->next->prev = tq->prev;
+    unhash_tqueue(tq);
 
     myfree(tq, M_TASK);
 }
@@ -738,6 +810,29 @@ find_verb_on(Objid oid, Parsed_Command * pc, db_verb_handle * vh)
     return vh->ptr != 0;
 }
 
+/* Finds the verb to run for the command PC typed by PLAYER, on one of
+ * the objects involved, or else a `huh' verb.
+ */
+static int
+find_command_verb(Objid player, Parsed_Command * pc, Objid * _this,
+		  db_verb_handle * vh)
+{
+    Objid location = valid(player) ? db_object_location(player) : NOTHING;
+
+    return (find_verb_on(*_this = player, pc, vh)
+	    || find_verb_on(*_this = location, pc, vh)
+	    || find_verb_on(*_this = pc->dobj, pc, vh)
+	    || find_verb_on(*_this = pc->iobj, pc, vh)
+	    || (valid(location)
+		&& !server_int_option("player_huh", PLAYER_HUH)
+		&& (*vh = db_find_callable_verb(new_obj(*_this = location), "huh"),
+		    vh->ptr))
+	    || (valid(player)
+		&& server_int_option("player_huh", PLAYER_HUH)
+		&& (*vh = db_find_callable_verb(new_obj(*_this = player), "huh"),
+		    vh->ptr)));
+}
+
 static int
 do_intrinsic_command(tqueue * tq, Parsed_Command * pc)
 {
@@ -751,10 +846,10 @@ do_intrinsic_command(tqueue * tq, Parsed_Command * pc)
     case ICMD_PROGRAM:
 	if (!is_programmer(tq->player))
 	    return 0;
-	if (pc->args.v.list[0].v.num != 1)
+	if (pc->argc != 1)
 	    notify(tq->player, "Usage:  .program object:verb");
 	else	
-	    start_programming(tq, (char *) pc->args.v.list[1].v.str);
+	    start_programming(tq, pc->argv[0]);
 	break;
     case ICMD_PREFIX:	
     case ICMD_OUTPUTPREFIX:
@@ -789,15 +884,12 @@ do_command_task(tqueue * tq, char *command)
 	else
 	    stream_printf(tq->program_stream, "%s\n", command);
     } else {
-	Parsed_Command *pc = parse_command(command, tq->player);
+	Parsed_Command parsed, *pc = &parsed;
 
-	if (!pc)
+	if (!parse_command(command, tq->player, pc))
 	    return 0;
 
 	if (!do_intrinsic_command(tq, pc)) {
-	    Objid location = (valid(tq->player)
-			      ? db_object_location(tq->player)
-			      : NOTHING);
 	    Objid _this;
 	    db_verb_handle vh;
 	    Var result, args;
@@ -813,25 +905,23 @@ do_command_task(tqueue * tq, char *command)
 		!= OUTCOME_DONE
 		|| is_true(result)) {
 		/* Do nothing more; we assume :do_command handled it. */
-	    } else if (find_verb_on(_this = tq->player, pc, &vh)
-		       || find_verb_on(_this = location, pc, &vh)
-		       || find_verb_on(_this = pc->dobj, pc, &vh)
-		       || find_verb_on(_this = pc->iobj, pc, &vh)
-		       || (valid(location)
-			   && !server_int_option("player_huh", PLAYER_HUH)
-			   && (vh = db_find_callable_verb(new_obj(_this = location), "huh"),
-			       vh.ptr))
-		       || (valid(tq->player)
-			   && server_int_option("player_huh", PLAYER_HUH)
-			   && (vh = db_find_callable_verb(new_obj(_this = tq->player), "huh"),
-			       vh.ptr))) {
-		do_input_task(tq->player, pc, _this, vh);
+	    } else if (find_command_verb(tq->player, pc, &_this, &vh)) {
+		task_queue q;
+
+		q.ptr = tq;
+		if ((db_verb_flags(vh) & VF_PARALLEL)
+		    && run_command_in_parallel(q, tq->player, command,
+					       pc, _this, vh))
+		    /* The rest waits for parallel_command_done(). */
+		    tq->parallel = 1;
+		else
+		    do_input_task(tq->player, pc, _this, vh);
 	    } else {
 		notify(tq->player, "I couldn't understand that.");
 		tq->last_input_task_id = 0;
 	    }
 
-	    if (tq->output_suffix)
+	    if (tq->output_suffix && !tq->parallel)
 		notify(tq->player, tq->output_suffix);
 
 	    /* clean up after `run_server_task_setting_id' */
@@ -846,6 +936,42 @@ do_command_task(tqueue * tq, char *command)
     return 1;
 }
 
+/* Called once a command handed to a worker by do_command_task() is
+ * over, after its output has been sent.  If the worker had to abandon
+ * it, it's run over again here, from the top, since the database may
+ * have changed in the meantime; the input that came in behind it has
+ * been waiting all along.
+ */
+void
+parallel_command_done(task_queue q, const char *command, int finished)
+{
+    tqueue *tq = (tqueue *) q.ptr;
+
+    if (!finished && tq->player >= 0) {
+	Parsed_Command parsed, *pc = &parsed;
+	Objid _this;
+	db_verb_handle vh;
+
+	current_task_id = tq->last_input_task_id = new_task_id();
+	current_local = new_map();
+	if (parse_command(command, tq->player, pc)) {
+	    if (find_command_verb(tq->player, pc, &_this, &vh))
+		do_input_task(tq->player, pc, _this, vh);
+	    else
+		notify(tq->player, "I couldn't understand that.");
+	    free_parsed_command(pc);
+	}
+	current_task_id = -1;
+	free_var(current_local);
+    }
+
+    tq->parallel = 0;
+    if (tq->output_suffix)
+	notify(tq->player, tq->output_suffix);
+    if (tq->first_input || tq->first_bg)
+	ensure_usage(tq);
+}
+
 static int
 do_login_task(tqueue * tq, char *command)
 {
@@ -871,7 +997,7 @@ do_login_task(tqueue * tq, char *command)
 	tqueue *dead_tq = find_tqueue(new_player, 0);
 	task *t;
 
-	tq->player = new_player;
+	set_tqueue_player(tq, new_player);
 	if (tq->num_bg_tasks) {
 	    /* Cute; this un-logged-in connection has some queued tasks!
 	     * Must copy them over to their own tqueue for accounting...
@@ -892,7 +1018,7 @@ do_login_task(tqueue * tq, char *command)
 	    while ((t = dequeue_bg_task(dead_tq)) != 0) {
 		enqueue_bg_task(tq, t);
 	    }
-	    dead_tq->player = NOTHING;	/* it'll be freed by run_ready_tasks */
+	    set_tqueue_player(dead_tq, NOTHING);	/* it'll be freed by run_ready_tasks */
 	    dead_tq->num_bg_tasks = 0;
 	}
 	/* clean up after `run_server_task_setting_id' before calling
@@ -1062,7 +1188,7 @@ enqueue_input_task(tqueue * tq, const char *input, int at_front, int binary)
     }
 
     /* Anything to do with this line? */
-    if (!tq->hold_input || tq->reading
+    if ((!tq->hold_input && !tq->parallel) || tq->reading
 	|| (!tq->disable_oob && t->kind == TASK_OOB))
 	ensure_usage(tq);
 
@@ -1224,12 +1350,14 @@ enqueue_forked_task2(activation a, int f_index, unsigned after_seconds, int vid)
     a.verb = str_ref(a.verb);
     a.verbname = str_ref(a.verbname);
     a.prog = program_ref(a.prog);
+    a.tail_caller = 0;
     if (vid >= 0) {
 	free_var(a.rt_env[vid]);
 	a.rt_env[vid].type = TYPE_INT;
 	a.rt_env[vid].v.num = id;
     }
     rt_env = copy_rt_env(a.rt_env, a.prog->num_var_names);
+    fill_in_inherited_vars(rt_env);
     enqueue_forked(a.prog, a, rt_env, f_index, time(0) + after_seconds, id);
 
     return E_NONE;
@@ -1240,7 +1368,7 @@ enqueue_suspended_task(vm the_vm, void *data)
 {
     int after_seconds = *((int *) data);
     int now = time(0);
-    int when;
+    int when, compact_after;
     task *t;
 
     if (check_user_task_limit(progr_of_cur_verb(the_vm))) {
@@ -1255,6 +1383,10 @@ enqueue_suspended_task(vm the_vm, void *data)
 	t->t.suspended.start_time = when;
 	t->t.suspended.value = zero;
 
+	compact_after = server_int_option_cached(SVO_COMPACT_SUSPENDED_AFTER);
+	if (compact_after >= 0 && when - now >= compact_after)
+	    compact_vm(the_vm);
+
 	enqueue_waiting(t);
 	return E_NONE;
     } else
@@ -1605,10 +1737,11 @@ run_ready_tasks(void)
 
 	    /* Loop over tasks, looking for runnable one */
 	    while (!did_one) {
-		t = dequeue_input_task(tq, ((tq->hold_input && !tq->reading)
+		t = dequeue_input_task(tq, (tq->parallel
+					    || (tq->hold_input && !tq->reading)
 					    ? DQ_OOB
 					    : DQ_FIRST));
-		if (!t)
+		if (!t && !tq->parallel)
 		    t = dequeue_bg_task(tq);
 		if (!t)
 		    break;
@@ -1749,7 +1882,8 @@ run_ready_tasks(void)
     for (tq = idle_tqueues; tq; tq = next_tq) {
 	next_tq = tq->next;
 
-	if (!tq->connected && !tq->first_input && tq->num_bg_tasks == 0)
+	if (!tq->connected && !tq->first_input && tq->num_bg_tasks == 0
+	    && !tq->parallel)
 	    free_tqueue(tq);
     }
 }
@@ -2222,6 +2356,11 @@ activation_bytes(activation * ap)
     total += value_bytes(ap->temp) - sizeof(Var);
     total += memo_strlen(ap->verb) + 1;
     total += memo_strlen(ap->verbname) + 1;
+    if (ap->tail_caller) {
+	total += sizeof(activation);
+	total += memo_strlen(ap->tail_caller->verb) + 1;
+	total += memo_strlen(ap->tail_caller->verbname) + 1;
+    }
     return total;
 }
 
@@ -2343,123 +2482,226 @@ counting_closure(vm the_vm, const char *status, void *data)
 }
 
 static task_enum_action
-listing_closure(vm the_vm, const char *status, void *data)
+writing_closure(vm the_vm, const char *status, void *data)
 {
     struct qcl_data *qdata = (struct qcl_data *)data;
-    Var list;
 
     if (qdata->show_all || qdata->progr == progr_of_cur_verb(the_vm)) {
-	list = list_for_vm(the_vm, qdata->progr);
-	list.v.list[2].type = TYPE_STR;
-	list.v.list[2].v.str = str_dup(status);
-	qdata->tasks.v.list[qdata->i++] = list;
+	dbio_printf("%d %s\n", the_vm->task_id, status);
+	write_vm(the_vm);
     }
 
     return TEA_CONTINUE;
 }
 
+/* Which tasks queued_tasks() is to list, and how far it has got.  The
+ * tasks are scanned twice, once to count the ones to list and once to
+ * list them, so only the tasks that are actually listed cost more than
+ * a few comparisons.
+ */
+struct queued_filter {
+    Objid progr;
+    int show_all;
+    int by_programmer;
+    Objid programmer;
+    Var verb_loc;		/* TYPE_NONE to match any */
+    int min_id, max_id;
+    int offset, limit;		/* limit < 0 for no limit */
+    int count_only;
+    int matched;		/* tasks that passed the filters so far */
+    int listing;		/* false while counting */
+    Var tasks;
+    int i;
+};
+
+/* Returns true if the task with the given ID, owner and verb location
+ * passes the filters in QF and falls within the page it asks for.
+ */
+static int
+queued_task_wanted(struct queued_filter *qf, int id, Objid owner, Var vloc)
+{
+    if ((!qf->show_all && owner != qf->progr)
+	|| (qf->by_programmer && owner != qf->programmer)
+	|| id < qf->min_id || id > qf->max_id
+	|| (qf->verb_loc.type != TYPE_NONE
+	    && !equality(vloc, qf->verb_loc, 0)))
+	return 0;
+
+    qf->matched++;
+    if (qf->count_only || qf->matched <= qf->offset
+	|| (qf->limit >= 0 && qf->matched > qf->offset + qf->limit))
+	return 0;
+    if (!qf->listing) {
+	qf->i++;
+	return 0;
+    }
+    return 1;
+}
+
+static Var
+vloc_of_vm(vm the_vm)
+{
+    return the_vm->activ_stack[the_vm->top_activ_stack].vloc;
+}
+
 static task_enum_action
-writing_closure(vm the_vm, const char *status, void *data)
+listing_closure(vm the_vm, const char *status, void *data)
 {
-    struct qcl_data *qdata = (struct qcl_data *)data;
+    struct queued_filter *qf = (struct queued_filter *)data;
+    Var list;
 
-    if (qdata->show_all || qdata->progr == progr_of_cur_verb(the_vm)) {
-	dbio_printf("%d %s\n", the_vm->task_id, status);
-	write_vm(the_vm);
+    if (queued_task_wanted(qf, the_vm->task_id, progr_of_cur_verb(the_vm),
+			   vloc_of_vm(the_vm))) {
+	list = list_for_vm(the_vm, qf->progr);
+	list.v.list[2].type = TYPE_STR;
+	list.v.list[2].v.str = str_dup(status);
+	qf->tasks.v.list[qf->i++] = list;
     }
 
     return TEA_CONTINUE;
 }
 
-static package
-bf_queued_tasks(Var arglist, Byte next, void *vdata, Objid progr)
+static void
+scan_queued_tasks(struct queued_filter *qf)
 {
-    Var tasks;
-    int show_all = is_wizard(progr);
     tqueue *tq;
     task *t;
-    int i, count = 0;
     ext_queue *eq;
-    struct qcl_data qdata;
-
-    for (tq = idle_tqueues; tq; tq = tq->next) {
-	if (tq->reading && (show_all || tq->player == progr))
-	    count++;
-    }
-
-    for (tq = active_tqueues; tq; tq = tq->next) {
-	if (tq->reading && (show_all || tq->player == progr))
-	    count++;
+    int i;
 
-	for (t = tq->first_bg; t; t = t->next)
-	    if (show_all
-		|| (t->kind == TASK_FORKED
-		    ? t->t.forked.a.progr == progr
-		    : progr_of_cur_verb(t->t.suspended.the_vm) == progr))
-		count++;
-    }
+    for (i = 0; i < 2; i++)
+	for (tq = i == 0 ? idle_tqueues : active_tqueues; tq; tq = tq->next) {
+	    if (tq->reading
+		&& queued_task_wanted(qf, tq->reading_vm->task_id, tq->player,
+				      vloc_of_vm(tq->reading_vm)))
+		qf->tasks.v.list[qf->i++]
+		    = list_for_reading_task(tq->player, tq->reading_vm,
+					    qf->progr);
+	    if (i == 0)
+		continue;
+	    for (t = tq->first_bg; t; t = t->next)
+		if (t->kind == TASK_FORKED) {
+		    if (queued_task_wanted(qf, t->t.forked.id,
+					   t->t.forked.a.progr,
+					   t->t.forked.a.vloc))
+			qf->tasks.v.list[qf->i++]
+			    = list_for_forked_task(t->t.forked, qf->progr);
+		} else if (t->kind == TASK_SUSPENDED) {
+		    vm the_vm = t->t.suspended.the_vm;
+
+		    if (queued_task_wanted(qf, the_vm->task_id,
+					   progr_of_cur_verb(the_vm),
+					   vloc_of_vm(the_vm)))
+			qf->tasks.v.list[qf->i++]
+			    = list_for_suspended_task(t->t.suspended,
+						      qf->progr);
+		}
+	}
 
     for (t = waiting_tasks; t; t = t->next)
-	if (show_all
-	    || (t->kind == TASK_FORKED
-		? t->t.forked.a.progr == progr
-		: progr_of_cur_verb(t->t.suspended.the_vm) == progr))
-	    count++;
+	if (t->kind == TASK_FORKED) {
+	    if (queued_task_wanted(qf, t->t.forked.id, t->t.forked.a.progr,
+				   t->t.forked.a.vloc))
+		qf->tasks.v.list[qf->i++]
+		    = list_for_forked_task(t->t.forked, qf->progr);
+	} else if (t->kind == TASK_SUSPENDED) {
+	    vm the_vm = t->t.suspended.the_vm;
+
+	    if (queued_task_wanted(qf, the_vm->task_id,
+				   progr_of_cur_verb(the_vm),
+				   vloc_of_vm(the_vm)))
+		qf->tasks.v.list[qf->i++]
+		    = list_for_suspended_task(t->t.suspended, qf->progr);
+	}
 
-    qdata.progr = progr;
-    qdata.show_all = show_all;
-    qdata.i = count;
     for (eq = external_queues; eq; eq = eq->next)
-	(*eq->enumerator) (counting_closure, &qdata);
-    count = qdata.i;
+	(*eq->enumerator) (listing_closure, qf);
+}
 
-    tasks = new_list(count);
-    i = 1;
+static int
+parse_queued_filter(Var key, Var value, void *data, int first)
+{
+    struct queued_filter *qf = (struct queued_filter *)data;
+    const char *name;
+    int *field;
 
-    for (tq = idle_tqueues; tq; tq = tq->next) {
-	if (tq->reading && (show_all || tq->player == progr))
-	    tasks.v.list[i++] = list_for_reading_task(tq->player,
-						      tq->reading_vm,
-						      progr);
+    if (key.type != TYPE_STR)
+	return E_INVARG;
+    name = key.v.str;
+    if (!mystrcasecmp(name, "verb_loc")) {
+	qf->verb_loc = value;
+	return 0;
+    } else if (!mystrcasecmp(name, "count")) {
+	qf->count_only = is_true(value);
+	return 0;
+    } else if (!mystrcasecmp(name, "programmer")) {
+	if (value.type != TYPE_OBJ)
+	    return E_TYPE;
+	qf->by_programmer = 1;
+	qf->programmer = value.v.obj;
+	return 0;
     }
+    if (!mystrcasecmp(name, "min_id"))
+	field = &qf->min_id;
+    else if (!mystrcasecmp(name, "max_id"))
+	field = &qf->max_id;
+    else if (!mystrcasecmp(name, "offset"))
+	field = &qf->offset;
+    else if (!mystrcasecmp(name, "limit"))
+	field = &qf->limit;
+    else
+	return E_INVARG;
+    if (value.type != TYPE_INT)
+	return E_TYPE;
+    if (value.v.num < 0 && field != &qf->min_id && field != &qf->max_id)
+	return E_INVARG;
+    *field = value.v.num;
+    return 0;
+}
 
-    for (tq = active_tqueues; tq; tq = tq->next) {
-	if (tq->reading && (show_all || tq->player == progr))
-	    tasks.v.list[i++] = list_for_reading_task(tq->player,
-						      tq->reading_vm,
-						      progr);
+static package
+bf_queued_tasks(Var arglist, Byte next, void *vdata, Objid progr)
+{				/* ([filters]) */
+    struct queued_filter qf;
+    Var r;
 
-	for (t = tq->first_bg; t; t = t->next)
-	    if (t->kind == TASK_FORKED && (show_all
-					|| t->t.forked.a.progr == progr))
-		tasks.v.list[i++] = list_for_forked_task(t->t.forked,
-						         progr);
-	    else if (t->kind == TASK_SUSPENDED
-		     && (show_all
-		   || progr_of_cur_verb(t->t.suspended.the_vm) == progr))
-		tasks.v.list[i++] = list_for_suspended_task(t->t.suspended,
-						            progr);
-    }
-
-    for (t = waiting_tasks; t; t = t->next) {
-	if (t->kind == TASK_FORKED && (show_all ||
-				       t->t.forked.a.progr == progr))
-	    tasks.v.list[i++] = list_for_forked_task(t->t.forked,
-						     progr);
-	else if (t->kind == TASK_SUSPENDED
-		 && (progr_of_cur_verb(t->t.suspended.the_vm) == progr
-		     || show_all))
-	    tasks.v.list[i++] = list_for_suspended_task(t->t.suspended,
-						        progr);
+    qf.progr = progr;
+    qf.show_all = is_wizard(progr);
+    qf.by_programmer = 0;
+    qf.verb_loc.type = TYPE_NONE;
+    qf.min_id = INT32_MIN;
+    qf.max_id = INT32_MAX;
+    qf.offset = 0;
+    qf.limit = -1;
+    qf.count_only = 0;
+
+    if (arglist.v.list[0].v.num > 0) {
+	enum error e = (enum error) mapforeach(arglist.v.list[1],
+					       parse_queued_filter, &qf);
+
+	if (e != E_NONE) {
+	    free_var(arglist);
+	    return make_error_pack(e);
+	}
     }
 
-    qdata.tasks = tasks;
-    qdata.i = i;
-    for (eq = external_queues; eq; eq = eq->next)
-	(*eq->enumerator) (listing_closure, &qdata);
+    qf.matched = qf.i = 0;
+    qf.listing = 0;
+    scan_queued_tasks(&qf);
+
+    if (qf.count_only) {
+	r.type = TYPE_INT;
+	r.v.num = qf.matched;
+    } else {
+	r = qf.tasks = new_list(qf.i);
+	qf.matched = 0;
+	qf.i = 1;
+	qf.listing = 1;
+	scan_queued_tasks(&qf);
+    }
 
     free_var(arglist);
-    return make_var_pack(tasks);
+    return make_var_pack(r);
 }
 
 struct fcl_data {
@@ -2685,6 +2927,9 @@ do_resume(int id, Var value, Objid progr)
 
 	    if (t->kind == TASK_SUSPENDED
 		&& t->t.suspended.the_vm->task_id == id) {
+		/* a preempted task's value is part of its stack */
+		if (t->t.suspended.the_vm->ticks_left)
+		    return E_INVARG;
 		if (!is_wizard(progr) && progr != tq->player)
 		    return E_PERM;
 		/* already resumed, but we have a new value for it */
@@ -2851,7 +3096,7 @@ bf_switch_player(Var arglist, Byte next, void *vdata, Objid progr)
     tqueue *dead_tq = find_tqueue(new_player, 0);
     task *t;
 
-    tq->player = new_player;
+    set_tqueue_player(tq, new_player);
     if (tq->num_bg_tasks) {
 	/* Cute; this un-logged-in connection has some queued tasks!
 	 * Must copy them over to their own tqueue for accounting...
@@ -2872,7 +3117,7 @@ bf_switch_player(Var arglist, Byte next, void *vdata, Objid progr)
 	while ((t = dequeue_bg_task(dead_tq)) != 0) {
 	    enqueue_bg_task(tq, t);
 	}
-	dead_tq->player = NOTHING;	/* it'll be freed by run_ready_tasks */
+	set_tqueue_player(dead_tq, NOTHING);	/* it'll be freed by run_ready_tasks */
 	dead_tq->num_bg_tasks = 0;
     }
 
@@ -2886,7 +3131,7 @@ void
 register_tasks(void)
 {
     register_function("task_id", 0, 0, bf_task_id);
-    register_function("queued_tasks", 0, 0, bf_queued_tasks);
+    register_function("queued_tasks", 0, 1, bf_queued_tasks, TYPE_MAP);
     register_function("kill_task", 1, 1, bf_kill_task, TYPE_INT);
     register_function("output_delimiters", 1, 1, bf_output_delimiters,
 		      TYPE_OBJ);
@@ -95,6 +95,8 @@ extern enum outcome run_server_program_task(Objid _this, const char *verb,
 					    int debug, Objid player,
 					    const char *argstr,
 					    Var * result);
+extern void parallel_command_done(task_queue q, const char *command,
+				  int finished);
 
 extern Var current_local;
 extern int current_task_id;
@@ -0,0 +1,141 @@
+require 'test_helper'
+
+class TestConnections < Test::Unit::TestCase
+
+  # Doubles as a benchmark: with many connections open and many task
+  # queues around, every notify() has to find the right connection.
+  def test_that_broadcasts_reach_every_connection
+    sockets = []
+    run_test_as('wizard') do
+      # a task queue for each of many owners of suspended tasks
+      tasks = simplify(command(%Q|; ids = {}; for o in (create_many(#1, player, 500)) fork t (0) set_task_perms(o); suspend(3600); endfork ids = {@ids, t}; endfor return ids;|))
+      assert_equal 500, tasks.length
+      begin
+        200.times { sockets << TCPSocket.open(options['host'], options['port']) }
+        sleep 1
+        start = Time.now
+        n = simplify(command(%Q|; all = setremove(connected_players(1), player); for i in [1..20] for c in (all) notify(c, "ping"); endfor endfor return length(all);|))
+        puts "broadcast: #{Time.now - start} seconds" if options['verbose']
+        assert n >= 200
+        sockets.each do |s|
+          pings = 0
+          while pings < 20 && IO.select([s], nil, nil, 5)
+            line = s.gets
+            break unless line
+            pings += 1 if line.chomp == 'ping'
+          end
+          assert_equal 20, pings
+        end
+      ensure
+        sockets.each { |s| s.close }
+        command(%Q|; for t in (#{tasks.inspect.tr('[]', '{}')}) kill_task(t); endfor|)
+      end
+    end
+  end
+
+  # Reads lines from `socket' up to and including `last'.
+  def read_lines(socket, last)
+    lines = []
+    while lines.last != last && IO.select([socket], nil, nil, 5)
+      line = socket.gets
+      break unless line
+      lines << line.chomp
+    end
+    lines
+  end
+
+  def test_that_notify_many_reaches_every_connection
+    sockets = []
+    run_test_as('wizard') do
+      begin
+        1000.times { sockets << TCPSocket.open(options['host'], options['port']) }
+        sleep 1
+        all = %Q|setremove(connected_players(1), player)|
+        n = nil
+        start = Time.now
+        (1..5).each do |i|
+          n = simplify(command(%Q|; all = #{all}; for c in (all) notify(c, "ping #{i}"); endfor return length(all);|))
+        end
+        looped = Time.now - start
+        assert n >= 1000
+        r = nil
+        start = Time.now
+        (6..10).each do |i|
+          r = simplify(command(%Q|; return notify_many(#{all}, "ping #{i}");|))
+        end
+        shared = Time.now - start
+        puts "notify loop: #{looped} seconds, notify_many: #{shared} seconds" if options['verbose']
+        assert_equal n, r
+        expected = (1..10).map { |i| "ping #{i}" }
+        sockets.each do |s|
+          assert_equal expected, read_lines(s, 'ping 10').select { |l| l =~ /^ping/ }
+        end
+      ensure
+        sockets.each { |s| s.close }
+      end
+    end
+  end
+
+  def test_that_notify_many_checks_its_arguments
+    run_test_as('programmer') do
+      result = command(%Q|; return notify_many({player}, "hi");|)
+      assert_equal 'hi', result.first
+      assert_equal 1, simplify(result.last)
+      assert_equal E_PERM, simplify(command(%Q|; return notify_many({player, #0}, "hi");|))
+      assert_equal E_TYPE, simplify(command(%Q|; return notify_many({player, 1}, "hi");|))
+      assert_equal 0, simplify(command(%Q|; return notify_many({}, "hi");|))
+    end
+    run_test_as('wizard') do
+      # players that aren't connected count as notified, as with notify()
+      assert_equal 3, simplify(command(%Q|; return notify_many({player, #0, #0}, "hi");|).last)
+      assert_equal E_TYPE, simplify(command(%Q|; return notify_many(#0, "hi");|))
+    end
+  end
+
+  def test_that_connections_time_out_waiting_for_login
+    run_test_as('wizard') do
+      begin
+        command(%Q|; add_property($server_options, "connect_timeout", 1, {player, "r"}); load_server_options();|)
+        waiting = TCPSocket.open(options['host'], options['port'])
+        lines = read_lines(waiting, '*** Timed-out waiting for login. ***')
+        assert_equal '*** Timed-out waiting for login. ***', lines.last
+        assert IO.select([waiting], nil, nil, 5)
+        assert_nil waiting.gets
+
+        # changes take effect for connections already waiting
+        command(%Q|; $server_options.connect_timeout = 3600; load_server_options();|)
+        waiting = TCPSocket.open(options['host'], options['port'])
+        sleep 1
+        command(%Q|; $server_options.connect_timeout = 1; load_server_options();|)
+        lines = read_lines(waiting, '*** Timed-out waiting for login. ***')
+        assert_equal '*** Timed-out waiting for login. ***', lines.last
+
+        # and a timeout that isn't a positive integer means never
+        command(%Q|; $server_options.connect_timeout = 0; load_server_options();|)
+        waiting = TCPSocket.open(options['host'], options['port'])
+        assert_equal [], read_lines(waiting, '*** Timed-out waiting for login. ***').select { |l| l =~ /Timed-out/ }
+        assert_nil IO.select([waiting], nil, nil, 0)
+        waiting.close
+      ensure
+        command(%Q|; delete_property($server_options, "connect_timeout"); load_server_options();|)
+      end
+    end
+  end
+
+  def test_that_outbound_connections_connect_or_fail_promptly
+    run_test_as('wizard') do
+      c = simplify(command(%Q|; c = open_network_connection("127.0.0.1", #{options['port']}); boot_player(c); return typeof(c);|))
+      assert_equal TYPE_OBJ, c
+      assert_equal E_INVARG, simplify(command(%Q|; return open_network_connection("127.0.0.1", 1);|))
+      begin
+        command(%Q|; add_property($server_options, "outbound_connect_timeout", 1, {player, "r"}); load_server_options();|)
+        start = Time.now
+        assert_equal E_INVARG, simplify(command(%Q|; return open_network_connection("10.255.255.1", 7777);|))
+        assert Time.now - start < 3
+      ensure
+        command(%Q|; delete_property($server_options, "outbound_connect_timeout"); load_server_options();|)
+      end
+    end
+  end
+
+end
@@ -318,4 +318,92 @@ class TestCreate < Test::Unit::TestCase
     end
   end
 
+
+  def test_that_create_many_checks_its_arguments
+    run_test_as('programmer') do
+      assert_equal E_TYPE, simplify(command("; create_many(1, player, 2);"))
+      assert_equal E_TYPE, simplify(command("; create_many($object, 1, 2);"))
+      assert_equal E_INVARG, simplify(command("; create_many($object, player, -1);"))
+      assert_equal E_INVARG, simplify(command("; create_many(#-2, player, 2);"))
+      assert_equal E_PERM, simplify(command("; create_many($object, #1, 2);"))
+      assert_equal E_INVARG, simplify(command("; create_many({$object, $object}, player, 2);"))
+      m = max_object
+      assert_equal [], simplify(command("; return create_many($object, player, 0);"))
+      assert_equal m, max_object
+    end
+  end
+
+  def test_that_create_many_creates_objects_like_create
+    run_test_as('wizard') do
+      a = create(:nothing)
+      b = create(:nothing)
+      add_property(a, 'x', 1, [a, 'rc'])
+      add_property(b, 'y', 2, [b, 'r'])
+      p = simplify(command("; return player;"))
+      objs = simplify(command("; return create_many({#{a}, #{b}}, player, 100);"))
+      assert_equal 100, objs.length
+      assert_equal objs.last, max_object
+      assert_equal objs, children(a)
+      assert_equal objs, children(b)
+      assert_equal objs, descendants(a)
+      assert_equal [1, 2], [get(objs[50], 'x'), get(objs[50], 'y')]
+      assert_equal [p, [a, b]], [get(objs[99], 'owner'), parents(objs[99])]
+      mine = simplify(command("; return create_many(#{a}, #-1, 3);"))
+      mine.each do |o|
+        assert_equal o, get(o, 'owner')
+        assert_equal [o, 'rc'], simplify(command("; return property_info(#{o}, \"x\");"))
+      end
+      set(mine[1], 'x', 5)
+      assert_equal [1, 5, 1], mine.map { |o| get(o, 'x') }
+      assert_equal objs + mine, descendants(a)
+    end
+  end
+
+  def test_that_create_many_calls_initialize_on_each_object
+    run_test_as('programmer') do
+      a = create(:object)
+      add_property(a, 'initialized', [], [player, ''])
+      add_verb(a, ['player', 'xd', 'initialize'], ['this', 'none', 'this'])
+      set_verb_code(a, 'initialize') do |vc|
+        vc << %Q<#{a}.initialized = {@#{a}.initialized, this};>
+      end
+      objs = simplify(command("; return create_many(#{a}, player, 5);"))
+      assert_equal objs, get(a, 'initialized')
+    end
+  end
+
+  def test_that_create_many_respects_the_quota
+    run_test_as('programmer') do
+      add_property(player, 'ownership_quota', 3, [player, ''])
+      begin
+        m = max_object
+        assert_equal E_QUOTA, simplify(command("; create_many($object, player, 4);"))
+        assert_equal m, max_object
+        assert_equal 3, simplify(command("; return length(create_many($object, player, 3));"))
+        assert_equal 0, get(player, 'ownership_quota')
+      ensure
+        delete_property(player, 'ownership_quota')
+      end
+    end
+  end
+
+  def test_that_create_many_is_limited_and_charges_ticks
+    run_test_as('wizard') do
+      m = max_object
+      assert_equal E_QUOTA, simplify(command("; create_many($object, player, 2147483647);"))
+      assert_equal m, max_object
+      begin
+        command(%Q|; add_property($server_options, "max_create_many", 2147483647, {player, "r"}); load_server_options();|)
+        assert_equal E_QUOTA, simplify(command("; create_many($object, player, 2147483647);"))
+        assert_equal m, max_object
+        command(%Q|; $server_options.max_create_many = 10; load_server_options();|)
+        assert_equal E_QUOTA, simplify(command("; create_many($object, player, 11);"))
+        assert_equal m, max_object
+        assert simplify(command("; t = ticks_left(); create_many($object, player, 10); return t - ticks_left();")) >= 10
+      ensure
+        command(%Q|; delete_property($server_options, "max_create_many"); load_server_options();|)
+      end
+    end
+  end
+
 end
@@ -167,4 +167,29 @@ class TestExec < Test::Unit::TestCase
     end
   end
 
+  def test_that_large_outputs_come_back_whole
+    run_test_as('wizard') do
+      r = simplify(command(%Q|; s = "abcdefghij"; for i in [1..12] s = s + s; endfor return {length(s), exec({"test_io"}, s) == {0, s, s}};|))
+      assert_equal [40960, 1], r
+    end
+  end
+
+  def test_that_max_exec_processes_limits_running_execs
+    run_test_as('wizard') do
+      begin
+        command(%Q|; add_property($server_options, "max_exec_processes", 1, {player, "r"}); load_server_options();|)
+        command(%Q|; fork (0) exec({"test_with_sleep"}); endfork|)
+        sleep 1
+        assert_equal E_QUOTA, simplify(command(%Q|; return exec({"test_io"}, "x");|))
+        sleep 6
+        assert_equal [0, 'x', 'x'], simplify(command(%Q|; return exec({"test_io"}, "x");|))
+        command(%Q|; $server_options.max_exec_processes = 0; load_server_options();|)
+        assert_equal E_QUOTA, simplify(command(%Q|; return exec({"test_io"}, "x");|))
+      ensure
+        command(%Q|; delete_property($server_options, "max_exec_processes"); load_server_options();|)
+      end
+      assert_equal [0, 'x', 'x'], simplify(command(%Q|; return exec({"test_io"}, "x");|))
+    end
+  end
+
 end
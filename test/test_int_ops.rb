@@ -0,0 +1,115 @@
+require 'test_helper'
+
+class TestIntOps < Test::Unit::TestCase
+
+  def define(o, name, lines)
+    add_verb(o, ['player', 'xd', name], ['this', 'none', 'this'])
+    set_verb_code(o, name) do |vc|
+      lines.each { |l| vc << l }
+    end
+  end
+
+  def test_that_integer_updates_and_tests_compute_the_right_results
+    run_test_as('programmer') do
+      assert_equal [5050, 100, 50, 3628800, -5050], eval(%|s = 0; n = 0; e = 0; f = 1; d = 0; i = 1; while (i <= 100); s = s + i; d = d - i; n = n + 1; if (i % 2 == 0) e = e + 1; endif; if (i <= 10) f = f * i; endif; i = i + 1; endwhile; return {s, n, e, f, d};|)
+      assert_equal [-2147483648, 2147483647, 0], eval(%|a = 2147483647; a = a + 1; b = -2147483647 - 1; b = b - 1; c = 65536; c = c * c; return {a, b, c};|)
+      assert_equal [2, 4, 4], eval(%|x = 1; y = (x = x + 1); x = x + x; return {y, x, x > y ? x \| y};|)
+      assert_equal [1, 0, 1, 1, 0, 1], eval(%|r = {}; a = 3; b = 3; if (a == b) r = {@r, 1}; else r = {@r, 0}; endif if (a != b) r = {@r, 1}; else r = {@r, 0}; endif if (a <= b) r = {@r, 1}; else r = {@r, 0}; endif if (a >= b) r = {@r, 1}; else r = {@r, 0}; endif if (a < b) r = {@r, 1}; elseif (a > b) r = {@r, 1}; else r = {@r, 0}; endif return {@r, a < b + 1};|)
+      assert_equal 12, eval(%|x = 0; try; for i in [1..3]; x = x + 4; endfor; except (ANY); endtry; return x;|)
+    end
+  end
+
+  def test_that_other_types_fall_back_to_the_generic_opcodes
+    run_test_as('programmer') do
+      assert_equal [3.5, 'abc', 4.0, [1, 0, 0]], eval(%|f = 1.5; f = f + 2.0; s = "ab"; t = "c"; s = s + t; g = 2.0; g = g * 2.0; r = {}; if (#1 < #2) r = {@r, 1}; endif if ("a" < "B") r = {@r, 0}; else r = {@r, 1}; endif if (1 == 1.0) r = {@r, 1}; else r = {@r, 0}; endif return {f, s, g, r};|)
+      assert_equal E_TYPE, eval(%|x = {}; x = x - 1; return x;|)
+      assert_equal E_TYPE, eval(%|x = 1; if (x < "1") return 1; endif return 0;|)
+      assert_equal E_VARNF, eval(%|x = x + 1; return x;|)
+      assert_equal 'a1b1', eval(%|x = ""; for s in ({"a", "b"}); x = x + s; x = x + tostr(1); endfor; return x;|)
+    end
+  end
+
+  def test_that_a_failed_update_leaves_the_variable_alone
+    run_test_as('programmer') do
+      o = create(:nothing)
+      define(o, 'test', [
+        %Q|x = 5;|,
+        %Q|try|,
+        %Q|  x = x + "a";|,
+        %Q|except (E_TYPE)|,
+        %Q|endtry|,
+        %Q|return x;|
+      ])
+      assert_equal 5, call(o, 'test')
+    end
+  end
+
+  def test_that_integer_opcodes_decompile_to_the_original_code
+    run_test_as('programmer') do
+      o = create(:nothing)
+      lines = [
+        'x = 0;',
+        'while (x < 10)',
+        '  x = x + 1;',
+        '  y = x * 2;',
+        '  if (y == 4)',
+        '    x = x - y;',
+        '  elseif (x >= 8)',
+        '    y = x > 3 ? x | y;',
+        '  endif',
+        'endwhile',
+        'return x = x * y;'
+      ]
+      define(o, 'test', lines)
+      assert_equal lines, simplify(command(%|; return verb_code(#{obj_ref(o)}, "test");|))
+    end
+  end
+
+  def test_that_integer_opcodes_count_ticks_like_the_generic_ones
+    run_test_as('programmer') do
+      specialized = eval(%|t = ticks_left(); x = 0; y = 2; for i in [1..20]; x = x + 1; x = x * y; if (x > 5) x = x - 5; endif endfor; return {t - ticks_left(), x};|)
+      generic = eval(%|t = ticks_left(); x = 0; y = 2; for i in [1..20]; x = 1 + x; x = y * x; if (5 < x) x = -5 + x; endif endfor; return {t - ticks_left(), x};|)
+      assert_equal generic, specialized
+    end
+  end
+
+  def test_that_ticks_run_out_in_the_middle_of_integer_loops
+    run_test_as('wizard') do
+      o = create(:nothing)
+      add_property(o, 'n', 0, ['player', ''])
+      define(o, 'spin', [
+        %Q|i = 0; while (i >= 0) i = i + 1; if (i % 1000 == 0) this.n = i; endif endwhile|
+      ])
+      define(o, 'test', [
+        %Q|fork t (0) this:spin(); endfork|,
+        %Q|suspend(1);|,
+        %Q|ids = {}; for q in (queued_tasks()); ids = {@ids, q[1]}; endfor|,
+        %Q|return {this.n > 0, t in ids};|
+      ])
+      # the last line follows the forked task's traceback
+      result = command %Q|; return #{obj_ref(o)}:test();|
+      assert_equal [1, 0], simplify(result.last)
+    end
+  end
+
+  # Doubles as a benchmark.
+  def test_that_long_integer_loops_work
+    run_test_as('wizard') do
+      o = create(:nothing)
+      define(o, 'test', [
+        %Q|a = 0; b = 0; j = 0;|,
+        %Q|while (j < 400)|,
+        %Q|  i = 0;|,
+        %Q|  while (i < 2000) a = a + i; i = i + 1; endwhile|,
+        %Q|  b = b + a; j = j + 1;|,
+        %Q|  if (ticks_left() < 20000 \|\| seconds_left() < 2) suspend(0); endif|,
+        %Q|endwhile|,
+        %Q|return {a, b};|
+      ])
+      # 32-bit wraparound, as in the interpreter
+      wrap = lambda { |n| n %= 2**32; n >= 2**31 ? n - 2**32 : n }
+      assert_equal [wrap.call(1999000 * 400), wrap.call(1999000 * 400 * 401 / 2)], call(o, 'test')
+    end
+  end
+
+end
@@ -0,0 +1,185 @@
+require 'test_helper'
+
+class TestJit < Test::Unit::TestCase
+
+  def setup
+    run_test_as('wizard') do
+      evaluate('add_property($server_options, "jit", 1, {player, "r"})')
+      evaluate('load_server_options();')
+    end
+  end
+
+  def teardown
+    run_test_as('wizard') do
+      evaluate('delete_property($server_options, "jit")')
+      evaluate('load_server_options();')
+    end
+  end
+
+  def set_jit(value)
+    evaluate("$server_options.jit = #{value}")
+    evaluate('load_server_options();')
+  end
+
+  # Defines a verb `test' on a new object from `lines', then calls it
+  # with `args', both with and without translation, and checks that the
+  # results agree.
+  def with_and_without_jit(lines, *args)
+    o = create(:nothing)
+    add_verb(o, ['player', 'xd', 'test'], ['this', 'none', 'this'])
+    set_verb_code(o, 'test') do |vc|
+      lines.each { |l| vc << l }
+    end
+    set_jit(0)
+    expected = call(o, 'test', *args)
+    set_jit(1)
+    actual = call(o, 'test', *args)
+    assert_equal expected, actual
+    actual
+  end
+
+  def test_that_integer_loops_compute_the_same_results
+    run_test_as('wizard') do
+      assert_equal [500500, 1000, 250000, 333166500], with_and_without_jit([
+        %Q|s = 0; odd = 0; sq = 0;|,
+        %Q|for i in [1..1000]|,
+        %Q|  s = s + i;|,
+        %Q|  if (i % 2 == 1 && i > 0) odd = odd + i; endif|,
+        %Q|  sq = sq + i * i - i * 1;|,
+        %Q|endfor|,
+        %Q|return {s, i, odd, sq + s - s / 3 * 3 - s % 3 - 166500};|
+      ])
+      assert_equal [0, 55], with_and_without_jit([
+        %Q|n = 10; a = 0; b = 1;|,
+        %Q|while (n > 0)|,
+        %Q|  {a, b} = {b, a + b};|,
+        %Q|  n = n - 1;|,
+        %Q|endwhile|,
+        %Q|return {n, a};|
+      ])
+    end
+  end
+
+  def test_that_arithmetic_edge_cases_match_the_interpreter
+    run_test_as('wizard') do
+      with_and_without_jit([
+        %Q|x = {};|,
+        %Q|for i in [1..200]|,
+        %Q|  a = 2147483647 + i; b = -2147483647 - 1 - i; c = a * 65537;|,
+        %Q|  d = -(-2147483647 - 1); e = !i; f = ~i; g = i &. 255 \|. 256 ^. 7;|,
+        %Q|  h = (i - 100) / 7; k = (i - 100) % 7; l = #0 == #0; m = E_PERM != E_PERM;|,
+        %Q|endfor|,
+        %Q|return {a, b, c, d, e, f, g, h, k, l, m};|
+      ])
+      assert_equal [-2147483648, 0], with_and_without_jit([
+        %Q|m = -2147483647 - 1;|,
+        %Q|for i in [1..200]; a = m / (i - i - 1); b = m % (i - i - 1); endfor|,
+        %Q|return {a, b};|
+      ])
+      assert_equal E_DIV, with_and_without_jit([
+        %Q|for i in [1..200]; a = i / (i - 150); endfor|,
+        %Q|return a;|
+      ])
+    end
+  end
+
+  def test_that_values_of_other_types_fall_back_to_the_interpreter
+    run_test_as('wizard') do
+      assert_equal [100.5, 'aaa', 300, [1, 2], 'x', 0], with_and_without_jit([
+        %Q|f = 0.5; s = ""; n = 0;|,
+        %Q|for i in [1..300]|,
+        %Q|  if (i <= 100) f = f + 1.0; endif|,
+        %Q|  if (i > 297) s = s + "a"; endif|,
+        %Q|  n = n + 1;|,
+        %Q|  l = {1, 2};|,
+        %Q|  x = "x";|,
+        %Q|  y = l == {1, 2} && x == "x" && 0;|,
+        %Q|endfor|,
+        %Q|return {f, s, n, l, x, y};|
+      ])
+      assert_equal E_TYPE, with_and_without_jit([
+        %Q|x = 0;|,
+        %Q|for i in [1..300]; x = x + (i == 250 ? "foo" \| 1); endfor|,
+        %Q|return x;|
+      ])
+      assert_equal E_VARNF, with_and_without_jit([
+        %Q|for i in [1..300]; if (i == 250) return y; endif endfor|
+      ])
+    end
+  end
+
+  def test_that_object_loops_and_builtin_calls_work
+    run_test_as('wizard') do
+      assert_equal [200, 20100, 'abcabc'], with_and_without_jit([
+        %Q|n = 0; s = 0; t = "";|,
+        %Q|for o in [#1..#200]; n = n + 1; endfor|,
+        %Q|for i in [1..200]; s = s + toint(tostr(i)); if (i % 100 == 0) t = t + "abc"; endif endfor|,
+        %Q|return {n, s, t};|
+      ])
+    end
+  end
+
+  def test_that_translated_loops_count_ticks_like_the_interpreter
+    run_test_as('wizard') do
+      with_and_without_jit([
+        %Q|t = ticks_left();|,
+        %Q|for i in [1..1000]; x = i + 1; if (x > 0 \|\| x) y = -x; endif endfor|,
+        %Q|return t - ticks_left();|
+      ])
+    end
+  end
+
+  def test_that_ticks_run_out_in_translated_loops
+    run_test_as('wizard') do
+      o = create(:nothing)
+      add_property(o, 'n', 0, ['player', ''])
+      add_verb(o, ['player', 'xd', 'spin'], ['this', 'none', 'this'])
+      set_verb_code(o, 'spin') do |vc|
+        vc << %Q|i = 0; while (1) i = i + 1; if (i % 1000 == 0) this.n = i; endif endwhile|
+      end
+      add_verb(o, ['player', 'xd', 'test'], ['this', 'none', 'this'])
+      set_verb_code(o, 'test') do |vc|
+        vc << %Q|this.n = 0;|
+        vc << %Q|fork t (0) this:spin(); endfork|
+        vc << %Q|suspend(1);|
+        vc << %Q|ids = {}; for q in (queued_tasks()); ids = {@ids, q[1]}; endfor|
+        vc << %Q|return {this.n > 0, t in ids};|
+      end
+      [0, 1].each do |jit|
+        set_jit(jit)
+        # the last line follows the forked task's traceback
+        result = command %Q|; return #{obj_ref(o)}:test();|
+        assert_equal [1, 0], simplify(result.last)
+      end
+    end
+  end
+
+  def test_that_suspended_tasks_resume_in_the_right_place
+    run_test_as('wizard') do
+      assert_equal [2000, 2001000], with_and_without_jit([
+        %Q|s = 0;|,
+        %Q|for i in [1..2000]|,
+        %Q|  s = s + i;|,
+        %Q|  if (i % 500 == 0) suspend(0); endif|,
+        %Q|endfor|,
+        %Q|return {i, s};|
+      ])
+    end
+  end
+
+  # Doubles as a benchmark: compare the times of the two calls.
+  def test_that_long_integer_loops_work
+    run_test_as('wizard') do
+      with_and_without_jit([
+        %Q|a = 0; b = 0;|,
+        %Q|for j in [1..400]|,
+        %Q|  for i in [1..5000]; a = a + i; endfor|,
+        %Q|  b = b + a;|,
+        %Q|  if (ticks_left() < 20000 \|\| seconds_left() < 2) suspend(0); endif|,
+        %Q|endfor|,
+        %Q|return {a, b};|
+      ])
+    end
+  end
+
+end
@@ -109,4 +109,33 @@ class TestLooping < Test::Unit::TestCase
     end
   end
 
+  def test_that_nested_and_abandoned_map_loops_work
+    run_test_as('programmer') do
+      assert_equal [[1, 1], [1, 2], [2, 1], [2, 2]], eval(%|x = {}; m = [1 -> 1, 2 -> 2]; for a in (m); for b in (m); x = {@x, {a, b}}; endfor; endfor; return x;|)
+      assert_equal [1, 2, 2], eval(%|x = {}; m = [1 -> 1, 2 -> 2, 3 -> 3]; for a in (m); for b in (m); x = {@x, a}; break; endfor; if (a == 2); break; endif; endfor; return {@x, a};|)
+      assert_equal [[1, 2], ['a', 'b']], eval(%|x = {}; for v, k in ({"a", "b"}); x = {@x, {k, v}}; k = 99; endfor; return {{x[1][1], x[2][1]}, {x[1][2], x[2][2]}};|)
+    end
+  end
+
+  # Doubles as a benchmark: each call iterates over ten million
+  # elements.
+  def test_that_for_loops_over_many_elements_work
+    run_test_as('wizard') do
+      o = create(:nothing)
+      add_verb(o, ['player', 'xd', 'loop'], ['this', 'none', 'this'])
+      set_verb_code(o, 'loop') do |vc|
+        vc << %Q|c = args[1];|
+        vc << %Q|for i in [1..1000]; if (typeof(c) == MAP); c[i] = i; else; c = {@c, i}; endif; endfor|
+        vc << %Q|n = 0;|
+        vc << %Q|for j in [1..10000]|
+        vc << %Q|  for x in (c); n = n + 1; endfor|
+        vc << %Q|  if (ticks_left() < 10000 \|\| seconds_left() < 2); suspend(0); endif|
+        vc << %Q|endfor|
+        vc << %Q|return {n, x};|
+      end
+      assert_equal [10000000, 1000], call(o, 'loop', [])
+      assert_equal [10000000, 1000], call(o, 'loop', {})
+    end
+  end
+
 end
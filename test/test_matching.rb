@@ -0,0 +1,107 @@
+require 'test_helper'
+
+class TestMatching < Test::Unit::TestCase
+
+  # Builds a room holding `fillers' unrelated objects plus a few with
+  # interesting names, moves the player into it, and returns the room,
+  # the parent of the objects and the interesting objects.  The room
+  # inherits the verb that evaluates `;' commands from #2.
+  def build_room(fillers)
+    room = create(MooObj.new('#2'))
+    add_verb(room, ['player', 'xd', 'accept'], ['this', 'none', 'this'])
+    set_verb_code(room, 'accept') do |vc|
+      vc << %Q|return 1;|
+    end
+    add_verb(room, ['player', 'xd', 'look'], ['any', 'none', 'none'])
+    set_verb_code(room, 'look') do |vc|
+      vc << %Q|notify(player, toliteral(dobj));|
+    end
+    thing = create(:nothing)
+    add_property(thing, 'aliases', [], ['player', 'r'])
+    fillers.times do |i|
+      command(%Q|; o = create(#{thing}); o.name = "filler #{i}"; o.aliases = {"stuff", "z#{i}"}; move(o, #{room});|)
+    end
+    names = [['red ball', ['ball', 'toy']], ['blue ball', ['ball']], ['Lamp', []], ['lantern', ['light']]]
+    objs = names.map do |name, aliases|
+      o = simplify(command(%Q|; o = create(#{thing}); o.name = "#{name}"; o.aliases = #{aliases.inspect.tr('[]', '{}')}; move(o, #{room}); return o;|))
+      o
+    end
+    move(player, room)
+    [room, thing, objs]
+  end
+
+  def look(what)
+    command(%Q|look #{what}|)
+  end
+
+  def check_matches(fillers)
+    room, thing, (red, blue, lamp, lantern) = build_room(fillers)
+    assert_equal red.to_s, look('red ball')
+    assert_equal red.to_s, look('RED')
+    assert_equal red.to_s, look('toy')
+    assert_equal lamp.to_s, look('lamp')
+    assert_equal lamp.to_s, look('lam')
+    assert_equal '#-2', look('la')
+    assert_equal '#-2', look('ball')
+    assert_equal '#-2', look('b')
+    assert_equal blue.to_s, look('blue')
+    assert_equal '#-3', look('nothing like it')
+    assert_equal lantern.to_s, look('light')
+
+    # changes to names, aliases and contents show up right away
+    command(%Q|; #{blue}.name = "green ball";|)
+    assert_equal '#-3', look('blue')
+    assert_equal blue.to_s, look('green')
+    command(%Q|; #{red}.aliases = {"toy"};|)
+    assert_equal blue.to_s, look('ball')
+    command(%Q|; move(#{blue}, #-1);|)
+    assert_equal '#-3', look('ball')
+    assert_equal '#-3', look('green')
+    command(%Q|; move(#{blue}, #{room});|)
+    assert_equal blue.to_s, look('ball')
+    command(%Q|; clear_property(#{lamp}, "aliases"); #{thing}.aliases = {"ball"};|)
+    assert_equal '#-2', look('ball')
+    command(%Q|; #{thing}.aliases = {};|)
+    assert_equal blue.to_s, look('ball')
+
+    # the player's inventory is searched along with the room
+    command(%Q|; move(#{lantern}, player);|)
+    assert_equal lantern.to_s, look('light')
+    command(%Q|; #{lantern}.name = "Lamp";|)
+    assert_equal '#-2', look('lamp')
+  end
+
+  def test_that_matching_works_in_a_nearly_empty_room
+    run_test_with_prefix_and_suffix_as('wizard') do
+      check_matches(0)
+    end
+  end
+
+  def test_that_matching_works_in_a_crowded_room
+    run_test_with_prefix_and_suffix_as('wizard') do
+      check_matches(40)
+    end
+  end
+
+  def test_that_commands_are_split_into_the_right_parts
+    run_test_with_prefix_and_suffix_as('wizard') do
+      room = create(MooObj.new('#2'))
+      ['show', 'say', 'emote'].each do |name|
+        add_verb(room, ['player', 'xd', name], ['any', 'any', 'any'])
+        set_verb_code(room, name) do |vc|
+          vc << %Q|notify(player, toliteral({verb, argstr, args, dobjstr, prepstr, iobjstr, dobj, iobj}));|
+        end
+      end
+      move(player, room)
+      assert_equal %q|{"show", "", {}, "", "", "", #-1, #-1}|, command(%q|  show|)
+      assert_equal %Q|{"show", "me", {"me"}, "me", "", "", #{player}, #-1}|, command(%q|show me|)
+      assert_equal %q|{"show", "\"a b\" c\\\\ d in the  box", {"a b", "c d", "in", "the", "box"}, "a b c d", "in", "the box", #-3, #-3}|,
+                   command(%q|show "a b" c\ d in the  box|)
+      assert_equal %q|{"show", "on top of", {"on", "top", "of"}, "", "on top of", "", #-1, #-1}|, command(%q|show on top of|)
+      assert_equal %q|{"show", "x\"y z\"w\\\\\"q me", {"xy zw\"q", "me"}, "xy zw\"q me", "", "", #-3, #-1}|, command(%q|show x"y z"w\"q me|)
+      assert_equal %q|{"say", "Hello  there", {"Hello", "there"}, "Hello there", "", "", #-3, #-1}|, command(%q|"Hello  there|)
+      assert_equal %q|{"emote", " waves", {"waves"}, "waves", "", "", #-3, #-1}|, command(%q|: waves|)
+    end
+  end
+
+end
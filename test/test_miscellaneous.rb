@@ -37,4 +37,185 @@ class TestMiscellaneous < Test::Unit::TestCase
     end
   end
 
+  def test_that_isa_and_ancestors_follow_changes_to_the_hierarchy
+    run_test_as('programmer') do
+      a = create(:nothing)
+      b = create(a)
+      c = create(b)
+      x = create(:nothing)
+      y = create([x, a])
+
+      assert_equal 1, isa(c, a)
+      assert_equal 0, isa(c, x)
+      assert_equal [b, a], ancestors(c)
+      assert_equal [x, a], ancestors(y)
+
+      # a change far up the hierarchy
+      chparent(a, x)
+      assert_equal 1, isa(c, x)
+      assert_equal [b, a, x], ancestors(c)
+      assert_equal [c, b, a, x], ancestors(c, 1)
+      assert_equal [x, a], ancestors(y)
+
+      chparents(b, [y])
+      assert_equal [y, x, a], ancestors(b)
+      assert_equal 1, isa(c, y)
+
+      # `b' inherits `y's parents
+      recycle(y)
+      assert_equal [x, a], ancestors(b)
+      assert_equal 0, isa(c, y)
+      assert_equal 1, isa(c, a)
+      chparent(b, :nothing)
+      assert_equal 0, isa(c, a)
+      assert_equal 0, isa(c, x)
+      assert_equal 1, isa(c, b)
+
+      # a change to an object with no children, and anonymous objects
+      chparent(c, x)
+      assert_equal [x], ancestors(c)
+      assert_equal 0, isa(c, b)
+      assert_equal [], ancestors(b)
+      chparent(c, b)
+      assert_equal [b], ancestors(c)
+      assert_equal [1, 0, 1], simplify(command(%Q|; v = create(#{obj_ref(c)}, 1); w = create(#{obj_ref(x)}, 1); return {isa(v, #{obj_ref(b)}), isa(w, #{obj_ref(b)}), ancestors(v) == {#{obj_ref(c)}, #{obj_ref(b)}}};|))
+
+      # lots of lookups on a deep hierarchy
+      o = create(:nothing)
+      add_property(o, 'objs', [], ['player', ''])
+      command %Q|; p = #{obj_ref(c)}; for i in [1..50]; p = create(p); #{obj_ref(o)}.objs = {@#{obj_ref(o)}.objs, p}; endfor|
+      assert_equal [1, 0, 51], simplify(command(%Q|; l = #{obj_ref(o)}.objs; t = 1; u = 0; for i in [1..2000]; t = t && isa(l[$], #{obj_ref(b)}); u = u \|\| isa(l[$], #{obj_ref(a)}); endfor; return {t, u, length(ancestors(l[$]))};|))
+    end
+  end
+
+  def test_that_cached_descendants_follow_changes_to_the_hierarchy
+    run_test_as('wizard') do
+      evaluate('add_property($server_options, "descendants_cache_threshold", 1, {player, "r"})')
+      evaluate('load_server_options();')
+      begin
+        a = create(:nothing)
+        b = create(a)
+        c = create(b)
+        d = create(a)
+        x = create(:nothing)
+
+        # compares the cached results against freshly computed ones
+        check = lambda do
+          cached = [a, b, x].map { |o| [descendants(o), descendants(o, 1)] }
+          evaluate('$server_options.descendants_cache_threshold = 0')
+          evaluate('load_server_options();')
+          fresh = [a, b, x].map { |o| [descendants(o), descendants(o, 1)] }
+          evaluate('$server_options.descendants_cache_threshold = 1')
+          evaluate('load_server_options();')
+          assert_equal fresh, cached
+          cached
+        end
+
+        assert_equal [[b, c, d], [a, b, c, d]], check.call[0]
+        e = create(d)
+        f = create(b)
+        assert_equal [b, c, f, d, e], check.call[0][0]
+        g = create([x, d])
+        assert_equal [x, g], check.call[2][1]
+        recycle(c)
+        recycle(d)
+        assert_equal [b, f, e, g], check.call[0][0]
+        chparent(b, x)
+        assert_equal [e, g], check.call[0][0]
+        assert_equal [g, b, f], check.call[2][0]
+        chparents(e, [b, x])
+        check.call
+        h = create(f)
+        check.call
+        recycle(b)
+        check.call
+      ensure
+        evaluate('delete_property($server_options, "descendants_cache_threshold")')
+        evaluate('load_server_options();')
+      end
+    end
+  end
+
+  def test_that_cached_descendants_follow_changes_to_a_diamond
+    run_test_as('wizard') do
+      evaluate('add_property($server_options, "descendants_cache_threshold", 1, {player, "r"})')
+      evaluate('load_server_options();')
+      begin
+        a = create(:nothing)
+        b = create(a)
+        c = create(a)
+        d = create([c, b])
+
+        # compares the cached results against freshly computed ones
+        check = lambda do
+          cached = [a, b, c, d].map { |o| descendants(o) }
+          evaluate('$server_options.descendants_cache_threshold = 0')
+          evaluate('load_server_options();')
+          fresh = [a, b, c, d].map { |o| descendants(o) }
+          evaluate('$server_options.descendants_cache_threshold = 1')
+          evaluate('load_server_options();')
+          assert_equal fresh, cached
+          cached
+        end
+
+        assert_equal [b, d, c], check.call[0]
+        e = create(d)
+        f = create(c)
+        assert_equal [b, d, e, c, f], check.call[0]
+        g = create(b)
+        assert_equal [b, d, e, g, c, f], check.call[0]
+        h = create([b, c])
+        check.call
+        i = create(f)
+        check.call
+        objs = simplify(command(%Q|; return create_many({#{c}, #{b}}, player, 3);|))
+        assert_equal [b, d, e, g, h] + objs + [c, f, i], check.call[0]
+        chparents(e, [c, b])
+        check.call
+        # a leaf that changes parents becomes the last child of each
+        j = create([b, c])
+        k = create(c)
+        check.call
+        chparent(j, c)
+        assert_equal [k, j], check.call[0][-2..-1]
+        recycle(h)
+        check.call
+        chparent(f, b)
+        check.call
+        recycle(d)
+        check.call
+      ensure
+        evaluate('delete_property($server_options, "descendants_cache_threshold")')
+        evaluate('load_server_options();')
+      end
+    end
+  end
+
+  # Doubles as a benchmark: sets this large are kept indexed.
+  def test_that_large_contents_and_children_keep_their_order
+    run_test_as('wizard') do
+      p = create(:nothing)
+      r = create(:nothing)
+      add_verb(p, ['player', 'xd', 'test'], ['this', 'none', 'this'])
+      set_verb_code(p, 'test') do |vc|
+        vc << %Q|r = args[1]; kids = {}; inside = {};|
+        vc << %Q|for i in [1..300]|
+        vc << %Q|  o = create(this); kids = {@kids, o};|
+        vc << %Q|  if (i % 2) move(o, r); inside = {@inside, o}; endif|
+        vc << %Q|endfor|
+        vc << %Q|for o in (kids)|
+        vc << %Q|  if (o in inside && toint(o) % 3 == 0) move(o, #-1); inside = setremove(inside, o); endif|
+        vc << %Q|endfor|
+        vc << %Q|x = kids[150]; chparent(x, #1); chparent(x, this); kids = {@setremove(kids, x), x};|
+        vc << %Q|y = inside[10]; move(y, #-1); move(y, r); inside = {@setremove(inside, y), y};|
+        vc << %Q|z = kids[7]; recycle(z); kids = setremove(kids, z); inside = setremove(inside, z);|
+        vc << %Q|ok = {children(this) == kids, r.contents == inside, length(kids) == 299};|
+        vc << %Q|recycle(r);|
+        vc << %Q|nowhere = 1; for o in (inside); if (o.location != #-1) nowhere = 0; endif endfor|
+        vc << %Q|return {@ok, nowhere};|
+      end
+      assert_equal [1, 1, 1, 1], call(p, 'test', r)
+    end
+  end
+
 end
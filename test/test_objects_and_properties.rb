@@ -1328,4 +1328,21 @@ class TestObjectsAndProperties < Test::Unit::TestCase
     end
   end
 
+  def test_that_adding_and_deleting_properties_on_a_large_hierarchy_keeps_values_in_place
+    run_test_as('programmer') do
+      # `a' has a few hundred descendants, some with several parents,
+      # each of which defines a property and overrides the ones it
+      # inherits with values that say where they came from
+      r = simplify command %Q{; a = create($nothing); x = create($nothing); add_property(x, "px", "x", {player, ""}); l = {}; for i in [1..300]; p = i > 3 ? l[random(i - 1)] | a; o = i % 7 ? create(p) | create({x, p}); add_property(o, tostr("p", i), i, {player, ""}); i % 7 || (o.px = i); l = {@l, o}; endfor; add_property(a, "pa", "a", {player, ""}); ok = 1; for i in [1..300]; o = l[i]; ok = ok && o.pa == "a" && is_clear_property(o, "pa") && o.(tostr("p", i)) == i && (i % 7 != 0 || o.px == i); endfor; delete_property(a, "pa"); for i in [1..300]; o = l[i]; ok = ok && `o.pa ! ANY' == E_PROPNF && o.(tostr("p", i)) == i && (i % 7 != 0 || o.px == i); endfor; return ok;}
+      assert_equal 1, r
+    end
+  end
+
+  def test_that_children_share_the_layout_of_their_properties_but_not_their_values
+    run_test_as('wizard') do
+      r = simplify command %Q{; p = create($nothing); for i in [1..50]; add_property(p, tostr("p", i), i, {player, i % 2 ? "r" | "rc"}); endfor; a = create(p); b = create(p); c = create(p); a.p1 = "a"; set_property_info(b, "p2", {#2, "rw"}); clear_property(a, "p1"); b.p3 = {1, 2}; return {a.p1, is_clear_property(a, "p1"), property_info(a, "p2"), property_info(b, "p2"), property_info(c, "p2"), b.p3, c.p3, property_info(c, "p1"), object_bytes(c) < object_bytes(p) / 4};}
+      assert_equal [1, 1, [player, 'rc'], [MooObj.new('#2'), 'rw'], [player, 'rc'], [1, 2], 3, [player, 'r'], 1], r
+    end
+  end
+
 end
@@ -1223,6 +1223,31 @@ class TestObjectsAndVerbs < Test::Unit::TestCase
     end
   end
 
+  def test_that_unused_command_variables_are_still_passed_along
+    run_test_as('wizard') do
+      o = create(:nothing)
+      add_property(o, 'forked', 0, [player, ''])
+      add_verb(o, [player, 'xd', 'a'], ['this', 'none', 'this'])
+      set_verb_code(o, 'a') do |vc|
+        vc << %|dobjstr = "foo"; iobj = #1;|
+        vc << %|return this:b();|
+      end
+      add_verb(o, [player, 'xd', 'b'], ['this', 'none', 'this'])
+      set_verb_code(o, 'b') do |vc|
+        vc << %|fork (0)|
+        vc << %|  this.forked = this:c();|
+        vc << %|endfork|
+        vc << %|return {this:c(), 1};|
+      end
+      add_verb(o, [player, 'xd', 'c'], ['this', 'none', 'this'])
+      set_verb_code(o, 'c') do |vc|
+        vc << %|return {dobjstr, iobj, argstr};|
+      end
+      assert_equal [['foo', OBJECT, ''], 1], call(o, 'a')
+      assert_equal ['foo', OBJECT, ''], get(o, 'forked')
+    end
+  end
+
   private
 
   def kahuna(parent, name, opt = 0)
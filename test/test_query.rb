@@ -0,0 +1,222 @@
+require 'test_helper'
+
+class TestQuery < Test::Unit::TestCase
+
+  def test_that_objects_where_finds_objects_by_property_value
+    run_test_as('wizard') do
+      a = create(:nothing)
+      add_property(a, 'color', 'red', ['player', 'r'])
+      b = create(a)
+      c = create(a)
+      d = create(a)
+      set(c, 'color', 'blue')
+      set(d, 'color', 'RED')
+      assert_equal [a, b, d].map(&:to_s), simplify(command(%Q|; return objects_where("color", "red");|)).map(&:to_s)
+      assert_equal [c.to_s], simplify(command(%Q|; return objects_where("color", "blue");|)).map(&:to_s)
+      assert_equal [], simplify(command(%Q|; return objects_where("color", "green");|))
+      assert_equal [], simplify(command(%Q|; return objects_where("no_such_property", 0);|))
+      # built-in properties work, too
+      assert_equal [b.to_s], simplify(command(%Q|; #{b}.name = "Query Target"; return objects_where("name", "query target");|)).map(&:to_s)
+    end
+  end
+
+  def test_that_objects_where_sees_the_database_as_it_was_when_it_started
+    run_test_as('wizard') do
+      a = create(:nothing)
+      add_property(a, 'n', 0, ['player', 'r'])
+      # enough objects to be split up among several workers; the forked
+      # task may not get to run until the suspend(0)
+      r = simplify(command(%Q|; objs = create_many(#{a}, player, 5000); objs[1].n = 1; objs[$].n = 1; fork (0) objs[2].n = 1; endfork; found = objects_where("n", 1); suspend(0); return {length(found), found[1] == objs[1], found[$] == objs[$], objs[2].n};|))
+      assert_equal [2, 1, 1, 1], r
+      assert_equal 3, simplify(command(%Q|; return length(objects_where("n", 1));|))
+    end
+  end
+
+  def test_that_find_verbs_matching_finds_verb_code
+    run_test_as('wizard') do
+      o = create(:nothing)
+      add_verb(o, ['player', 'xd', 'first'], ['this', 'none', 'this'])
+      set_verb_code(o, 'first') do |vc|
+        vc << %Q|x = 1;|
+        vc << %Q|return "needle in a haystack";|
+      end
+      add_verb(o, ['player', 'xd', 'second third'], ['this', 'none', 'this'])
+      set_verb_code(o, 'second') do |vc|
+        vc << %Q|if (1)|
+        vc << %Q|  return "NEEDLE";|
+        vc << %Q|endif|
+      end
+      add_verb(o, ['player', 'xd', 'fourth'], ['this', 'none', 'this'])
+      set_verb_code(o, 'fourth') do |vc|
+        vc << %Q|return "haystack";|
+      end
+      found = simplify(command(%Q|; return find_verbs_matching("needle");|))
+      assert_equal [[o.to_s, 'first', 2], [o.to_s, 'second third', 2]], found.map { |f| [f[0].to_s, f[1], f[2]] }
+      found = simplify(command(%Q|; return find_verbs_matching("NEEDLE", 1);|))
+      assert_equal [[o.to_s, 'second third', 2]], found.map { |f| [f[0].to_s, f[1], f[2]] }
+      assert_equal [], simplify(command(%Q|; return find_verbs_matching("nothing like this anywhere");|))
+    end
+  end
+
+  def test_that_call_in_parallel_makes_every_call
+    run_test_as('wizard') do
+      o = create(:nothing)
+      add_property(o, 'pokes', 0, ['player', 'r'])
+      add_verb(o, ['player', 'xd', 'sum'], ['this', 'none', 'this'])
+      set_verb_code(o, 'sum') do |vc|
+        vc << %Q|s = 0;|
+        vc << %Q|for i in [1..args[1]]|
+        vc << %Q|  s = s + i;|
+        vc << %Q|endfor|
+        vc << %Q|return s;|
+      end
+      add_verb(o, ['player', 'xd', 'greet'], ['this', 'none', 'this'])
+      set_verb_code(o, 'greet') do |vc|
+        vc << %Q|notify(player, "hello " + tostr(args[1]));|
+        vc << %Q|return args[1];|
+      end
+      add_verb(o, ['player', 'xd', 'poke'], ['this', 'none', 'this'])
+      set_verb_code(o, 'poke') do |vc|
+        vc << %Q|notify(player, "poking");|
+        vc << %Q|return this.pokes = this.pokes + 1;|
+      end
+      add_verb(o, ['player', 'xd', 'values'], ['this', 'none', 'this'])
+      set_verb_code(o, 'values') do |vc|
+        vc << %Q|return {1.5, ["a" -> {#1, E_PERM}], "x\\"y\|z", {}, -7};|
+      end
+
+      before = simplify(command(%Q|; return parallel_call_stats();|))
+      result = command(%Q|; return call_in_parallel({{#{o}, "sum", {10}}, {#{o}, "greet", {1}}, {#{o}, "values"}, {#{o}, "poke"}, {#{o}, "greet", {2}}, {#{o}, "sum", {100}}});|)
+      # notifications come in the order of the calls, and the call that
+      # assigned to a property was made again, once, by the server
+      assert_equal ['hello 1', 'poking', 'hello 2'], result[0..-2]
+      assert_equal [55, 1, [1.5, {'a' => [MooObj.new('#1'), E_PERM]}, 'x"y|z', [], -7], 1, 2, 5050], simplify(result.last)
+      assert_equal 1, get(o, 'pokes')
+
+      after = simplify(command(%Q|; return parallel_call_stats();|))
+      assert_equal before['batches'] + 1, after['batches']
+      assert_equal before['calls'] + 6, after['calls']
+      assert_equal before['conflicts'] + 1, after['conflicts']
+      # it and every call after it
+      assert_equal before['retried'] + 3, after['retried']
+      assert_equal 'property assignment', after['last_conflict']
+
+      # and so was a call that used a builtin that changes things
+      add_verb(o, ['player', 'xd', 'extend'], ['this', 'none', 'this'])
+      set_verb_code(o, 'extend') do |vc|
+        vc << %Q|add_property(this, "extra", args[1], {player, "r"});|
+        vc << %Q|return this.extra;|
+      end
+      assert_equal [3, 6], simplify(command(%Q|; return call_in_parallel({{#{o}, "sum", {2}}, {#{o}, "extend", {6}}});|))
+      assert_equal 6, get(o, 'extra')
+      assert_equal 'add_property', simplify(command(%Q|; return parallel_call_stats()["last_conflict"];|))
+
+      # and so was a call that drew a random number
+      add_verb(o, ['player', 'xd', 'roll'], ['this', 'none', 'this'])
+      set_verb_code(o, 'roll') do |vc|
+        vc << %Q|return random(1000000000);|
+      end
+      rolls = simplify(command(%Q|; return {@call_in_parallel({{#{o}, "roll"}}), #{o}:roll()};|))
+      assert_not_equal rolls[0], rolls[1]
+      assert_equal 'random', simplify(command(%Q|; return parallel_call_stats()["last_conflict"];|))
+    end
+  end
+
+  def test_that_call_in_parallel_calls_see_what_earlier_calls_did
+    run_test_as('wizard') do
+      o = create(:nothing)
+      add_property(o, 'pokes', 0, ['player', 'r'])
+      add_verb(o, ['player', 'xd', 'poke'], ['this', 'none', 'this'])
+      set_verb_code(o, 'poke') do |vc|
+        vc << %Q|return this.pokes = this.pokes + 1;|
+      end
+      add_verb(o, ['player', 'xd', 'peek'], ['this', 'none', 'this'])
+      set_verb_code(o, 'peek') do |vc|
+        vc << %Q|return this.pokes;|
+      end
+
+      assert_equal [0, 1, 1, 2, 2], simplify(command(%Q|; return call_in_parallel({{#{o}, "peek"}, {#{o}, "poke"}, {#{o}, "peek"}, {#{o}, "poke"}, {#{o}, "peek"}});|))
+      assert_equal 2, get(o, 'pokes')
+
+      # the server makes no more than ten calls itself, or none at all
+      ten = ([%Q|{#{o}, "poke"}|] + [%Q|{#{o}, "peek"}|] * 9).join(', ')
+      assert_equal [3] * 10, simplify(command(%Q|; return call_in_parallel({#{ten}});|))
+      assert_equal E_QUOTA, simplify(command(%Q|; return call_in_parallel({{#{o}, "poke"}, #{ten}});|))
+      assert_equal 3, get(o, 'pokes')
+    end
+  end
+
+  def test_that_commands_with_the_p_flag_are_tried_in_a_worker_first
+    run_test_with_prefix_and_suffix_as('wizard') do
+      room = create(MooObj.new('#2'))
+      add_property(room, 'count', 0, ['player', 'r'])
+      add_verb(room, ['player', 'xd', 'accept'], ['this', 'none', 'this'])
+      set_verb_code(room, 'accept') do |vc|
+        vc << %Q|return 1;|
+      end
+      add_verb(room, ['player', 'xdp', 'tally'], ['any', 'none', 'none'])
+      set_verb_code(room, 'tally') do |vc|
+        vc << %Q|s = 0;|
+        vc << %Q|for i in [1..toint(dobjstr)]|
+        vc << %Q|  s = s + i;|
+        vc << %Q|endfor|
+        vc << %Q|notify(player, "tally " + tostr(s));|
+      end
+      add_verb(room, ['player', 'xdp', 'bump'], ['none', 'none', 'none'])
+      set_verb_code(room, 'bump') do |vc|
+        vc << %Q|notify(player, "bumping");|
+        vc << %Q|this.count = this.count + 1;|
+        vc << %Q|notify(player, "bumped " + tostr(this.count));|
+      end
+      move(player, room)
+      assert_equal 'xdp', simplify(command(%Q|; return verb_info(#{room}, "tally")[2];|))
+
+      before = simplify(command(%Q|; return parallel_call_stats();|))
+      assert_equal 'tally 5050', command('tally 100')
+      # a command that changes something is run over again by the
+      # server, and only the output of that run is sent
+      assert_equal ['bumping', 'bumped 1'], command('bump')
+      assert_equal 1, get(room, 'count')
+      after = simplify(command(%Q|; return parallel_call_stats();|))
+      assert_equal before['commands'] + 2, after['commands']
+      assert_equal before['conflicts'] + 1, after['conflicts']
+      assert_equal before['retried'] + 1, after['retried']
+      assert_equal 'property assignment', after['last_conflict']
+
+      # without the flag, the server runs the command itself
+      command(%Q|; set_verb_info(#{room}, "bump", {player, "xd", "bump"});|)
+      assert_equal ['bumping', 'bumped 2'], command('bump')
+      assert_equal after['commands'], simplify(command(%Q|; return parallel_call_stats()["commands"];|))
+
+      # input that comes in while a command is in its worker waits for
+      # it (both lines are sent at once, so they arrive together)
+      assert_equal 'tally 12502500', command(%Q|tally 5000\n; notify(player, "after");|)
+    end
+  end
+
+  def test_that_queries_check_their_arguments
+    run_test_as('programmer') do
+      assert_equal E_PERM, simplify(command(%Q|; return objects_where("name", "foo");|))
+      assert_equal E_PERM, simplify(command(%Q|; return find_verbs_matching("foo");|))
+      assert_equal E_PERM, simplify(command(%Q|; return call_in_parallel({});|))
+      assert_equal E_PERM, simplify(command(%Q|; return parallel_call_stats();|))
+      # only wizards may set the `p' bit
+      o = create(:nothing)
+      assert_equal E_PERM, simplify(command(%Q|; return add_verb(#{o}, {player, "xdp", "foo"}, {"this", "none", "this"});|))
+      add_verb(o, ['player', 'xd', 'foo'], ['this', 'none', 'this'])
+      assert_equal E_PERM, simplify(command(%Q|; return set_verb_info(#{o}, "foo", {player, "xdp", "foo"});|))
+      assert_equal 'xd', simplify(command(%Q|; return verb_info(#{o}, "foo")[2];|))
+    end
+    run_test_as('wizard') do
+      assert_equal [], simplify(command(%Q|; return call_in_parallel({});|))
+      assert_equal E_INVARG, simplify(command(%Q|; return call_in_parallel({{#0}});|))
+      assert_equal E_INVARG, simplify(command(%Q|; return call_in_parallel({{#0, "foo", "bar"}});|))
+      assert_equal E_INVIND, simplify(command(%Q|; return call_in_parallel({{#-1, "foo"}});|))
+      assert_equal E_VERBNF, simplify(command(%Q|; return call_in_parallel({{#0, "no_such_verb"}});|))
+      assert_equal E_TYPE, simplify(command(%Q|; return objects_where(1, "foo");|))
+      assert_equal E_TYPE, simplify(command(%Q|; return find_verbs_matching(1);|))
+      assert_equal E_INVARG, simplify(command(%Q|; return find_verbs_matching("%(");|))
+    end
+  end
+
+end
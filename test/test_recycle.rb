@@ -275,4 +275,29 @@ class TestRecycle < Test::Unit::TestCase
     end
   end
 
+
+  def test_that_object_table_stats_count_the_holes_left_by_recycling
+    run_test_as('programmer') do
+      assert_equal E_PERM, simplify(command(%Q|; return object_table_stats();|))
+    end
+    run_test_as('wizard') do
+      stats = lambda { simplify(command(%Q|; return object_table_stats();|)) }
+      before = stats.call
+      a = create(:nothing)
+      b = create(:nothing)
+      c = create(:nothing)
+      recycle(b)
+      after = stats.call
+      assert_equal before['slots'] + 3, after['slots']
+      assert_equal before['objects'] + 2, after['objects']
+      assert_equal before['recycled'] + 1, after['recycled']
+      assert_equal after['slots'], after['objects'] + after['recycled']
+      assert after['allocated'] >= after['objects'] + after['free']
+      renumber(c)
+      assert_equal after['objects'], stats.call['objects']
+      recycle(a)
+      assert_equal after['recycled'] + 1, stats.call['recycled']
+    end
+  end
+
 end
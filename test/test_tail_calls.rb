@@ -0,0 +1,129 @@
+require 'test_helper'
+
+class TestTailCalls < Test::Unit::TestCase
+
+  def setup
+    run_test_as('wizard') do
+      evaluate('add_property($server_options, "tail_calls", 1, {player, "r"})')
+      evaluate('load_server_options();')
+    end
+  end
+
+  def teardown
+    run_test_as('wizard') do
+      evaluate('delete_property($server_options, "tail_calls")')
+      evaluate('load_server_options();')
+    end
+  end
+
+  def disable_tail_calls
+    evaluate('$server_options.tail_calls = 0')
+    evaluate('load_server_options();')
+  end
+
+  def test_that_tail_calls_do_not_consume_stack
+    run_test_as('wizard') do
+      o = create(:nothing)
+      add_verb(o, ['player', 'xd', 'count'], ['this', 'none', 'this'])
+      set_verb_code(o, 'count') do |vc|
+        vc << %Q|{n, acc} = args;|
+        vc << %Q|if (n == 0) return acc; endif|
+        vc << %Q|return this:count(n - 1, acc + 1);|
+      end
+      assert_equal 500, call(o, 'count', 500, 0)
+      disable_tail_calls
+      assert_equal E_MAXREC, call(o, 'count', 500, 0)
+    end
+  end
+
+  def test_that_pass_is_tail_called
+    run_test_as('wizard') do
+      a = create(:nothing)
+      b = create(a)
+      add_verb(a, ['player', 'xd', 'count'], ['this', 'none', 'this'])
+      set_verb_code(a, 'count') do |vc|
+        vc << %Q|{n, acc} = args;|
+        vc << %Q|if (n == 0) return acc; endif|
+        vc << %Q|return this:count(n - 1, acc + 1);|
+      end
+      add_verb(b, ['player', 'xd', 'count'], ['this', 'none', 'this'])
+      set_verb_code(b, 'count') do |vc|
+        vc << %Q|return pass(@args);|
+      end
+      assert_equal 300, call(b, 'count', 300, 0)
+    end
+  end
+
+  def test_that_callers_still_shows_the_tail_caller
+    run_test_as('wizard') do
+      o = create(:nothing)
+      add_verb(o, ['player', 'xd', 'a'], ['this', 'none', 'this'])
+      set_verb_code(o, 'a') do |vc|
+        vc << %Q|return this:b();|
+      end
+      add_verb(o, ['player', 'xd', 'b'], ['this', 'none', 'this'])
+      set_verb_code(o, 'b') do |vc|
+        vc << %Q|return {caller == this, callers()[1][1] == this, callers()[1][2], caller_perms() == player};|
+      end
+      assert_equal [1, 1, 'a', 1], call(o, 'a')
+    end
+  end
+
+  def test_that_calls_inside_try_are_not_tail_calls
+    run_test_as('wizard') do
+      o = create(:nothing)
+      add_verb(o, ['player', 'xd', 'count'], ['this', 'none', 'this'])
+      set_verb_code(o, 'count') do |vc|
+        vc << %Q|n = args[1];|
+        vc << %Q|if (n == 0) return 0; endif|
+        vc << %Q|try|
+        vc << %Q|return this:count(n - 1);|
+        vc << %Q|finally|
+        vc << %Q|endtry|
+      end
+      assert_equal 0, call(o, 'count', 10)
+      assert_equal E_MAXREC, call(o, 'count', 500)
+    end
+  end
+
+  def test_that_tail_calls_preserve_caller_perms
+    run_test_as('wizard') do
+      o = create(:nothing)
+      add_verb(o, ['player', 'xd', 'a'], ['this', 'none', 'this'])
+      set_verb_code(o, 'a') do |vc|
+        vc << %Q|return this:b();|
+      end
+      add_verb(o, ['player', 'xd', 'b'], ['this', 'none', 'this'])
+      set_verb_code(o, 'b') do |vc|
+        vc << %Q|return this:c();|
+      end
+      add_verb(o, ['player', 'xd', 'c'], ['this', 'none', 'this'])
+      set_verb_code(o, 'c') do |vc|
+        vc << %Q|return {caller_perms(), callers()[1][2]};|
+      end
+      p = simplify command %Q|; return player;|
+      assert_equal [p, 'b'], call(o, 'a')
+    end
+  end
+
+  def test_that_tail_calls_keep_command_variables_set_by_the_caller
+    run_test_as('wizard') do
+      o = create(:nothing)
+      add_verb(o, ['player', 'xd', 'a'], ['this', 'none', 'this'])
+      set_verb_code(o, 'a') do |vc|
+        vc << %Q|dobjstr = "foo";|
+        vc << %Q|return this:b();|
+      end
+      add_verb(o, ['player', 'xd', 'b'], ['this', 'none', 'this'])
+      set_verb_code(o, 'b') do |vc|
+        vc << %Q|return this:c();|
+      end
+      add_verb(o, ['player', 'xd', 'c'], ['this', 'none', 'this'])
+      set_verb_code(o, 'c') do |vc|
+        vc << %Q|return dobjstr;|
+      end
+      assert_equal 'foo', call(o, 'a')
+    end
+  end
+
+end
@@ -0,0 +1,214 @@
+require 'test_helper'
+
+class TestTasks < Test::Unit::TestCase
+
+  def setup_suspender
+    o = create(:nothing)
+    add_property(o, 'results', [], ['player', ''])
+    add_verb(o, ['player', 'xd', 'outer'], ['this', 'none', 'this'])
+    set_verb_code(o, 'outer') do |vc|
+      vc << %Q|r = {};|
+      vc << %Q|for x in ({1, 2})|
+      vc << %Q|  r = {@r, {"outer", x, 100 + this:inner(x, args[1]), "tail"}};|
+      vc << %Q|endfor|
+      vc << %Q|this.results = {@this.results, r};|
+    end
+    add_verb(o, ['player', 'xd', 'inner'], ['this', 'none', 'this'])
+    set_verb_code(o, 'inner') do |vc|
+      vc << %Q|{x, how} = args;|
+      vc << %Q|l = {x, x * 2};|
+      vc << %Q|return l[2] + (how ? suspend(how) \| suspend());|
+    end
+    o
+  end
+
+  def test_that_compacted_suspended_tasks_resume_where_they_left_off
+    run_test_as('wizard') do
+      begin
+        # compact every suspended task, however short its suspension
+        command(%Q|; add_property($server_options, "compact_suspended_after", 0, {player, "r"}); load_server_options();|)
+        o = setup_suspender
+        expected = [['outer', 1, 102, 'tail'], ['outer', 2, 104, 'tail']]
+
+        # woken by the clock
+        command(%Q|; fork (0) #{o}:outer(1); endfork|)
+        sleep 4
+        assert_equal [expected], get(o, 'results')
+
+        # woken by resume(), with a value
+        tasks = simplify(command(%Q|; ts = {}; for i in [1..50] fork t (0) #{o}:outer(0); endfork ts = {@ts, t}; endfor return ts;|))
+        sleep 1
+        command(%Q|; for t in (#{tasks.inspect.tr('[]', '{}')}) resume(t, 0); endfor|)
+        sleep 1
+        command(%Q|; for t in (#{tasks.inspect.tr('[]', '{}')}) resume(t, 0); endfor|)
+        sleep 1
+        assert_equal 51, get(o, 'results').length
+        assert_equal [expected], get(o, 'results').uniq
+
+        # and killed while compacted
+        tasks = simplify(command(%Q|; ts = {}; for i in [1..50] fork t (0) #{o}:outer(0); endfork ts = {@ts, t}; endfor return ts;|))
+        sleep 1
+        assert_equal 50, simplify(command(%Q|; n = 0; for t in (queued_tasks()) n = n + (t[1] in #{tasks.inspect.tr('[]', '{}')} ? 1 \| 0); endfor return n;|))
+        command(%Q|; for t in (#{tasks.inspect.tr('[]', '{}')}) kill_task(t); endfor|)
+        assert_equal 51, get(o, 'results').length
+      ensure
+        command(%Q|; delete_property($server_options, "compact_suspended_after"); load_server_options();|)
+      end
+    end
+  end
+
+  def test_that_queued_tasks_can_be_filtered_and_paged
+    run_test_as('wizard') do
+      a = create(:nothing)
+      b = create(:nothing)
+      [a, b].each do |o|
+        add_verb(o, ['player', 'xd', 'wait'], ['this', 'none', 'this'])
+        set_verb_code(o, 'wait') do |vc|
+          vc << %Q|suspend(3600);|
+        end
+      end
+      ids = simplify(command(%Q|; ids = {}; for i in [1..6] fork t (0) (i <= 4 ? #{a} \| #{b}):wait(); endfork ids = {@ids, t}; endfor fork t (3600) endfork return {@ids, t};|))
+      begin
+        sleep 1
+        mine = %Q|"programmer" -> player|
+        assert_equal 7, simplify(command(%Q|; return queued_tasks([#{mine}, "count" -> 1]);|))
+        assert_equal 4, simplify(command(%Q|; return queued_tasks([#{mine}, "verb_loc" -> #{a}, "count" -> 1]);|))
+        assert_equal 0, simplify(command(%Q|; return queued_tasks(["programmer" -> #0, "count" -> 1]);|))
+        assert_equal 0, simplify(command(%Q|; return queued_tasks([#{mine}, "min_id" -> 1, "max_id" -> 0, "count" -> 1]);|))
+
+        # pages come in the same order as the full list, filtered
+        all = simplify(command(%Q|; return queued_tasks([#{mine}]);|))
+        assert_equal ids.sort, all.map { |t| t[0] }.sort
+        assert all.all? { |t| t[4].to_s == player.to_s }
+        at_b = simplify(command(%Q|; return queued_tasks([#{mine}, "verb_loc" -> #{b}]);|))
+        assert_equal all.select { |t| t[5].to_s == b.to_s }, at_b
+        assert_equal 2, at_b.length
+        pages = (0..4).map { |i| simplify(command(%Q|; return queued_tasks([#{mine}, "offset" -> #{i * 2}, "limit" -> 2]);|)) }
+        assert_equal all, pages.flatten(1)
+        assert_equal [], pages.last
+        assert_equal all[1..-1], simplify(command(%Q|; return queued_tasks([#{mine}, "offset" -> 1]);|))
+
+        one = ids.first
+        assert_equal [one], simplify(command(%Q|; return queued_tasks([#{mine}, "min_id" -> #{one}, "max_id" -> #{one}]);|)).map { |t| t[0] }
+        assert_equal ids.select { |i| i >= one }.sort, simplify(command(%Q|; return queued_tasks([#{mine}, "min_id" -> #{one}]);|)).map { |t| t[0] }.sort
+
+        assert_equal E_TYPE, simplify(command(%Q|; return queued_tasks(["limit" -> "2"]);|))
+        assert_equal E_TYPE, simplify(command(%Q|; return queued_tasks(["programmer" -> 2]);|))
+        assert_equal E_INVARG, simplify(command(%Q|; return queued_tasks(["limit" -> -1]);|))
+        assert_equal E_INVARG, simplify(command(%Q|; return queued_tasks(["colour" -> 1]);|))
+        assert_equal E_TYPE, simplify(command(%Q|; return queued_tasks(1);|))
+      ensure
+        command(%Q|; for t in (#{ids.inspect.tr('[]', '{}')}) kill_task(t); endfor|)
+      end
+    end
+  end
+
+  def setup_cruncher
+    o = create(:nothing)
+    add_property(o, 'results', [], ['player', ''])
+    add_verb(o, ['player', 'xd', 'crunch'], ['this', 'none', 'this'])
+    set_verb_code(o, 'crunch') do |vc|
+      vc << %Q|t = ticks_left();|
+      vc << %Q|s = 0;|
+      vc << %Q|for i in [1..args[1]]|
+      vc << %Q|  s = s + (args[2] ? this:identity(i) \| i);|
+      vc << %Q|endfor|
+      vc << %Q|this.results = {@this.results, {s, t - ticks_left()}};|
+    end
+    add_verb(o, ['player', 'xd', 'identity'], ['this', 'none', 'this'])
+    set_verb_code(o, 'identity') do |vc|
+      vc << %Q|return args[1];|
+    end
+    o
+  end
+
+  def test_that_preempted_background_tasks_carry_on_where_they_left_off
+    run_test_as('wizard') do
+      begin
+        o = setup_cruncher
+        command(%Q|; fork (0) #{o}:crunch(2000, 0); endfork fork (0) #{o}:crunch(300, 1); endfork|)
+        sleep 1
+        unpreempted = get(o, 'results')
+        assert_equal [2001000, 45150], unpreempted.map(&:first)
+
+        set(o, 'results', [])
+        command(%Q|; add_property($server_options, "bg_quantum", 500, {player, "r"}); load_server_options();|)
+        command(%Q|; fork (0) #{o}:crunch(2000, 0); endfork fork (0) #{o}:crunch(300, 1); endfork|)
+        sleep 1
+        # the same sums, using the same number of ticks
+        assert_equal unpreempted.sort, get(o, 'results').sort
+
+        # the tick limit still applies
+        command(%Q|; fork (0) while (1) endwhile endfork|)
+        sleep 1
+        assert_equal 0, simplify(command(%Q|; return queued_tasks(["count" -> 1]);|))
+      ensure
+        command(%Q|; delete_property($server_options, "bg_quantum"); load_server_options();|)
+      end
+    end
+  end
+
+  def test_that_preempted_background_tasks_still_run_out_of_seconds
+    run_test_as('wizard') do
+      begin
+        o = create(:nothing)
+        add_property(o, 'reason', '', ['player', ''])
+        add_verb(MooObj.new('#0'), ['player', 'xd', 'handle_task_timeout'], ['this', 'none', 'this'])
+        set_verb_code(MooObj.new('#0'), 'handle_task_timeout') do |vc|
+          vc << %Q|#{o}.reason = args[1];|
+        end
+        # far more ticks than it could use in the time allowed
+        command(%Q|; add_property($server_options, "bg_ticks", 2000000000, {player, "r"}); add_property($server_options, "bg_seconds", 1, {player, "r"});|)
+        command(%Q|; add_property($server_options, "bg_quantum", 1000, {player, "r"}); load_server_options();|)
+        command(%Q|; fork (0) while (1) endwhile endfork|)
+        start = Time.now
+        sleep 0.2 while get(o, 'reason') == '' && Time.now - start < 60
+        assert_equal 'seconds', get(o, 'reason')
+      ensure
+        command(%Q|; delete_verb(#0, "handle_task_timeout");|)
+        command(%Q|; for p in ({"bg_ticks", "bg_seconds", "bg_quantum"}) delete_property($server_options, p); endfor load_server_options();|)
+      end
+    end
+  end
+
+  def test_that_quanta_ending_inside_try_do_not_use_up_the_ticks
+    run_test_as('wizard') do
+      begin
+        o = create(:nothing)
+        add_property(o, 'done', [], ['player', ''])
+        command(%Q|; add_property($server_options, "bg_ticks", 2000000000, {player, "r"}); add_property($server_options, "bg_seconds", 60, {player, "r"});|)
+        command(%Q|; add_property($server_options, "bg_quantum", 1000, {player, "r"}); load_server_options();|)
+        # the quantum ends at every point of the loop for one size or another
+        (1000..1007).each do |quantum|
+          command(%Q|; $server_options.bg_quantum = #{quantum}; load_server_options();|)
+          command(%Q|; fork (0) for i in [1..5000] try x = E_PERM; except (ANY) endtry n = i; endfor #{o}.done = {@#{o}.done, #{quantum}}; endfork|)
+          start = Time.now
+          sleep 0.2 while get(o, 'done').length < quantum - 999 && Time.now - start < 30
+        end
+        assert_equal (1000..1007).to_a, get(o, 'done')
+      ensure
+        command(%Q|; for p in ({"bg_ticks", "bg_seconds", "bg_quantum"}) delete_property($server_options, p); endfor load_server_options();|)
+      end
+    end
+  end
+
+  def test_that_commands_run_between_the_quanta_of_a_long_background_task
+    run_test_as('wizard') do
+      begin
+        o = setup_cruncher
+        command(%Q|; add_property($server_options, "bg_ticks", 10000000, {player, "r"}); add_property($server_options, "bg_seconds", 60, {player, "r"});|)
+        command(%Q|; add_property($server_options, "bg_quantum", 10000, {player, "r"}); load_server_options();|)
+        command(%Q|; fork (0) #{o}:crunch(1000000, 0); endfork|)
+        # it's still crunching when the next command comes in
+        assert_equal [], get(o, 'results')
+        start = Time.now
+        sleep 0.2 while get(o, 'results') == [] && Time.now - start < 30
+        # and it ran to the end, using all the ticks it needed
+        assert get(o, 'results')[0][1] > 5000000
+      ensure
+        command(%Q|; for p in ({"bg_ticks", "bg_seconds", "bg_quantum"}) delete_property($server_options, p); endfor load_server_options();|)
+      end
+    end
+  end
+
+end
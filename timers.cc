@@ -22,6 +22,7 @@
 #include "my-unistd.h"
 
 #include "config.h"
+#include "storage.h"
 #include "timers.h"
 
 #if (defined(MACH) && defined(CMU)) || !defined(SIGVTALRM)
@@ -29,178 +30,280 @@
 #  undef ITIMER_VIRTUAL
 #endif
 
+#if defined(__linux__) && defined(CLOCK_MONOTONIC)
+#  include <sys/timerfd.h>
+#  define HAVE_TIMERFD 1
+#endif
+
+/* Wall-clock timers are kept in a binary heap ordered by when they are
+ * due, in milliseconds.  They are delivered by SIGALRM until the server
+ * asks for them to be delivered through a file descriptor instead (see
+ * use_timer_fd()), after which no signal handler runs for them at all.
+ * The one virtual timer, used to limit the seconds a task may run, is
+ * separate; it only sets a flag for the interpreter, and setting and
+ * cancelling it costs a single setitimer() call each.
+ */
+
 typedef struct Timer_Entry Timer_Entry;
 struct Timer_Entry {
-    Timer_Entry *next;
-    time_t when;
+    long long when;
     Timer_Proc proc;
     Timer_Data data;
     Timer_ID id;
 };
 
-static Timer_Entry *active_timers = 0;
-static Timer_Entry *free_timers = 0;
-static Timer_Entry *virtual_timer = 0;
+static Timer_Entry *heap = 0;
+static int heap_size = 0;
+static int heap_max = 0;
+static Timer_Entry virtual_timer;
+static int virtual_timer_set = 0;
 static Timer_ID next_id = 0;
+static int timer_fd = -1;
 
-static Timer_Entry *
-allocate_timer(void)
+static long long
+now_ms(void)
 {
-    if (free_timers) {
-	Timer_Entry *_this = free_timers;
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+#else
+    struct timeval tv;
 
-	free_timers = _this->next;
-	return _this;
-    } else
-	return (Timer_Entry *) malloc(sizeof(Timer_Entry));
+    gettimeofday(&tv, 0);
+    return tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+#endif
 }
 
 static void
-free_timer(Timer_Entry *_this)
+block_alarms(sigset_t * old)
 {
-    _this->next = free_timers;
-    free_timers = _this;
+    sigset_t sigs;
+
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGALRM);
+    sigprocmask(SIG_BLOCK, &sigs, old);
 }
 
-static void restart_timers(void);
+#define BLOCK_ALARMS(old)   sigset_t old; block_alarms(&old)
+#define UNBLOCK_ALARMS(old) sigprocmask(SIG_SETMASK, &old, 0)
 
 static void
-wakeup_call(int signo)
+sift_up(int i)
 {
-    Timer_Entry *_this = active_timers;
-    Timer_Proc proc = _this->proc;
-    Timer_ID id = _this->id;
-    Timer_Data data = _this->data;
-
-    active_timers = active_timers->next;
-    free_timer(_this);
-    restart_timers();
-    if (proc)
-	(*proc) (id, data);
-}
+    Timer_Entry t = heap[i];
 
+    while (i > 0 && t.when < heap[(i - 1) / 2].when) {
+	heap[i] = heap[(i - 1) / 2];
+	i = (i - 1) / 2;
+    }
+    heap[i] = t;
+}
 
-#ifdef ITIMER_VIRTUAL
 static void
-virtual_wakeup_call(int signo)
+sift_down(int i)
 {
-    Timer_Entry *_this = virtual_timer;
-    Timer_Proc proc = _this->proc;
-    Timer_ID id = _this->id;
-    Timer_Data data = _this->data;
-
-    virtual_timer = 0;
-    free_timer(_this);
-    if (proc)
-	(*proc) (id, data);
+    Timer_Entry t = heap[i];
+    int child;
+
+    while ((child = 2 * i + 1) < heap_size) {
+	if (child + 1 < heap_size && heap[child + 1].when < heap[child].when)
+	    child++;
+	if (t.when <= heap[child].when)
+	    break;
+	heap[i] = heap[child];
+	i = child;
+    }
+    heap[i] = t;
 }
-#endif
 
 static void
-stop_timers()
+remove_timer(int i)
 {
-    alarm(0);
-    signal(SIGALRM, SIG_IGN);
-    signal(SIGALRM, wakeup_call);
+    heap[i] = heap[--heap_size];
+    if (i < heap_size) {
+	sift_down(i);
+	sift_up(i);
+    }
+}
 
-#ifdef ITIMER_VIRTUAL
-    {
-	struct itimerval itimer, oitimer;
+static int
+find_timer(Timer_ID id)
+{
+    int i;
 
-	itimer.it_value.tv_sec = 0;
-	itimer.it_value.tv_usec = 0;
-	itimer.it_interval.tv_sec = 0;
-	itimer.it_interval.tv_usec = 0;
+    for (i = 0; i < heap_size; i++)
+	if (heap[i].id == id)
+	    return i;
+    return -1;
+}
 
-	setitimer(ITIMER_VIRTUAL, &itimer, &oitimer);
-	signal(SIGVTALRM, SIG_IGN);
-	signal(SIGVTALRM, virtual_wakeup_call);
-	if (virtual_timer)
-	    virtual_timer->when = oitimer.it_value.tv_sec;
+/* Arranges for the earliest timer, if any, to be delivered when due. */
+static void
+arm_timers(void)
+{
+#ifdef HAVE_TIMERFD
+    if (timer_fd >= 0) {
+	struct itimerspec its;
+
+	its.it_interval.tv_sec = its.it_interval.tv_nsec = 0;
+	its.it_value.tv_sec = its.it_value.tv_nsec = 0;
+	if (heap_size) {
+	    its.it_value.tv_sec = heap[0].when / 1000;
+	    /* never all zeros, which would disarm it */
+	    its.it_value.tv_nsec = heap[0].when % 1000 * 1000000 + 1;
+	}
+	timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, 0);
+	return;
     }
 #endif
+    {
+	struct itimerval itimer;
+
+	itimer.it_interval.tv_sec = itimer.it_interval.tv_usec = 0;
+	itimer.it_value.tv_sec = itimer.it_value.tv_usec = 0;
+	if (heap_size) {
+	    long long delay = heap[0].when - now_ms();
+
+	    if (delay < 1)	/* we're already late... */
+		delay = 1;
+	    itimer.it_value.tv_sec = delay / 1000;
+	    itimer.it_value.tv_usec = delay % 1000 * 1000;
+	}
+	setitimer(ITIMER_REAL, &itimer, 0);
+    }
 }
 
+/* Called with SIGALRM blocked, or with timers delivered through
+ * timer_fd.  A timer's proc may not return (see net_sysv_tcp.cc), so the
+ * next timer is armed before each one is called.
+ */
 static void
-restart_timers()
+run_expired_timers(void)
 {
-    if (active_timers) {
-	time_t now = time(0);
+    long long now = now_ms();
 
-	signal(SIGALRM, wakeup_call);
+    while (heap_size && heap[0].when <= now) {
+	Timer_Entry t = heap[0];
 
-	if (now < active_timers->when)	/* first timer is in the future */
-	    alarm(active_timers->when - now);
-	else
-	    kill(getpid(), SIGALRM);	/* we're already late... */
+	remove_timer(0);
+	arm_timers();
+	if (t.proc)
+	    (*t.proc) (t.id, t.data);
     }
+    arm_timers();
+}
+
+static void
+wakeup_call(int signo)
+{
+    signal(SIGALRM, wakeup_call);
+    run_expired_timers();
+}
+
 #ifdef ITIMER_VIRTUAL
+static void
+virtual_wakeup_call(int signo)
+{
+    signal(SIGVTALRM, virtual_wakeup_call);
+    if (virtual_timer_set) {
+	virtual_timer_set = 0;
+	if (virtual_timer.proc)
+	    (*virtual_timer.proc) (virtual_timer.id, virtual_timer.data);
+    }
+}
+#endif
 
-    if (virtual_timer) {
-	signal(SIGVTALRM, virtual_wakeup_call);
+static void
+set_virtual_itimer(unsigned ms)
+{
+#ifdef ITIMER_VIRTUAL
+    struct itimerval itimer;
 
-	if (virtual_timer->when > 0) {
-	    struct itimerval itimer;
+    itimer.it_value.tv_sec = ms / 1000;
+    itimer.it_value.tv_usec = ms % 1000 * 1000;
+    itimer.it_interval.tv_sec = 0;
+    itimer.it_interval.tv_usec = 0;
 
-	    itimer.it_value.tv_sec = virtual_timer->when;
-	    itimer.it_value.tv_usec = 0;
-	    itimer.it_interval.tv_sec = 0;
-	    itimer.it_interval.tv_usec = 0;
+    setitimer(ITIMER_VIRTUAL, &itimer, 0);
+#endif
+}
 
-	    setitimer(ITIMER_VIRTUAL, &itimer, 0);
-	} else
-	    kill(getpid(), SIGVTALRM);
-    }
+static void
+initialize_timers(void)
+{
+    static int initialized = 0;
+
+    if (!initialized) {
+	signal(SIGALRM, wakeup_call);
+#ifdef ITIMER_VIRTUAL
+	signal(SIGVTALRM, virtual_wakeup_call);
 #endif
+	initialized = 1;
+    }
 }
 
-Timer_ID
-set_timer(unsigned seconds, Timer_Proc proc, Timer_Data data)
+static Timer_ID
+add_timer(long long ms, Timer_Proc proc, Timer_Data data)
 {
-    Timer_Entry *_this = allocate_timer();
-    Timer_Entry **t;
+    Timer_ID id;
 
-    _this->id = next_id++;
-    _this->when = time(0) + seconds;
-    _this->proc = proc;
-    _this->data = data;
+    initialize_timers();
 
-    stop_timers();
+    BLOCK_ALARMS(old);
 
-    t = &active_timers;
-    while (*t && _this->when >= (*t)->when)
-	t = &((*t)->next);
-    _this->next = *t;
-    *t = _this;
+    if (heap_size == heap_max) {
+	heap_max = heap_max ? heap_max * 2 : 8;
+	heap = (Timer_Entry *) myrealloc(heap, heap_max * sizeof(Timer_Entry),
+					  M_ARRAY);
+    }
+    id = next_id++;
+    heap[heap_size].id = id;
+    heap[heap_size].when = now_ms() + ms;
+    heap[heap_size].proc = proc;
+    heap[heap_size].data = data;
+    sift_up(heap_size++);
+    arm_timers();
 
-    restart_timers();
+    UNBLOCK_ALARMS(old);
 
-    return _this->id;
+    return id;
+}
+
+Timer_ID
+set_timer(unsigned seconds, Timer_Proc proc, Timer_Data data)
+{
+    return add_timer(seconds * 1000LL, proc, data);
 }
 
 Timer_ID
 set_virtual_timer(unsigned seconds, Timer_Proc proc, Timer_Data data)
+{
+    return set_virtual_timer_ms(seconds * 1000, proc, data);
+}
+
+Timer_ID
+set_virtual_timer_ms(unsigned ms, Timer_Proc proc, Timer_Data data)
 {
 #ifdef ITIMER_VIRTUAL
 
-    if (virtual_timer)
+    if (virtual_timer_set)
 	return -1;
 
-    stop_timers();
-
-    virtual_timer = allocate_timer();
-    virtual_timer->id = next_id++;
-    virtual_timer->when = seconds;
-    virtual_timer->proc = proc;
-    virtual_timer->data = data;
+    initialize_timers();
 
-    restart_timers();
+    virtual_timer.id = next_id++;
+    virtual_timer.proc = proc;
+    virtual_timer.data = data;
+    virtual_timer_set = 1;
+    set_virtual_itimer(ms);
 
-    return virtual_timer->id;
+    return virtual_timer.id;
 
 #else				/* !ITIMER_VIRTUAL */
 
-    return set_timer(seconds, proc, data);
+    return add_timer(ms, proc, data);
 
 #endif
 }
@@ -218,61 +321,122 @@ virtual_timer_available()
 unsigned
 timer_wakeup_interval(Timer_ID id)
 {
-    Timer_Entry *t;
+    return timer_wakeup_interval_ms(id) / 1000;
+}
+
+unsigned
+timer_wakeup_interval_ms(Timer_ID id)
+{
+    unsigned interval = 0;
+    int i;
 
 #ifdef ITIMER_VIRTUAL
 
-    if (virtual_timer && virtual_timer->id == id) {
+    if (virtual_timer_set && virtual_timer.id == id) {
 	struct itimerval itimer;
 
 	getitimer(ITIMER_VIRTUAL, &itimer);
-	return itimer.it_value.tv_sec;
+	return itimer.it_value.tv_sec * 1000 + itimer.it_value.tv_usec / 1000;
     }
 #endif
 
-    for (t = active_timers; t; t = t->next)
-	if (t->id == id)
-	    return t->when - time(0);;
+    BLOCK_ALARMS(old);
 
-    return 0;
+    if ((i = find_timer(id)) >= 0) {
+	long long left = heap[i].when - now_ms();
+
+	interval = left > 0 ? left : 0;
+    }
+
+    UNBLOCK_ALARMS(old);
+
+    return interval;
 }
 
 void
 timer_sleep(unsigned seconds)
 {
-    set_timer(seconds, 0, 0);
-    pause();
+    while ((seconds = sleep(seconds)) > 0)
+	;
 }
 
 int
 cancel_timer(Timer_ID id)
 {
-    Timer_Entry **t = &active_timers;
     int found = 0;
+    int i;
+
+    if (virtual_timer_set && virtual_timer.id == id) {
+	set_virtual_itimer(0);
+	virtual_timer_set = 0;
+	return 1;
+    }
 
-    stop_timers();
+    BLOCK_ALARMS(old);
 
-    if (virtual_timer && virtual_timer->id == id) {
-	free_timer(virtual_timer);
-	virtual_timer = 0;
+    if ((i = find_timer(id)) >= 0) {
 	found = 1;
-    } else {
-	while (*t) {
-	    if ((*t)->id == id) {
-		Timer_Entry *tt = *t;
-
-		*t = tt->next;
-		found = 1;
-		free_timer(tt);
-		break;
+	remove_timer(i);
+	if (i == 0)
+	    arm_timers();
+    }
+
+    UNBLOCK_ALARMS(old);
+
+    return found;
+}
+
+void
+reset_virtual_timer(void)
+{
+    set_virtual_itimer(0);
+    virtual_timer_set = 0;
+}
+
+int
+use_timer_fd(void)
+{
+#ifdef HAVE_TIMERFD
+    if (timer_fd < 0) {
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if (fd >= 0) {
+	    BLOCK_ALARMS(old);
+
+	    {
+		struct itimerval itimer;
+
+		itimer.it_interval.tv_sec = itimer.it_interval.tv_usec = 0;
+		itimer.it_value.tv_sec = itimer.it_value.tv_usec = 0;
+		setitimer(ITIMER_REAL, &itimer, 0);
 	    }
-	    t = &((*t)->next);
+	    timer_fd = fd;
+	    arm_timers();
+
+	    UNBLOCK_ALARMS(old);
 	}
     }
+    return timer_fd;
+#else
+    return -1;
+#endif
+}
 
-    restart_timers();
+void
+run_timers(void)
+{
+#ifdef HAVE_TIMERFD
+    unsigned long long expirations;
 
-    return found;
+    if (timer_fd >= 0)
+	while (read(timer_fd, &expirations, sizeof(expirations)) > 0)
+	    ;
+#endif
+    BLOCK_ALARMS(old);
+
+    run_expired_timers();
+
+    UNBLOCK_ALARMS(old);
 }
 
 void
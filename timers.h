@@ -29,7 +29,26 @@ extern Timer_ID set_virtual_timer(unsigned, Timer_Proc, Timer_Data);
 extern int cancel_timer(Timer_ID);
 extern void reenable_timers(void);
 extern unsigned timer_wakeup_interval(Timer_ID);
+
+/* The same, in milliseconds rather than seconds. */
+extern Timer_ID set_virtual_timer_ms(unsigned, Timer_Proc, Timer_Data);
+extern unsigned timer_wakeup_interval_ms(Timer_ID);
 extern void timer_sleep(unsigned seconds);
 extern int virtual_timer_available();
 
+/* reset_virtual_timer() forgets the virtual timer, if any, without
+ * running it; a forked child calls it, since it doesn't inherit the
+ * itimer itself along with the record of it.
+ */
+extern void reset_virtual_timer(void);
+
+/* use_timer_fd() switches the wall-clock timers from SIGALRM to a file
+ * descriptor, which it returns, that becomes readable whenever a timer
+ * is due; the caller must then call run_timers() to run them.  Returns
+ * -1, leaving timers as they were, if that isn't possible here.  Timers
+ * delivered this way never interrupt a system call.
+ */
+extern int use_timer_fd(void);
+extern void run_timers(void);
+
 #endif				/* !Timers_H */
@@ -106,6 +106,10 @@ validate_verb_info(Var v, Objid * owner, unsigned *flags, const char **names)
 	case 'D':
 	    *flags |= VF_DEBUG;
 	    break;
+	case 'p':
+	case 'P':
+	    *flags |= VF_PARALLEL;
+	    break;
 	default:
 	    return E_INVARG;
 	}
@@ -195,7 +199,8 @@ bf_add_verb(Var arglist, Byte next, void *vdata, Objid progr)
 	free_str(names);
 	e = E_INVARG;
     } else if (!db_object_allows(obj, progr, FLAG_WRITE)
-	       || (progr != owner && !is_wizard(progr))) {
+	       || (progr != owner && !is_wizard(progr))
+	       || ((flags & VF_PARALLEL) && !is_wizard(progr))) {
 	free_str(names);
 	e = E_PERM;
     } else {
@@ -275,7 +280,7 @@ bf_verb_info(Var arglist, Byte next, void *vdata, Objid progr)
     db_verb_handle h;
     Var r;
     unsigned flags;
-    char perms[5], *s;
+    char perms[6], *s;
     enum error e;
 
     if (!is_object(obj)) {
@@ -308,6 +313,8 @@ bf_verb_info(Var arglist, Byte next, void *vdata, Objid progr)
 	*s++ = 'x';
     if (flags & VF_DEBUG)
 	*s++ = 'd';
+    if (flags & VF_PARALLEL)
+	*s++ = 'p';
     *s = '\0';
     r.v.list[2].v.str = str_dup(perms);
     r.v.list[3].type = TYPE_STR;
@@ -350,7 +357,9 @@ bf_set_verb_info(Var arglist, Byte next, void *vdata, Objid progr)
 	free_str(new_names);
 	return make_error_pack(E_VERBNF);
     } else if (!db_verb_allows(h, progr, VF_WRITE)
-	       || (!is_wizard(progr) && db_verb_owner(h) != new_owner)) {
+	       || (!is_wizard(progr) && db_verb_owner(h) != new_owner)
+	       || (!is_wizard(progr) && (new_flags & VF_PARALLEL)
+		   && !(db_verb_flags(h) & VF_PARALLEL))) {
 	free_str(new_names);
 	return make_error_pack(E_PERM);
     }
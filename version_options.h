@@ -84,6 +84,11 @@ _DDEF("BYTECODE_REDUCE_REF")
 #else
 _DNDEF("BYTECODE_REDUCE_REF")
 #endif
+#ifdef BYTECODE_INT_OPS
+_DDEF("BYTECODE_INT_OPS")
+#else
+_DNDEF("BYTECODE_INT_OPS")
+#endif
 #ifdef STRING_INTERNING
 _DDEF("STRING_INTERNING")
 #else